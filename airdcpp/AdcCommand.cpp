@@ -35,163 +35,116 @@ AdcCommand::AdcCommand(const string& aLine, bool nmdc /* = false */) : cmdInt(0)
 	parse(aLine, nmdc);
 }
 
-void AdcCommand::parse(const string& aLine, bool nmdc /* = false */) {
-	string::size_type i = 5;
-
-	if(nmdc) {
-		// "$ADCxxx ..."
-		if(aLine.length() < 7)
-			throw ParseException("Too short");
-		type = TYPE_CLIENT;
-		cmd[0] = aLine[4];
-		cmd[1] = aLine[5];
-		cmd[2] = aLine[6];
-		i += 3;
-	} else {
-		// "yxxx ..."
-		if(aLine.length() < 4)
-			throw ParseException("Too short");
-		type = aLine[0];
-		cmd[0] = aLine[1];
-		cmd[1] = aLine[2];
-		cmd[2] = aLine[3];
-	}
-
-	if(type != TYPE_BROADCAST && type != TYPE_CLIENT && type != TYPE_DIRECT && type != TYPE_ECHO && type != TYPE_FEATURE && type != TYPE_INFO && type != TYPE_HUB && type != TYPE_UDP) {
-		throw ParseException("Invalid type");
-	}
-
-	if(type == TYPE_INFO) {
-		from = HUB_SID;
-	}
+AdcCommand::AdcCommand(const AdcCommandView& aView) noexcept : cmdInt(0), type(TYPE_CLIENT) {
+	assign(aView);
+}
 
-	string::size_type len = aLine.length();
-	const char* buf = aLine.c_str();
-	string cur;
-	cur.reserve(128);
+void AdcCommand::parse(const string& aLine, bool nmdc /* = false */) {
+	assign(AdcCommandView(aLine, nmdc));
+}
 
-	bool toSet = false;
-	bool featureSet = false;
-	bool fromSet = nmdc; // $ADCxxx never have a from CID...
+void AdcCommand::assign(const AdcCommandView& aView) noexcept {
+	type = aView.getType();
+	cmdInt = aView.getCommand();
+	from = aView.getFrom();
+	to = aView.getTo();
 
-	while(i < len) {
-		switch(buf[i]) {
-		case '\\':
-			++i;
-			if(i == len)
-				throw ParseException("Escape at eol");
-			if(buf[i] == 's')
-				cur += ' ';
-			else if(buf[i] == 'n')
-				cur += '\n';
-			else if(buf[i] == '\\')
-				cur += '\\';
-			else if(buf[i] == ' ' && nmdc)	// $ADCGET escaping, leftover from old specs
-				cur += ' ';
-			else
-				throw ParseException("Unknown escape");
-			break;
-		case ' ': 
-			// New parameter...
-			{
-				if((type == TYPE_BROADCAST || type == TYPE_DIRECT || type == TYPE_ECHO || type == TYPE_FEATURE) && !fromSet) {
-					if(cur.length() != 4) {
-						throw ParseException("Invalid SID length");
-					}
-					from = toSID(cur);
-					fromSet = true;
-				} else if((type == TYPE_DIRECT || type == TYPE_ECHO) && !toSet) {
-					if(cur.length() != 4) {
-						throw ParseException("Invalid SID length");
-					}
-					to = toSID(cur);
-					toSet = true;
-				} else if(type == TYPE_FEATURE && !featureSet) {
-					if(cur.length() % 5 != 0) {
-						throw ParseException("Invalid feature length");
-					}
-					// Skip...
-					featureSet = true;
-				} else {
-					parameters.push_back(cur);
-				}
-				cur.clear();
-			}
-			break;
-		default:
-			cur += buf[i];
-		}
-		++i;
-	}
-	if(!cur.empty()) {
-		if((type == TYPE_BROADCAST || type == TYPE_DIRECT || type == TYPE_ECHO || type == TYPE_FEATURE) && !fromSet) {
-			if(cur.length() != 4) {
-				throw ParseException("Invalid SID length");
-			}
-			from = toSID(cur);
-			fromSet = true;
-		} else if((type == TYPE_DIRECT || type == TYPE_ECHO) && !toSet) {
-			if(cur.length() != 4) {
-				throw ParseException("Invalid SID length");
-			}
-			to = toSID(cur);
-			toSet = true;
-		} else if(type == TYPE_FEATURE && !featureSet) {
-			if(cur.length() % 5 != 0) {
-				throw ParseException("Invalid feature length");
-			}
-			// Skip...
-			featureSet = true;
+	parameters.reserve(parameters.size() + aView.getParameterCount());
+	for (size_t i = 0; i < aView.getParameterCount(); ++i) {
+		auto p = aView.getRawParam(i);
+		if (p.find('\\') == string_view::npos) {
+			parameters.emplace_back(p);
 		} else {
-			parameters.push_back(cur);
+			parameters.push_back(AdcCommandView::unescape(p));
 		}
 	}
-
-	if((type == TYPE_BROADCAST || type == TYPE_DIRECT || type == TYPE_ECHO || type == TYPE_FEATURE) && !fromSet) {
-		throw ParseException("Missing from_sid");
-	}
-	
-	if(type == TYPE_FEATURE && !featureSet) {
-		throw ParseException("Missing feature");
-	}
-	
-	if((type == TYPE_DIRECT || type == TYPE_ECHO) && !toSet) {
-		throw ParseException("Missing to_sid");
-	}
 }
 
 string AdcCommand::toString(const CID& aCID) const noexcept {
-	return getHeaderString(aCID) + getParamString(false);
+	dcassert(type == TYPE_UDP);
+
+	string tmp;
+	tmp.reserve(5 + 39 + getParamLength(false));
+
+	tmp += getType();
+	tmp += cmdChar;
+	tmp += ' ';
+	tmp += aCID.toBase32();
+	appendParams(false, tmp);
+	return tmp;
 }
 
 string AdcCommand::toString() const noexcept {
-	return getHeaderString() + getParamString(false);
+	dcassert(type == TYPE_UDP);
+
+	string tmp;
+	tmp.reserve(4 + getParamLength(false));
+
+	tmp += getType();
+	tmp += cmdChar;
+	appendParams(false, tmp);
+	return tmp;
 }
 
 string AdcCommand::toString(uint32_t sid /* = 0 */, bool nmdc /* = false */) const noexcept {
-	return getHeaderString(sid, nmdc) + getParamString(nmdc);
+	string tmp;
+	tmp.reserve(getHeaderLength(nmdc) + getParamLength(nmdc));
+
+	appendHeader(sid, nmdc, tmp);
+	appendParams(nmdc, tmp);
+	return tmp;
 }
 
-string AdcCommand::escape(const string& str, bool old) noexcept {
-	string tmp = str;
-	string::size_type i = 0;
-	while( (i = tmp.find_first_of(" \n\\", i)) != string::npos) {
-		if(old) {
-			tmp.insert(i, "\\");
-		} else {
-			switch(tmp[i]) {
-				case ' ': tmp.replace(i, 1, "\\s"); break;
-				case '\n': tmp.replace(i, 1, "\\n"); break;
-				case '\\': tmp.replace(i, 1, "\\\\"); break;
-			}
+size_t AdcCommand::getEscapedLength(const string& str, bool /*old*/) noexcept {
+	// Each escaped character takes two bytes in both formats
+	auto len = str.size();
+	for (auto c: str) {
+		if (c == ' ' || c == '\n' || c == '\\') {
+			len++;
+		}
+	}
+
+	return len;
+}
+
+void AdcCommand::escape(const string& str, bool old, string& out_) noexcept {
+	for (auto c: str) {
+		switch (c) {
+			case ' ': out_ += old ? "\\ " : "\\s"; break;
+			case '\n': out_ += old ? "\\\n" : "\\n"; break;
+			case '\\': out_ += "\\\\"; break;
+			default: out_ += c;
 		}
-		i+=2;
 	}
-	return tmp;
 }
 
-string AdcCommand::getHeaderString(uint32_t sid, bool nmdc) const noexcept {
+string AdcCommand::escape(const string& str, bool old) noexcept {
 	string tmp;
+	tmp.reserve(getEscapedLength(str, old));
+	escape(str, old, tmp);
+	return tmp;
+}
+
+size_t AdcCommand::getHeaderLength(bool nmdc) const noexcept {
+	// Type/$ADC + command
+	size_t len = nmdc ? 7 : 4;
+
+	if(type == TYPE_BROADCAST || type == TYPE_DIRECT || type == TYPE_ECHO || type == TYPE_FEATURE) {
+		len += 5;
+	}
+
+	if(type == TYPE_DIRECT || type == TYPE_ECHO) {
+		len += 5;
+	}
+
+	if(type == TYPE_FEATURE) {
+		len += 1 + features.size();
+	}
+
+	return len;
+}
+
+void AdcCommand::appendHeader(uint32_t sid, bool nmdc, string& tmp) const noexcept {
 	if(nmdc) {
 		tmp += "$ADC";
 	} else {
@@ -202,57 +155,44 @@ string AdcCommand::getHeaderString(uint32_t sid, bool nmdc) const noexcept {
 
 	if(type == TYPE_BROADCAST || type == TYPE_DIRECT || type == TYPE_ECHO || type == TYPE_FEATURE) {
 		tmp += ' ';
-		tmp += fromSID(sid);
+		tmp.append(reinterpret_cast<const char*>(&sid), sizeof(sid));
 	}
 
 	if(type == TYPE_DIRECT || type == TYPE_ECHO) {
 		tmp += ' ';
-		tmp += fromSID(to);
+		tmp.append(reinterpret_cast<const char*>(&to), sizeof(to));
 	}
 
 	if(type == TYPE_FEATURE) {
 		tmp += ' ';
 		tmp += features;
 	}
-	return tmp;
 }
 
-string AdcCommand::getHeaderString(const CID& cid) const noexcept {
-	dcassert(type == TYPE_UDP);
-	string tmp;
-	
-	tmp += getType();
-	tmp += cmdChar;
-	tmp += ' ';
-	tmp += cid.toBase32();
-	return tmp;
+const string& AdcCommand::getParam(size_t n) const noexcept {
+	return getParameters().size() > n ? getParameters()[n] : Util::emptyString;
 }
 
-string AdcCommand::getHeaderString() const noexcept {
-	dcassert(type == TYPE_UDP);
-	string tmp;
-	
-	tmp += getType();
-	tmp += cmdChar;
-	return tmp;
-}
+size_t AdcCommand::getParamLength(bool nmdc) const noexcept {
+	// Separators and the terminating character
+	size_t len = getParameters().size() + 1;
+	for(const auto& i: getParameters()) {
+		len += getEscapedLength(i, nmdc);
+	}
 
-const string& AdcCommand::getParam(size_t n) const noexcept {
-	return getParameters().size() > n ? getParameters()[n] : Util::emptyString;
+	return len;
 }
 
-string AdcCommand::getParamString(bool nmdc) const noexcept {
-	string tmp;
+void AdcCommand::appendParams(bool nmdc, string& tmp) const noexcept {
 	for(const auto& i: getParameters()) {
 		tmp += ' ';
-		tmp += escape(i, nmdc);
+		escape(i, nmdc, tmp);
 	}
 	if(nmdc) {
 		tmp += '|';
 	} else {
 		tmp += '\n';
 	}
-	return tmp;
 }
 
 bool AdcCommand::getParam(const char* name, size_t start, string& ret) const noexcept {
@@ -286,4 +226,186 @@ bool AdcCommand::hasFlag(const char* name, size_t start) const noexcept {
 	return false;
 }
 
-} // namespace dcpp
\ No newline at end of file
+AdcCommandView::AdcCommandView(string_view aLine, bool aNmdc) : nmdc(aNmdc) {
+	string_view::size_type i = 5;
+
+	if(nmdc) {
+		// "$ADCxxx ..."
+		if(aLine.length() < 7)
+			throw ParseException("Too short");
+		cmd[0] = aLine[4];
+		cmd[1] = aLine[5];
+		cmd[2] = aLine[6];
+		i += 3;
+	} else {
+		// "yxxx ..."
+		if(aLine.length() < 4)
+			throw ParseException("Too short");
+		type = aLine[0];
+		cmd[0] = aLine[1];
+		cmd[1] = aLine[2];
+		cmd[2] = aLine[3];
+	}
+	cmd[3] = 0;
+
+	if(type != AdcCommand::TYPE_BROADCAST && type != AdcCommand::TYPE_CLIENT && type != AdcCommand::TYPE_DIRECT && type != AdcCommand::TYPE_ECHO && 
+		type != AdcCommand::TYPE_FEATURE && type != AdcCommand::TYPE_INFO && type != AdcCommand::TYPE_HUB && type != AdcCommand::TYPE_UDP) {
+		throw ParseException("Invalid type");
+	}
+
+	if(type == AdcCommand::TYPE_INFO) {
+		from = AdcCommand::HUB_SID;
+	}
+
+	bool toSet = false;
+	bool featureSet = false;
+	bool fromSet = nmdc; // $ADCxxx never have a from CID...
+
+	auto len = aLine.length();
+	auto tokenStart = i;
+	while(i < len) {
+		switch(aLine[i]) {
+		case '\\':
+			++i;
+			if(i == len)
+				throw ParseException("Escape at eol");
+
+			// $ADCGET escaping, leftover from old specs
+			if(aLine[i] != 's' && aLine[i] != 'n' && aLine[i] != '\\' && !(aLine[i] == ' ' && nmdc))
+				throw ParseException("Unknown escape");
+			break;
+		case ' ':
+			// New parameter...
+			addToken(aLine.substr(tokenStart, i - tokenStart), fromSet, toSet, featureSet);
+			tokenStart = i + 1;
+			break;
+		}
+		++i;
+	}
+
+	if(tokenStart < len) {
+		addToken(aLine.substr(tokenStart), fromSet, toSet, featureSet);
+	}
+
+	if((type == AdcCommand::TYPE_BROADCAST || type == AdcCommand::TYPE_DIRECT || type == AdcCommand::TYPE_ECHO || type == AdcCommand::TYPE_FEATURE) && !fromSet) {
+		throw ParseException("Missing from_sid");
+	}
+
+	if(type == AdcCommand::TYPE_FEATURE && !featureSet) {
+		throw ParseException("Missing feature");
+	}
+
+	if((type == AdcCommand::TYPE_DIRECT || type == AdcCommand::TYPE_ECHO) && !toSet) {
+		throw ParseException("Missing to_sid");
+	}
+}
+
+void AdcCommandView::addToken(string_view aToken, bool& fromSet_, bool& toSet_, bool& featureSet_) {
+	// SIDs and features are used as they appear on the line, valid ones never contain escapes
+	auto checkPlain = [&] {
+		if(aToken.find('\\') != string_view::npos) {
+			throw ParseException("Escape in SID or feature");
+		}
+	};
+
+	if((type == AdcCommand::TYPE_BROADCAST || type == AdcCommand::TYPE_DIRECT || type == AdcCommand::TYPE_ECHO || type == AdcCommand::TYPE_FEATURE) && !fromSet_) {
+		checkPlain();
+		if(aToken.length() != 4) {
+			throw ParseException("Invalid SID length");
+		}
+		memcpy(&from, aToken.data(), sizeof(from));
+		fromSet_ = true;
+	} else if((type == AdcCommand::TYPE_DIRECT || type == AdcCommand::TYPE_ECHO) && !toSet_) {
+		checkPlain();
+		if(aToken.length() != 4) {
+			throw ParseException("Invalid SID length");
+		}
+		memcpy(&to, aToken.data(), sizeof(to));
+		toSet_ = true;
+	} else if(type == AdcCommand::TYPE_FEATURE && !featureSet_) {
+		checkPlain();
+		if(aToken.length() % 5 != 0) {
+			throw ParseException("Invalid feature length");
+		}
+		features = aToken;
+		featureSet_ = true;
+	} else {
+		addParam(aToken);
+	}
+}
+
+void AdcCommandView::addParam(string_view aParam) noexcept {
+	if(paramCount < INLINE_PARAMS) {
+		inlineParams[paramCount] = aParam;
+	} else {
+		extraParams.push_back(aParam);
+	}
+
+	paramCount++;
+}
+
+string_view AdcCommandView::getRawParam(size_t n) const noexcept {
+	if(n >= paramCount) {
+		return string_view();
+	}
+
+	return n < INLINE_PARAMS ? inlineParams[n] : extraParams[n - INLINE_PARAMS];
+}
+
+void AdcCommandView::unescape(string_view aRawParam, string& out_) noexcept {
+	auto len = aRawParam.length();
+	for(string_view::size_type i = 0; i < len; ++i) {
+		auto c = aRawParam[i];
+		if(c == '\\' && i + 1 < len) {
+			c = aRawParam[++i];
+			if(c == 's') {
+				c = ' ';
+			} else if(c == 'n') {
+				c = '\n';
+			}
+		}
+
+		out_ += c;
+	}
+}
+
+string AdcCommandView::unescape(string_view aRawParam) noexcept {
+	string ret;
+	ret.reserve(aRawParam.size());
+	unescape(aRawParam, ret);
+	return ret;
+}
+
+bool AdcCommandView::getParam(const char* name, size_t start, string& ret) const noexcept {
+	for(auto i = start; i < paramCount; ++i) {
+		auto p = getRawParam(i);
+		if(isCode(p, name)) {
+			ret.clear();
+			unescape(p.substr(2), ret);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool AdcCommandView::getParam(const char* name, size_t start, StringList& ret) const noexcept {
+	for(auto i = start; i < paramCount; ++i) {
+		auto p = getRawParam(i);
+		if(isCode(p, name)) {
+			ret.push_back(unescape(p.substr(2)));
+		}
+	}
+	return !ret.empty();
+}
+
+bool AdcCommandView::hasFlag(const char* name, size_t start) const noexcept {
+	for(auto i = start; i < paramCount; ++i) {
+		auto p = getRawParam(i);
+		if(isCode(p, name) && p.size() == 3 && p[2] == '1') {
+			return true;
+		}
+	}
+	return false;
+}
+
+} // namespace dcpp
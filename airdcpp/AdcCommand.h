@@ -23,8 +23,12 @@
 
 #include "Exception.h"
 
+#include <array>
+#include <string_view>
+
 namespace dcpp {
 
+class AdcCommandView;
 class CID;
 
 class AdcCommand {
@@ -128,6 +132,9 @@ public:
 	// Throws ParseException on errors
 	explicit AdcCommand(const string& aLine, bool nmdc = false);
 
+	// Copies the parameters from a parsed view
+	explicit AdcCommand(const AdcCommandView& aView) noexcept;
+
 	// Throws ParseException on errors
 	void parse(const string& aLine, bool nmdc = false);
 
@@ -165,6 +172,8 @@ public:
 	bool operator==(uint32_t aCmd) const noexcept { return cmdInt == aCmd; }
 
 	static string escape(const string& str, bool old) noexcept;
+	static void escape(const string& str, bool old, string& out_) noexcept;
+	static size_t getEscapedLength(const string& str, bool old) noexcept;
 	uint32_t getTo() const noexcept { return to; }
 	AdcCommand& setTo(const uint32_t sid) noexcept { to = sid; return *this; }
 	uint32_t getFrom() const noexcept { return from; }
@@ -173,10 +182,14 @@ public:
 	static uint32_t toSID(const string& aSID) noexcept { return *reinterpret_cast<const uint32_t*>(aSID.data()); }
 	static string fromSID(const uint32_t aSID) noexcept { return string(reinterpret_cast<const char*>(&aSID), sizeof(aSID)); }
 private:
-	string getHeaderString(const CID& cid) const noexcept;
-	string getHeaderString() const noexcept;
-	string getHeaderString(uint32_t sid, bool nmdc) const noexcept;
-	string getParamString(bool nmdc) const noexcept;
+	void assign(const AdcCommandView& aView) noexcept;
+
+	// The serialized size is calculated first so that the string gets allocated only once
+	size_t getHeaderLength(bool nmdc) const noexcept;
+	void appendHeader(uint32_t sid, bool nmdc, string& tmp_) const noexcept;
+	size_t getParamLength(bool nmdc) const noexcept;
+	void appendParams(bool nmdc, string& tmp_) const noexcept;
+
 	StringList parameters;
 	string features;
 	union {
@@ -190,6 +203,63 @@ private:
 
 };
 
+/**
+ * Parsed command that refers to the original line (the line must outlive the view)
+ *
+ * Parsing doesn't allocate memory unless there are more than INLINE_PARAMS parameters.
+ * The parameters are stored in escaped form and they are unescaped only when accessed.
+ */
+class AdcCommandView {
+public:
+	// Throws ParseException on errors
+	explicit AdcCommandView(string_view aLine, bool aNmdc = false);
+
+	uint32_t getCommand() const noexcept { return cmdInt; }
+	char getType() const noexcept { return type; }
+	uint32_t getFrom() const noexcept { return from; }
+	uint32_t getTo() const noexcept { return to; }
+	string_view getFeatures() const noexcept { return features; }
+	bool isNmdc() const noexcept { return nmdc; }
+
+	size_t getParameterCount() const noexcept { return paramCount; }
+
+	// Parameter as it appears on the line (possibly containing escapes)
+	string_view getRawParam(size_t n) const noexcept;
+	string getParam(size_t n) const noexcept { return unescape(getRawParam(n)); }
+
+	/** Return a named parameter where the name is a two-letter code */
+	bool getParam(const char* name, size_t start, string& ret) const noexcept;
+	bool getParam(const char* name, size_t start, StringList& ret) const noexcept;
+	bool hasFlag(const char* name, size_t start) const noexcept;
+
+	static bool isCode(string_view aRawParam, const char* aName) noexcept {
+		return aRawParam.size() >= 2 && aRawParam[0] == aName[0] && aRawParam[1] == aName[1];
+	}
+
+	// Escapes have been validated when parsing
+	static string unescape(string_view aRawParam) noexcept;
+	static void unescape(string_view aRawParam, string& out_) noexcept;
+private:
+	void addToken(string_view aToken, bool& fromSet_, bool& toSet_, bool& featureSet_);
+	void addParam(string_view aParam) noexcept;
+
+	static const size_t INLINE_PARAMS = 48;
+	std::array<string_view, INLINE_PARAMS> inlineParams;
+	vector<string_view> extraParams;
+	size_t paramCount = 0;
+
+	string_view features;
+	union {
+		char cmdChar[4];
+		uint8_t cmd[4];
+		uint32_t cmdInt;
+	};
+	uint32_t from = 0;
+	uint32_t to = 0;
+	char type = AdcCommand::TYPE_CLIENT;
+	const bool nmdc;
+};
+
 template<class T>
 class CommandHandler {
 public:
@@ -200,9 +270,9 @@ public:
 	template<typename... ArgT>
 	void dispatch(const string& aLine, bool aNmdc, ArgT&&... args) noexcept {
 		try {
-			AdcCommand c(aLine, aNmdc);
+			AdcCommandView c(aLine, aNmdc);
 
-#define C(n) case AdcCommand::CMD_##n: ((T*)this)->handle(AdcCommand::n(), c, std::forward<ArgT>(args)...); break;
+#define C(n) case AdcCommand::CMD_##n: handleCommand(AdcCommand::n(), c, 0, std::forward<ArgT>(args)...); break;
 			switch(c.getCommand()) {
 				C(SUP);
 				C(STA);
@@ -241,6 +311,20 @@ public:
 			return;
 		}
 	}
+private:
+	// Handlers taking a view are used when available
+	// (H delays the check until the handler class is complete)
+	template<typename H = T, typename CmdT, typename... ArgT>
+	auto handleCommand(CmdT aCmd, const AdcCommandView& aView, int, ArgT&&... args) -> decltype(((H*)this)->handle(aCmd, aView, std::forward<ArgT>(args)...), void()) {
+		((H*)this)->handle(aCmd, aView, std::forward<ArgT>(args)...);
+	}
+
+	// Compatibility path for handlers that take a (modifiable) command
+	template<typename CmdT, typename... ArgT>
+	void handleCommand(CmdT aCmd, const AdcCommandView& aView, long, ArgT&&... args) {
+		AdcCommand c(aView);
+		((T*)this)->handle(aCmd, c, std::forward<ArgT>(args)...);
+	}
 };
 
 } // namespace dcpp
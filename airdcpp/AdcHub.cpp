@@ -178,8 +178,8 @@ void AdcHub::clearUsers() noexcept {
 	}
 }
 
-void AdcHub::handle(AdcCommand::INF, AdcCommand& c) noexcept {
-	if(c.getParameters().empty())
+void AdcHub::handle(AdcCommand::INF, const AdcCommandView& c) noexcept {
+	if(c.getParameterCount() == 0)
 		return;
 
 	string cid;
@@ -216,20 +216,27 @@ void AdcHub::handle(AdcCommand::INF, AdcCommand& c) noexcept {
 		return;
 	}
 
-	for (const auto& p: c.getParameters()) {
+	// INFs are the most common commands, avoid copying the parameters
+	bool connectivityChanged = false;
+	for (size_t i = 0; i < c.getParameterCount(); ++i) {
+		auto p = c.getRawParam(i);
 		if(p.length() < 2)
 			continue;
 
-		if(p.substr(0, 2) == "SS") {
+		if(AdcCommandView::isCode(p, "SS")) {
 			availableBytes -= u->getIdentity().getBytesShared();
-			u->getIdentity().setBytesShared(p.substr(2));
+			u->getIdentity().setBytesShared(AdcCommandView::unescape(p.substr(2)));
 			availableBytes += u->getIdentity().getBytesShared();
 		} else {
-			u->getIdentity().set(p.c_str(), p.substr(2));
+			u->getIdentity().set(p.data(), AdcCommandView::unescape(p.substr(2)));
+		}
+
+		if (AdcCommandView::isCode(p, "SU") || AdcCommandView::isCode(p, "I4") || AdcCommandView::isCode(p, "I6")) {
+			connectivityChanged = true;
 		}
 		
-		if((p.substr(0, 2) == "VE") || (p.substr(0, 2) == "AP")) {
-			if (p.find("AirDC++") != string::npos) {
+		if(AdcCommandView::isCode(p, "VE") || AdcCommandView::isCode(p, "AP")) {
+			if (p.find("AirDC++") != string_view::npos) {
 				u->getUser()->setFlag(User::AIRDCPLUSPLUS);
 			}
 		}
@@ -277,7 +284,7 @@ void AdcHub::handle(AdcCommand::INF, AdcCommand& c) noexcept {
 
 		//we have to update the modes in case our connectivity changed
 
-		if (oldState != STATE_NORMAL || any_of(c.getParameters().begin(), c.getParameters().end(), [](const string& p) { return p.substr(0, 2) == "SU" || p.substr(0, 2) == "I4" || p.substr(0, 2) == "I6"; })) {
+		if (oldState != STATE_NORMAL || connectivityChanged) {
 			fire(ClientListener::HubUpdated(), this);
 
 			OnlineUserList ouList;
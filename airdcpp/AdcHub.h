@@ -134,7 +134,7 @@ private:
 	void handle(AdcCommand::SUP, AdcCommand& c) noexcept;
 	void handle(AdcCommand::SID, AdcCommand& c) noexcept;
 	void handle(AdcCommand::MSG, AdcCommand& c) noexcept;
-	void handle(AdcCommand::INF, AdcCommand& c) noexcept;
+	void handle(AdcCommand::INF, const AdcCommandView& c) noexcept;
 	void handle(AdcCommand::GPA, AdcCommand& c) noexcept;
 	void handle(AdcCommand::QUI, AdcCommand& c) noexcept;
 	void handle(AdcCommand::CTM, AdcCommand& c) noexcept;
@@ -22,6 +22,9 @@
 #include "Exception.h"
 #include "ResourceManager.h"
 
+#include <future>
+#include <thread>
+
 namespace dcpp {
 	
 BZFilter::BZFilter() {
@@ -101,4 +104,157 @@ bool UnBZFilter::operator()(const void* in, size_t& insize, void* out, size_t& o
 	return err == BZ_OK;
 }
 
+// Bit patterns from the bzip2 stream format
+#define BZ_BLOCK_MAGIC 0x314159265359ULL
+#define BZ_EOS_MAGIC 0x177245385090ULL
+
+ParallelBZOutputStream::ParallelBZOutputStream(OutputStream* aStream) : os(aStream), maxPending(max(thread::hardware_concurrency(), 1U)) {
+	// Stream header (all blocks are compressed with the largest block size)
+	outBuf = { 'B', 'Z', 'h', '9' };
+	curChunk.reserve(CHUNK_SIZE);
+}
+
+size_t ParallelBZOutputStream::write(const void* aBuf, size_t aLen) {
+	if (flushed)
+		throw Exception("No filtered writes after flush");
+
+	auto p = reinterpret_cast<const uint8_t*>(aBuf);
+	size_t written = 0;
+	while (aLen > 0) {
+		auto n = min(aLen, CHUNK_SIZE - curChunk.size());
+		curChunk.insert(curChunk.end(), p, p + n);
+		p += n;
+		aLen -= n;
+
+		if (curChunk.size() == CHUNK_SIZE) {
+			pending.push_back(move(curChunk));
+			curChunk = ByteVector();
+			curChunk.reserve(CHUNK_SIZE);
+
+			if (pending.size() >= maxPending) {
+				written += compressPending();
+			}
+		}
+	}
+
+	return written;
+}
+
+size_t ParallelBZOutputStream::flushBuffers(bool aForce) {
+	if (flushed)
+		return 0;
+
+	flushed = true;
+	if (!curChunk.empty()) {
+		pending.push_back(move(curChunk));
+	}
+
+	compressPending();
+
+	// End of stream
+	putBits(static_cast<uint32_t>(BZ_EOS_MAGIC >> 24), 24);
+	putBits(static_cast<uint32_t>(BZ_EOS_MAGIC & 0xFFFFFF), 24);
+	putBits(combinedCRC, 32);
+	if (bitCount > 0) {
+		putBits(0, 8 - bitCount);
+	}
+
+	auto written = writeOutput();
+	return written + os->flushBuffers(aForce);
+}
+
+ByteVector ParallelBZOutputStream::compressChunk(const ByteVector& aChunk) {
+	// Enough for incompressible data
+	auto outSize = static_cast<unsigned int>(aChunk.size() + aChunk.size() / 100 + 600);
+	ByteVector ret(outSize);
+	if (BZ2_bzBuffToBuffCompress(reinterpret_cast<char*>(&ret[0]), &outSize, const_cast<char*>(reinterpret_cast<const char*>(&aChunk[0])), static_cast<unsigned int>(aChunk.size()), 9, 0, 30) != BZ_OK) {
+		throw Exception(STRING(COMPRESSION_ERROR));
+	}
+
+	ret.resize(outSize);
+	return ret;
+}
+
+size_t ParallelBZOutputStream::compressPending() {
+	vector<future<ByteVector>> tasks;
+	for (const auto& chunk: pending) {
+		tasks.push_back(async(launch::async, [&chunk] { return compressChunk(chunk); }));
+	}
+
+	// Keep the original order
+	for (auto& t: tasks) {
+		appendBlock(t.get());
+	}
+
+	pending.clear();
+	return writeOutput();
+}
+
+void ParallelBZOutputStream::appendBlock(const ByteVector& aStream) {
+	auto readBits = [&aStream](size_t aPos, int aBits) {
+		uint64_t ret = 0;
+		for (int i = 0; i < aBits; ++i, ++aPos) {
+			ret = (ret << 1) | ((aStream[aPos / 8] >> (7 - aPos % 8)) & 1);
+		}
+
+		return ret;
+	};
+
+	// Stream header (32 bits), block magic (48 bits) and block CRC (32 bits) followed by the block data,
+	// end of stream magic (48 bits), stream CRC (32 bits) and 0-7 padding bits
+	auto totalBits = aStream.size() * 8;
+	if (totalBits < 32 + 80 + 80 || readBits(32, 48) != BZ_BLOCK_MAGIC) {
+		throw Exception(STRING(COMPRESSION_ERROR));
+	}
+
+	// The stream CRC of a single block stream equals with the block CRC
+	auto blockCRC = static_cast<uint32_t>(readBits(80, 32));
+
+	size_t endPos = 0;
+	for (size_t padding = 0; padding < 8; ++padding) {
+		auto pos = totalBits - 80 - padding;
+		if (readBits(pos, 48) == BZ_EOS_MAGIC && readBits(pos + 48, 32) == blockCRC) {
+			endPos = pos;
+			break;
+		}
+	}
+
+	if (endPos == 0) {
+		// Multiple blocks?
+		throw Exception(STRING(COMPRESSION_ERROR));
+	}
+
+	// The block starts from a byte boundary
+	auto endByte = endPos / 8;
+	for (size_t i = 4; i < endByte; ++i) {
+		putBits(aStream[i], 8);
+	}
+
+	if (endPos % 8 > 0) {
+		auto bits = static_cast<int>(endPos % 8);
+		putBits(aStream[endByte] >> (8 - bits), bits);
+	}
+
+	combinedCRC = ((combinedCRC << 1) | (combinedCRC >> 31)) ^ blockCRC;
+}
+
+void ParallelBZOutputStream::putBits(uint32_t aValue, int aBits) noexcept {
+	bitBuf = (bitBuf << aBits) | (aValue & ((1ULL << aBits) - 1));
+	bitCount += aBits;
+	while (bitCount >= 8) {
+		bitCount -= 8;
+		outBuf.push_back(static_cast<uint8_t>(bitBuf >> bitCount));
+	}
+}
+
+size_t ParallelBZOutputStream::writeOutput() {
+	if (outBuf.empty()) {
+		return 0;
+	}
+
+	auto written = os->write(&outBuf[0], outBuf.size());
+	outBuf.clear();
+	return written;
+}
+
 } // namespace dcpp
\ No newline at end of file
@@ -19,6 +19,8 @@
 #ifndef DCPLUSPLUS_DCPP_BZUTILS_H
 #define DCPLUSPLUS_DCPP_BZUTILS_H
 
+#include "StreamBase.h"
+
 #include <bzlib.h>
 
 namespace dcpp {
@@ -57,6 +59,45 @@ private:
 	bz_stream zs;
 };
 
+/**
+ * Compresses the data in independent blocks using multiple threads.
+ * The blocks are joined into a single standard bzip2 stream so that
+ * the result can be decompressed with any bzip2 decoder.
+ */
+class ParallelBZOutputStream : public OutputStream {
+public:
+	explicit ParallelBZOutputStream(OutputStream* aStream);
+
+	using OutputStream::write;
+	size_t write(const void* aBuf, size_t aLen) override;
+	size_t flushBuffers(bool aForce) override;
+private:
+	// Maximum input size of a single block
+	// The initial run-length encoding of bzip2 may expand the data by 25% and the
+	// result must still fit in one 900 kB block
+	static const size_t CHUNK_SIZE = 700000;
+
+	static ByteVector compressChunk(const ByteVector& aChunk);
+
+	size_t compressPending();
+	void appendBlock(const ByteVector& aStream);
+	void putBits(uint32_t aValue, int aBits) noexcept;
+	size_t writeOutput();
+
+	OutputStream* const os;
+	const size_t maxPending;
+
+	vector<ByteVector> pending;
+	ByteVector curChunk;
+
+	ByteVector outBuf;
+	uint64_t bitBuf = 0;
+	int bitCount = 0;
+	uint32_t combinedCRC = 0;
+
+	bool flushed = false;
+};
+
 } // namespace dcpp
 
 #endif // !defined(DCPLUSPLUS_DCPP_BZUTILS_H)
\ No newline at end of file
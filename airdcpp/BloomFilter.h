@@ -41,6 +41,8 @@ public:
 		}
 		return true;
 	}
+	size_t getTableSize() const noexcept { return table.size(); }
+
 	void clear() {
 		size_t s = table.size();
 		table.clear();
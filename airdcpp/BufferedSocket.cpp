@@ -24,6 +24,7 @@
 #include <boost/scoped_array.hpp>
 
 #include "ConnectivityManager.h"
+#include "File.h"
 #include "SettingsManager.h"
 #include "SSLSocket.h"
 #include "Streams.h"
@@ -39,6 +40,9 @@ using std::max;
 // Polling is used for tasks...should be fixed...
 #define POLL_TIMEOUT 250
 
+// Maximum number of reads per reactor pass before other sockets get their turn
+#define MAX_REACTOR_READS 16
+
 BufferedSocket::BufferedSocket(char aSeparator, bool v4only) :
 separator(aSeparator), useLimiter(false), mode(MODE_LINE), dataBytes(0), rollback(0), state(STARTING),
 disconnecting(false), v4only(v4only)
@@ -49,6 +53,27 @@ disconnecting(false), v4only(v4only)
 }
 
 atomic<long> BufferedSocket::sockets(0);
+unique_ptr<SocketReactor> BufferedSocket::reactor;
+
+void BufferedSocket::startReactor(int aThreads) noexcept {
+	dcassert(!reactor);
+	if (aThreads <= 0 || !SocketReactor::isSupported()) {
+		return;
+	}
+
+	auto r = make_unique<SocketReactor>(aThreads);
+	if (!r->start()) {
+		dcdebug("BufferedSocket: failed to start the reactor, using a thread for each socket\n");
+		return;
+	}
+
+	reactor = move(r);
+}
+
+void BufferedSocket::stopReactor() noexcept {
+	// All sockets have been deleted
+	reactor.reset();
+}
 
 BufferedSocket::~BufferedSocket() {
 	--sockets;
@@ -91,10 +116,19 @@ void BufferedSocket::setOptions() {
 		sock->setSocketOpt(SO_SNDBUF, SETTING(SOCKET_OUT_BUFFER));
 }
 
+Socket* BufferedSocket::createSSLSocket(bool aServer, bool aAllowUntrusted, const string& aExpKP) {
+	auto s = new SSLSocket(aServer ? CryptoManager::SSL_SERVER : CryptoManager::SSL_CLIENT, aAllowUntrusted, aExpKP);
+	if(kernelTls) {
+		s->requestKernelTls();
+	}
+
+	return s;
+}
+
 void BufferedSocket::accept(const Socket& srv, bool secure, bool allowUntrusted, const string& expKP) {
 	//dcdebug("BufferedSocket::accept() %p\n", (void*)this);
 
-	unique_ptr<Socket> s(secure ? new SSLSocket(CryptoManager::SSL_SERVER, allowUntrusted, expKP) : new Socket(Socket::TYPE_TCP));
+	unique_ptr<Socket> s(secure ? createSSLSocket(true, allowUntrusted, expKP) : new Socket(Socket::TYPE_TCP));
 
 	s->accept(srv);
 
@@ -111,7 +145,7 @@ void BufferedSocket::connect(const AddressInfo& aAddress, const string& aPort, b
 
 void BufferedSocket::connect(const AddressInfo& aAddress, const string& aPort, const string& localPort, NatRoles natRole, bool secure, bool allowUntrusted, bool proxy, const string& expKP) {
 	//dcdebug("BufferedSocket::connect() %p\n", (void*)this);
-	unique_ptr<Socket> s(secure ? new SSLSocket(natRole == NAT_SERVER ? CryptoManager::SSL_SERVER : CryptoManager::SSL_CLIENT, allowUntrusted, expKP) : new Socket(Socket::TYPE_TCP));
+	unique_ptr<Socket> s(secure ? createSSLSocket(natRole == NAT_SERVER, allowUntrusted, expKP) : new Socket(Socket::TYPE_TCP));
 
 	s->setLocalIp4(CONNSETTING(BIND_ADDRESS));
 	s->setLocalIp6(CONNSETTING(BIND_ADDRESS6));
@@ -188,14 +222,15 @@ void BufferedSocket::threadAccept() {
 	}
 }
 
-void BufferedSocket::threadRead() {
+/** @return Whether data was received */
+bool BufferedSocket::threadRead() {
 	if(state != RUNNING)
-		return;
+		return false;
 
-	int left = (mode == MODE_DATA && useLimiter) ? ThrottleManager::getInstance()->read(sock.get(), &inbuf[0], inbuf.size()) : sock->read(&inbuf[0], inbuf.size());
+	int left = (mode == MODE_DATA && useLimiter) ? ThrottleManager::getInstance()->read(sock.get(), &inbuf[0], inbuf.size(), getLimiters().get()) : sock->read(&inbuf[0], inbuf.size());
 	if(left == -1) {
 		// EWOULDBLOCK, no data received...
-		return;
+		return false;
 	} else if(left == 0) {
 		// This socket has been closed...
 		throw SocketException(STRING(CONNECTION_CLOSED));
@@ -292,6 +327,8 @@ void BufferedSocket::threadRead() {
 	if(mode == MODE_LINE && line.size() > static_cast<size_t>(SETTING(MAX_COMMAND_LENGTH))) {
 		throw SocketException(STRING(COMMAND_TOO_LONG));
 	}
+
+	return true;
 }
 
 void BufferedSocket::threadSendFile(InputStream* file) {
@@ -301,6 +338,16 @@ void BufferedSocket::threadSendFile(InputStream* file) {
 	if(disconnecting)
 		return;
 	dcassert(file != NULL);
+
+	if(sock->isSendFileSupported()) {
+		int64_t directBytes = 0;
+		auto directFile = file->getDirectFile(directBytes);
+		if(directFile) {
+			threadSendFileDirect(file, *directFile, directBytes);
+			return;
+		}
+	}
+
 	size_t sockSize = (size_t)sock->getSocketOptInt(SO_SNDBUF);
 	size_t bufSize = max(sockSize, (size_t)64*1024);
 
@@ -350,7 +397,7 @@ void BufferedSocket::threadSendFile(InputStream* file) {
 				written = sock->write(&writeBufTmp[writePos], writeSize);
 			} else {
 				writeSize = min(sockSize / 2, writeBufTmp.size() - writePos);
-				written = useLimiter ? ThrottleManager::getInstance()->write(sock.get(), &writeBufTmp[writePos], writeSize) : sock->read(&inbuf[0], inbuf.size());
+				written = useLimiter ? ThrottleManager::getInstance()->write(sock.get(), &writeBufTmp[writePos], writeSize, getLimiters().get()) : sock->write(&writeBufTmp[writePos], writeSize);
 			}
 			
 			if(written > 0) {
@@ -389,6 +436,56 @@ void BufferedSocket::threadSendFile(InputStream* file) {
 	}
 }
 
+void BufferedSocket::threadSendFileDirect(InputStream* aStream, File& aFile, int64_t aBytes) {
+	// The data isn't copied, send in larger chunks
+	size_t chunkSize = max((size_t)sock->getSocketOptInt(SO_SNDBUF), (size_t)256*1024);
+
+	auto fileLeft = aFile.getSize() - aFile.getPos();
+	int64_t left = aBytes == -1 ? fileLeft : min(aBytes, fileLeft);
+
+	while(!disconnecting) {
+		if(left <= 0) {
+			fire(BufferedSocketListener::TransmitDone());
+			return;
+		}
+
+		size_t len = (size_t)min((int64_t)chunkSize, left);
+		int sent = useLimiter ? ThrottleManager::getInstance()->sendFile(sock.get(), aFile, len, getLimiters().get()) : sock->sendFile(aFile, len);
+
+		if(sent > 0) {
+			aStream->directRead(sent);
+			left -= sent;
+
+			fire(BufferedSocketListener::BytesSent(), sent, sent);
+		} else if(sent == 0) {
+			// No upload tokens or the file was truncated
+			if(aFile.getPos() >= aFile.getSize()) {
+				left = 0;
+			}
+		} else {
+			// Wait until the socket is writable
+			while(!disconnecting) {
+				auto w = sock->wait(POLL_TIMEOUT, true, true);
+				if(w.first) {
+					threadRead();
+				}
+				if(w.second) {
+					break;
+				}
+			}
+		}
+	}
+}
+
+void BufferedSocket::setLimiters(TokenBucketList&& aLimiters) noexcept {
+	shared_ptr<const TokenBucketList> l;
+	if (!aLimiters.empty()) {
+		l = make_shared<const TokenBucketList>(move(aLimiters));
+	}
+
+	std::atomic_store(&limiters, l);
+}
+
 void BufferedSocket::write(const char* aBuf, size_t aLen) noexcept {
 	if(!sock.get())
 		return;
@@ -405,16 +502,21 @@ void BufferedSocket::threadSendData() {
 
 	{
 		Lock l(cs);
-		if(writeBuf.empty())
-			return;
 
-		writeBuf.swap(sendBuf);
+		// There may be unsent data from the reactor
+		if(sendBuf.empty()) {
+			if(writeBuf.empty())
+				return;
+
+			writeBuf.swap(sendBuf);
+		}
 	}
 
-	size_t left = sendBuf.size();
-	size_t done = 0;
+	size_t left = sendBuf.size() - sendPos;
+	size_t done = sendPos;
 	while(left > 0) {
 		if(disconnecting) {
+			sendPos = done;
 			return;
 		}
 
@@ -433,14 +535,49 @@ void BufferedSocket::threadSendData() {
 		}
 	}
 	sendBuf.clear();
+	sendPos = 0;
+}
+
+void BufferedSocket::reactorSendData() {
+	if(state != RUNNING)
+		return;
+
+	if(sendBuf.empty()) {
+		Lock l(cs);
+		if(writeBuf.empty())
+			return;
+
+		writeBuf.swap(sendBuf);
+	}
+
+	while(sendPos < sendBuf.size()) {
+		// A failed write must be retried with the same buffer (OpenSSL)
+		int n = sock->write(&sendBuf[sendPos], static_cast<int>(sendBuf.size() - sendPos));
+		if(n <= 0) {
+			// Continue when the socket becomes writable
+			return;
+		}
+
+		sendPos += n;
+	}
+
+	sendBuf.clear();
+	sendPos = 0;
 }
 
 bool BufferedSocket::checkEvents() {
-	while(state == RUNNING ? taskSem.wait(0) : taskSem.wait()) {
+	// The reactor must never block
+	while(state == RUNNING || getReactorId() != 0 ? taskSem.wait(0) : taskSem.wait()) {
 		pair<Tasks, unique_ptr<TaskData> > p;
 		{
 			Lock l(cs);
 			dcassert(!tasks.empty());
+			if(getReactorId() != 0 && state == RUNNING && tasks.front().first == SEND_FILE) {
+				// Sending files blocks, leave it for the socket's own thread (the task is dropped below if the socket isn't running anymore)
+				taskSem.signal();
+				return true;
+			}
+
 			p = move(tasks.front());
 			tasks.erase(tasks.begin());
 		}
@@ -465,7 +602,11 @@ bool BufferedSocket::checkEvents() {
 			}
 		} else if(state == RUNNING) {
 			if(p.first == SEND_DATA) {
-				threadSendData();
+				if(getReactorId() != 0) {
+					reactorSendData();
+				} else {
+					threadSendData();
+				}
 			} else if(p.first == SEND_FILE) {
 				threadSendFile(static_cast<SendFileInfo*>(p.second.get())->stream); break;
 			} else if(p.first == DISCONNECT) {
@@ -503,12 +644,106 @@ int BufferedSocket::run() {
 		} catch(const Exception& e) {
 			fail(e.getError());
 		}
+
+		if(attachReactor()) {
+			// The reactor owns the socket now
+			return 0;
+		}
 	}
 	//dcdebug("BufferedSocket::run() end %p\n", (void*)this);
 	delete this;
 	return 0;
 }
 
+bool BufferedSocket::attachReactor() noexcept {
+	if(!reactor || state != RUNNING || disconnecting || mode == MODE_DATA)
+		return false;
+
+	Lock l(cs);
+	if(!tasks.empty() || !sendBuf.empty())
+		return false;
+
+	return reactor->add(sock->getNativeHandle(), this) != 0;
+}
+
+bool BufferedSocket::needsThread() noexcept {
+	if(state != RUNNING)
+		return false;
+
+	// Received data is written to disk (and throttling blocks), don't hold up the other sockets
+	if(mode == MODE_DATA)
+		return true;
+
+	Lock l(cs);
+	return !tasks.empty() && tasks.front().first == SEND_FILE;
+}
+
+void BufferedSocket::detachReactor() noexcept {
+	Lock l(cs);
+	reactor->remove(getReactorId());
+
+	if(!sendBuf.empty() || !writeBuf.empty()) {
+		// Continue sending with the thread
+		addTask(SEND_DATA, 0);
+	}
+}
+
+bool BufferedSocket::handleReactorEvents() noexcept {
+	try {
+		if(!checkEvents()) {
+			Lock l(cs);
+			reactorShutdown = true;
+			reactor->remove(getReactorId());
+			return false;
+		}
+
+		if(state == RUNNING) {
+			reactorSendData();
+
+			// Edge-triggered, read everything that is available
+			for(int i = 0; ; ++i) {
+				if(needsThread()) {
+					detachReactor();
+					return false;
+				}
+
+				if(i == MAX_REACTOR_READS) {
+					// Give other sockets a chance
+					reactor->schedule(getReactorId());
+					break;
+				}
+
+				if(!threadRead()) {
+					break;
+				}
+			}
+		}
+	} catch(const Exception& e) {
+		fail(e.getError());
+	}
+
+	return true;
+}
+
+void BufferedSocket::onReactorRemoved() noexcept {
+	if(reactorShutdown) {
+		delete this;
+		return;
+	}
+
+	try {
+		start();
+	} catch(const ThreadException& e) {
+		// Stay in the reactor so that the socket can still be shut down
+		fail(e.getError());
+
+		Lock l(cs);
+		if(reactor->add(INVALID_SOCKET, this) != 0 && !tasks.empty()) {
+			reactor->schedule(getReactorId());
+		}
+	}
+}
+
 void BufferedSocket::fail(const string& aError) {
 	if(state != FAILED) {
 		state = FAILED;
@@ -516,6 +751,11 @@ void BufferedSocket::fail(const string& aError) {
 	}
 	//fire listener before deleting socket to be able to retrieve information from it.. does it cause any problems?? 
 	if (sock.get()) {
+		if (getReactorId() != 0) {
+			// The descriptor may be reused after it has been closed
+			reactor->removeSocket(getReactorId());
+		}
+
 		sock->disconnect();
 	}
 }
@@ -529,6 +769,10 @@ void BufferedSocket::shutdown(function<void ()> f) {
 void BufferedSocket::addTask(Tasks task, TaskData* data) {
 	dcassert(task == DISCONNECT || task == SHUTDOWN || sock.get());
 	tasks.emplace_back(task, unique_ptr<TaskData>(data)); taskSem.signal();
+
+	if(getReactorId() != 0) {
+		reactor->schedule(getReactorId());
+	}
 }
 
 } // namespace dcpp
@@ -30,6 +30,7 @@
 #include "Semaphore.h"
 #include "Thread.h"
 #include "Socket.h"
+#include "SocketReactor.h"
 #include "Speaker.h"
 
 namespace dcpp {
@@ -39,7 +40,12 @@ using std::function;
 using std::pair;
 using std::unique_ptr;
 
-class BufferedSocket : public Speaker<BufferedSocketListener>, public Thread {
+/**
+ * Each socket has its own thread while connecting and sending files. Connected sockets
+ * are served by the shared reactor when it's available (except while receiving data, which is
+ * written to disk by the listeners).
+ */
+class BufferedSocket : public Speaker<BufferedSocketListener>, public Thread, private SocketReactor::Handler {
 public:
 	enum Modes {
 		MODE_LINE,
@@ -72,8 +78,13 @@ public:
 	static void waitShutdown() noexcept {
 		while(sockets > 0)
 			Thread::sleep(100);
+
+		stopReactor();
 	}
 
+	/** Start the shared I/O threads for connected sockets (0 = each socket uses its own thread) */
+	static void startReactor(int aThreads) noexcept;
+
 	void accept(const Socket& srv, bool secure, bool allowUntrusted, const string& expKP = Util::emptyString);
 	void connect(const AddressInfo& aAddress, const string& aPort, bool secure, bool allowUntrusted, bool proxy, const string& expKP = Util::emptyString);
 	void connect(const AddressInfo& aAddress, const string& aPort, const string& localPort, NatRoles natRole, bool secure, bool allowUntrusted, bool proxy, const string& expKP = Util::emptyString);
@@ -94,6 +105,7 @@ public:
 	bool isTrusted() const { return sock->isTrusted(); }
 	bool isKeyprintMatch() const { return sock->isKeyprintMatch(); }
 	std::string getEncryptionInfo() const { return sock->getEncryptionInfo(); }
+	bool isKernelTls() const { return sock->isKernelTls(); }
 	ByteVector getKeyprint() const { return sock->getKeyprint(); }
 	bool verifyKeyprint(const string& expKeyp, bool allowUntrusted) noexcept { return sock->verifyKeyprint(expKeyp, allowUntrusted); };
 	string getLocalIp() const { return sock->getLocalIp(); }
@@ -112,6 +124,12 @@ public:
 
 	GETSET(char, separator, Separator);
 	GETSET(bool, useLimiter, UseLimiter);
+
+	// Class limiters to use in addition to the global limits (see ThrottleManager::getLimiters)
+	void setLimiters(TokenBucketList&& aLimiters) noexcept;
+
+	// Request kernel TLS offload for secure connections (set before connecting)
+	IGETSET(bool, kernelTls, KernelTls, false);
 private:
 	enum Tasks {
 		CONNECT,
@@ -166,27 +184,55 @@ private:
 	ByteVector inbuf;
 	ByteVector writeBuf;
 	ByteVector sendBuf;
+	size_t sendPos = 0;
 
 	std::unique_ptr<Socket> sock;
+
+	// Accessed atomically (the limiters may be changed from other threads)
+	shared_ptr<const TokenBucketList> limiters;
+	shared_ptr<const TokenBucketList> getLimiters() const noexcept { return std::atomic_load(&limiters); }
+
 	State state;
 	bool disconnecting;
 	bool v4only;
 
+	// Set when the socket should be deleted after it has been removed from the reactor
+	bool reactorShutdown = false;
+
 	virtual int run();
 
 	void threadConnect(const AddressInfo& aAddr, const string& aPort, const string& localPort, NatRoles natRole, bool proxy);
 	void threadAccept();
-	void threadRead();
+	bool threadRead();
 	void threadSendFile(InputStream* is);
+	// Let the kernel send the data of a plain file stream
+	void threadSendFileDirect(InputStream* aStream, File& aFile, int64_t aBytes);
 	void threadSendData();
 
 	void fail(const string& aError);
 	static atomic<long> sockets;
 
+	static unique_ptr<SocketReactor> reactor;
+	static void stopReactor() noexcept;
+
+	// Reactor
+	bool handleReactorEvents() noexcept override;
+	void onReactorRemoved() noexcept override;
+
+	// Move an idle connected socket to the reactor, the thread must exit if this returns true
+	bool attachReactor() noexcept;
+	// Continue in the socket's own thread (blocking tasks and data downloads)
+	bool needsThread() noexcept;
+	void detachReactor() noexcept;
+
+	// Send as much as possible without blocking
+	void reactorSendData();
+
 	bool checkEvents();
 	void checkSocket();
 
 	void setSocket(std::unique_ptr<Socket>&& s);
+	Socket* createSSLSocket(bool aServer, bool aAllowUntrusted, const string& aExpKP);
 	void setOptions();
 	void shutdown(function<void ()> f);
 	void addTask(Tasks task, TaskData* data);
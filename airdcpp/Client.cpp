@@ -71,6 +71,7 @@ void Client::shutdown(ClientPtr& aClient, bool aRedirect) {
 	FavoriteManager::getInstance()->removeUserCommand(getHubUrl());
 	TimerManager::getInstance()->removeListener(this);
 	ShareManager::getInstance()->removeListener(this);
+	updateSpeedLimits(true);
 
 	if (!aRedirect) {
 		fire(ClientListener::Close(), this);
@@ -148,10 +149,17 @@ void Client::reloadSettings(bool aUpdateNick) noexcept {
 	}
 
 	searchQueue.setMinInterval(get(HubSettings::SearchInterval) * 1000); //convert from seconds
+	updateSpeedLimits(false);
 
 	fire(ClientListener::SettingsUpdated(), this);
 }
 
+void Client::updateSpeedLimits(bool aRemove) noexcept {
+	auto tm = ThrottleManager::getInstance();
+	tm->setClassLimit(ThrottleManager::CLASS_HUB, getHubUrl(), true, aRemove ? 0 : get(HubSettings::UploadLimit));
+	tm->setClassLimit(ThrottleManager::CLASS_HUB, getHubUrl(), false, aRemove ? 0 : get(HubSettings::DownloadLimit));
+}
+
 
 bool Client::toggleHubBoolSetting(HubSettings::HubBoolSetting aSetting) noexcept {
 	auto newValue = static_cast<bool>(!get(aSetting));
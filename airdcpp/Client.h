@@ -221,6 +221,9 @@ protected:
 
 	/** Reload details from favmanager or settings */
 	void reloadSettings(bool updateNick) noexcept;
+
+	// Applies the hub speed limits for connections of this hub (see ThrottleManager::setClassLimit)
+	void updateSpeedLimits(bool aRemove) noexcept;
 	/// Get the external IP the user has defined for this hub, if any.
 	const string& getUserIp4() const noexcept;
 	const string& getUserIp6() const noexcept;
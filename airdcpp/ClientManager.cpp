@@ -38,7 +38,7 @@
 #include "AdcHub.h"
 #include "NmdcHub.h"
 
-#include <openssl/aes.h>
+#include <openssl/evp.h>
 #include <openssl/rand.h>
 
 #include <boost/range/algorithm/copy.hpp>
@@ -853,55 +853,113 @@ void ClientManager::userCommand(const HintedUser& user, const UserCommand& uc, P
 	ou->getClient()->sendUserCmd(uc, params_);
 }
 
+namespace {
+
+// Encrypts UDP packets for users that have provided a key (SUDP)
+// The key is set up once for all packets, and the cipher context and output buffer are reused between calls
+class UDPEncryptor {
+public:
+	UDPEncryptor(const string& aKey) noexcept {
+		if (aKey.empty() || !Encoder::isBase32(aKey.c_str())) {
+			return;
+		}
+
+		uint8_t keyChar[16];
+		Encoder::fromBase32(aKey.c_str(), keyChar, 16);
+
+		ctx = getContext();
+		valid = ctx && EVP_EncryptInit_ex(ctx, EVP_aes_128_cbc(), nullptr, keyChar, nullptr) == 1;
+	}
+
+	bool isValid() const noexcept { return valid; }
+
+	// Returns the size of the encrypted packet (0 on errors)
+	size_t encrypt(string& packet_) noexcept {
+		// prepend 16 random bytes to message
+		uint8_t prefix[16];
+		RAND_bytes(prefix, 16);
+		packet_.insert(0, (char*)prefix, 16);
+
+		auto& out = getBuffer();
+		out.resize(packet_.size() + 16);
+
+		// the IV is reset for each packet, the key schedule is kept
+		uint8_t ivd[16] = { };
+		int len = 0, finalLen = 0;
+		if (EVP_EncryptInit_ex(ctx, nullptr, nullptr, nullptr, ivd) != 1 ||
+			EVP_EncryptUpdate(ctx, &out[0], &len, (const uint8_t*)packet_.data(), static_cast<int>(packet_.size())) != 1 ||
+			EVP_EncryptFinal_ex(ctx, &out[0] + len, &finalLen) != 1) { // adds PKCS#5 padding
+			return 0;
+		}
+
+		dcassert(((len + finalLen) & 15) == 0);
+		packet_.assign((const char*)&out[0], len + finalLen);
+		return packet_.size();
+	}
+private:
+	static EVP_CIPHER_CTX* getContext() noexcept {
+		static thread_local ssl::EVP_CIPHER_CTX ctx(EVP_CIPHER_CTX_new());
+		return ctx;
+	}
+
+	static ByteVector& getBuffer() noexcept {
+		static thread_local ByteVector buf;
+		return buf;
+	}
+
+	EVP_CIPHER_CTX* ctx = nullptr;
+	bool valid = false;
+};
+
+}
+
 bool ClientManager::sendUDP(AdcCommand& cmd, const CID& aCID, bool aNoCID /*false*/, bool aNoPassive /*false*/, const string& aKey /*Util::emptyString*/, const string& aHubUrl /*Util::emptyString*/) noexcept {
+	vector<AdcCommand> commands { cmd };
+	return sendUDP(commands, aCID, aNoCID, aNoPassive, aKey, aHubUrl);
+}
+
+bool ClientManager::sendUDP(vector<AdcCommand>& aCommands, const CID& aCID, bool aNoCID /*false*/, bool aNoPassive /*false*/, const string& aKey /*Util::emptyString*/, const string& aHubUrl /*Util::emptyString*/) noexcept {
 	auto u = findOnlineUser(aCID, aHubUrl);
 	if (!u) {
 		return false;
 	}
 
-	if (cmd.getType() == AdcCommand::TYPE_UDP && !u->getIdentity().isUdpActive()) {
-		if (u->getUser()->isNMDC() || aNoPassive) {
-			return false;
+	StringList packets;
+	UDPEncryptor encryptor(aKey);
+	for (auto& cmd: aCommands) {
+		if (cmd.getType() == AdcCommand::TYPE_UDP && !u->getIdentity().isUdpActive()) {
+			if (u->getUser()->isNMDC() || aNoPassive) {
+				return false;
+			}
+
+			cmd.setType(AdcCommand::TYPE_DIRECT);
+			cmd.setTo(u->getIdentity().getSID());
+			u->getClient()->send(cmd);
+			continue;
 		}
 
-		cmd.setType(AdcCommand::TYPE_DIRECT);
-		cmd.setTo(u->getIdentity().getSID());
-		u->getClient()->send(cmd);
-	} else {
-		try {
-			COMMAND_DEBUG(cmd.toString(), DebugManager::TYPE_CLIENT_UDP, DebugManager::OUTGOING, u->getIdentity().getUdpIp() + ":" + u->getIdentity().getUdpPort());
-			auto cmdStr = aNoCID ? cmd.toString() : cmd.toString(getMe()->getCID());
-			if (!aKey.empty() && Encoder::isBase32(aKey.c_str())) {
-				uint8_t keyChar[16];
-				Encoder::fromBase32(aKey.c_str(), keyChar, 16);
-
-				uint8_t ivd[16] = { };
-
-				// prepend 16 random bytes to message
-				RAND_bytes(ivd, 16);
-				cmdStr.insert(0, (char*)ivd, 16);
-					
-				// use PKCS#5 padding to align the message length to the cypher block size (16)
-				uint8_t pad = 16 - (cmdStr.length() & 15);
-				cmdStr.append(pad, (char)pad);
-
-				// encrypt it
-				uint8_t* out = new uint8_t[cmdStr.length()];
-				memset(ivd, 0, 16);
-				int aLen = cmdStr.length();
-
-				AES_KEY key;
-				AES_set_encrypt_key(keyChar, 128, &key);
-				AES_cbc_encrypt((unsigned char*)cmdStr.c_str(), out, cmdStr.length(), &key, ivd, AES_ENCRYPT);
-
-				dcassert((aLen & 15) == 0);
-
-				cmdStr.clear();
-				cmdStr.insert(0, (char*)out, aLen);
-				delete[] out;
+		COMMAND_DEBUG(cmd.toString(), DebugManager::TYPE_CLIENT_UDP, DebugManager::OUTGOING, u->getIdentity().getUdpIp() + ":" + u->getIdentity().getUdpPort());
+		auto cmdStr = aNoCID ? cmd.toString() : cmd.toString(getMe()->getCID());
+		if (encryptor.isValid()) {
+			auto encrypted = encryptor.encrypt(cmdStr);
+			if (encrypted == 0) {
+				dcdebug("Failed to encrypt ADC UDP command\n");
+				continue;
 			}
 
-			udp->writeTo(u->getIdentity().getUdpIp(), u->getIdentity().getUdpPort(), cmdStr);
+			udpStats.encryptedPackets++;
+			udpStats.encryptedBytes += encrypted;
+		}
+
+		packets.push_back(move(cmdStr));
+	}
+
+	if (!packets.empty()) {
+		try {
+			auto calls = udp->writeTo(u->getIdentity().getUdpIp(), u->getIdentity().getUdpPort(), packets);
+
+			udpStats.packets += packets.size();
+			udpStats.sendCalls += calls;
 		} catch(const SocketException&) {
 			dcdebug("Socket exception sending ADC UDP command\n");
 		}
@@ -910,6 +968,15 @@ bool ClientManager::sendUDP(AdcCommand& cmd, const CID& aCID, bool aNoCID /*fals
 	return true;
 }
 
+ClientManager::UDPStats ClientManager::getUDPStats() const noexcept {
+	UDPStats ret;
+	ret.packets = udpStats.packets;
+	ret.sendCalls = udpStats.sendCalls;
+	ret.encryptedPackets = udpStats.encryptedPackets;
+	ret.encryptedBytes = udpStats.encryptedBytes;
+	return ret;
+}
+
 void ClientManager::infoUpdated() noexcept {
 	RLock l(cs);
 	for (auto c: clients | map_values) {
@@ -1311,6 +1378,17 @@ Average NMDC connection speed: %s")
 		ret += c.first + ":\t\t" + Util::toString(c.second) + " (" + Util::toString(Util::countPercentage(c.second, stats.uniqueUsers)) + "%)" + lb;
 	}
 
+	auto udpStats = getUDPStats();
+	ret += boost::str(boost::format(
+		"\r\n\r\n-=[ UDP statistics ]=-\r\n\r\n\
+Sent packets: %d (%.2f per system call)\r\n\
+Encrypted packets: %d (%s)")
+
+% udpStats.packets % udpStats.getPacketsPerCall()
+% udpStats.encryptedPackets % Util::formatBytes(udpStats.encryptedBytes)
+
+);
+
 	return ret;
 }
 
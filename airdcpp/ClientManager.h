@@ -219,6 +219,21 @@ public:
 	
 	bool sendUDP(AdcCommand& c, const CID& to, bool aNoCID = false, bool aNoPassive = false, const string& aEncryptionKey = Util::emptyString, const string& aHubUrl = Util::emptyString) noexcept;
 
+	// Send multiple commands to the same user
+	// The packets are encrypted with a shared cipher context and sent with as few system calls as possible
+	bool sendUDP(vector<AdcCommand>& aCommands, const CID& to, bool aNoCID = false, bool aNoPassive = false, const string& aEncryptionKey = Util::emptyString, const string& aHubUrl = Util::emptyString) noexcept;
+
+	struct UDPStats {
+		uint64_t packets = 0;
+		uint64_t sendCalls = 0;
+		uint64_t encryptedPackets = 0;
+		uint64_t encryptedBytes = 0;
+
+		double getPacketsPerCall() const noexcept { return sendCalls > 0 ? static_cast<double>(packets) / static_cast<double>(sendCalls) : 0; }
+	};
+
+	UDPStats getUDPStats() const noexcept;
+
 	bool connect(const UserPtr& aUser, const string& aToken, bool aAllowUrlChange, string& lastError_, string& hubHint_, bool& isProtocolError_, ConnectionType type = CONNECTION_TYPE_LAST) const noexcept;
 	bool privateMessageHooked(const HintedUser& aUser, const OutgoingChatMessage& aMessage, string& error_, bool aEcho = true) noexcept;
 	void userCommand(const HintedUser& aUser, const UserCommand& uc, ParamMap& params_, bool aCompatibility) noexcept;
@@ -274,6 +289,13 @@ private:
 	UserPtr me;
 
 	unique_ptr<Socket> udp;
+
+	struct {
+		atomic<uint64_t> packets { 0 };
+		atomic<uint64_t> sendCalls { 0 };
+		atomic<uint64_t> encryptedPackets { 0 };
+		atomic<uint64_t> encryptedBytes { 0 };
+	} udpStats;
 	
 	CID pid;
 	uint64_t lastOfflineUserCleanup;
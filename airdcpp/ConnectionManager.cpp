@@ -347,6 +347,13 @@ void ConnectionManager::attemptDownloads(uint64_t aTick, StringList& removedToke
 	}
 }
 
+void ConnectionManager::updateLimiters() noexcept {
+	RLock l(cs);
+	for (auto uc : userConnections) {
+		// the limiters are read by the socket thread
+		uc->callAsync([uc] { uc->updateLimiters(); });
+	}
+}
 
 void ConnectionManager::addRunningMCN(const UserConnection *aSource) noexcept {
 	{
@@ -160,6 +160,9 @@ public:
 
 	void addRunningMCN(const UserConnection *aSource) noexcept;
 
+	// Makes all connections pick up the current class limiters (see ThrottleManager::getLimiters)
+	void updateLimiters() noexcept;
+
 	// set fatalError to true if the client shouldn't try to reconnect automatically
 	void failDownload(const string& aToken, const string& aError, bool fatalError);
 
@@ -111,6 +111,7 @@ void startup(StepFunction aStepF, MessageFunction aMessageF, Callback aRunWizard
 		}
 	};
 
+	auto startTime = GET_TICK();
 	auto loader = StartupLoader(
 		announce,
 		aProgressF,
@@ -156,6 +157,7 @@ void startup(StepFunction aStepF, MessageFunction aMessageF, Callback aRunWizard
 	}
 
 	loader.stepF(STRING(CONNECTIVITY));
+	BufferedSocket::startReactor(SETTING(SOCKET_REACTOR_THREADS));
 	ConnectivityManager::getInstance()->startup(loader);
 
 	// Modules may depend on data loaded in other sections
@@ -167,6 +169,37 @@ void startup(StepFunction aStepF, MessageFunction aMessageF, Callback aRunWizard
 	for (const auto& cb: loader.getPostLoadTasks()) {
 		cb();
 	}
+
+	loader.finishStep();
+
+	string timings;
+	for (const auto& t: loader.getTimings()) {
+		if (!timings.empty()) {
+			timings += ", ";
+		}
+
+		timings += t.first + ": " + Util::toString(t.second) + " ms";
+	}
+
+	LogManager::getInstance()->message("Startup completed in " + Util::toString(GET_TICK() - startTime) + " ms (" + timings + ")", LogMessage::SEV_INFO, "Startup");
+}
+
+void StartupLoader::startStep(const string& aStep) noexcept {
+	finishStep();
+
+	currentStep = aStep;
+	stepStart = GET_TICK();
+}
+
+void StartupLoader::finishStep() noexcept {
+	if (!currentStep.empty()) {
+		timings.emplace_back(currentStep, GET_TICK() - stepStart);
+		currentStep.clear();
+	}
+}
+
+void StartupLoader::addTiming(const string& aName, uint64_t aDurationMs) noexcept {
+	timings.emplace_back(aName, aDurationMs);
 }
 
 void shutdown(StepFunction stepF, ProgressFunction progressF, ShutdownUnloadCallback aModuleUnloadF, Callback aModuleDestroyF) {
@@ -178,6 +211,7 @@ void shutdown(StepFunction stepF, ProgressFunction progressF, ShutdownUnloadCall
 	};
 
 	ShareManager::getInstance()->abortRefresh();
+	SearchManager::getInstance()->shutdown();
 
 	announce(STRING(SAVING_HASH_DATA));
 	HashManager::getInstance()->shutdown(progressF);
@@ -25,9 +25,10 @@
 
 namespace dcpp {
 
-class StartupLoader {
+class StartupLoader : boost::noncopyable {
 public:
-	StartupLoader(const StepFunction& aStepF, const ProgressFunction& aProgressF, const MessageFunction& aMessageF) : stepF(aStepF), progressF(aProgressF), messageF(aMessageF) {}
+	StartupLoader(const StepFunction& aStepF, const ProgressFunction& aProgressF, const MessageFunction& aMessageF) : 
+		stepF([this, aStepF](const string& aStep) { startStep(aStep); if (aStepF) aStepF(aStep); }), progressF(aProgressF), messageF(aMessageF) {}
 
 	const StepFunction stepF;
 	const ProgressFunction& progressF;
@@ -42,8 +43,27 @@ public:
 	const vector<Callback>& getPostLoadTasks() const noexcept {
 		return postLoadTasks;
 	}
+
+	// Name, milliseconds
+	typedef vector<pair<string, uint64_t>> TimingList;
+
+	// Steps are timed automatically, this can be used for reporting parts of them
+	void addTiming(const string& aName, uint64_t aDurationMs) noexcept;
+
+	// Stops timing of the current step
+	void finishStep() noexcept;
+
+	const TimingList& getTimings() const noexcept {
+		return timings;
+	}
 private:
+	void startStep(const string& aStep) noexcept;
+
 	vector<Callback> postLoadTasks;
+
+	TimingList timings;
+	string currentStep;
+	uint64_t stepStart = 0;
 };
 
 typedef function<void(StartupLoader&)> StartupLoadCallback;
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "DeviceTaskPool.h"
+
+#include "debug.h"
+
+namespace dcpp {
+
+DeviceTaskPool::DeviceTaskPool(int aMaxThreads, int aMaxTasksPerDevice) noexcept :
+	maxThreads(max(aMaxThreads, 1)), maxTasksPerDevice(max(aMaxTasksPerDevice, 1)) {
+
+}
+
+DeviceTaskPool::~DeviceTaskPool() {
+	{
+		std::lock_guard<std::mutex> l(cs);
+		stopping = true;
+		tasks.clear();
+	}
+
+	taskAvailable.notify_all();
+	for (auto& t : threads) {
+		t.join();
+	}
+}
+
+void DeviceTaskPool::addTask(int64_t aDeviceId, Task&& aTask) noexcept {
+	{
+		std::lock_guard<std::mutex> l(cs);
+		tasks.push_back({ aDeviceId, move(aTask) });
+
+		// Threads are created only when there's something to run
+		if (idleThreads == 0 && static_cast<int>(threads.size()) < maxThreads) {
+			threads.emplace_back([this] { run(); });
+			return;
+		}
+	}
+
+	// Idle threads may also be waiting for a busy device
+	taskAvailable.notify_all();
+}
+
+deque<DeviceTaskPool::QueuedTask>::iterator DeviceTaskPool::getNextTask() noexcept {
+	return find_if(tasks.begin(), tasks.end(), [this](const QueuedTask& aTask) {
+		auto p = runningTasks.find(aTask.deviceId);
+		return p == runningTasks.end() || p->second < maxTasksPerDevice;
+	});
+}
+
+void DeviceTaskPool::run() noexcept {
+	std::unique_lock<std::mutex> l(cs);
+	for (;;) {
+		auto next = getNextTask();
+		if (next == tasks.end()) {
+			if (stopping) {
+				return;
+			}
+
+			idleThreads++;
+			taskAvailable.wait(l);
+			idleThreads--;
+			continue;
+		}
+
+		auto deviceId = next->deviceId;
+		auto task = move(next->task);
+		tasks.erase(next);
+		runningTasks[deviceId]++;
+
+		l.unlock();
+		try {
+			task();
+		} catch (...) {
+			dcassert(0);
+		}
+
+		l.lock();
+
+		auto p = runningTasks.find(deviceId);
+		if (--p->second == 0) {
+			runningTasks.erase(p);
+		}
+
+		// Tasks for this device may be waiting
+		taskAvailable.notify_all();
+	}
+}
+
+} // namespace dcpp
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_DEVICE_TASK_POOL_H
+#define DCPLUSPLUS_DCPP_DEVICE_TASK_POOL_H
+
+#include "typedefs.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace dcpp {
+
+/* Worker pool for blocking file system operations (such as directory listing)
+   The number of concurrently running tasks is limited both in total and per storage device so that
+   slow (network) storages won't reserve all threads and local disks won't be kept seeking */
+
+class DeviceTaskPool : boost::noncopyable {
+public:
+	typedef std::function<void()> Task;
+
+	DeviceTaskPool(int aMaxThreads, int aMaxTasksPerDevice) noexcept;
+
+	// Waits for the running tasks to complete, tasks that haven't been started are discarded
+	~DeviceTaskPool();
+
+	// Tasks of the same device are started in the order they were added
+	void addTask(int64_t aDeviceId, Task&& aTask) noexcept;
+
+	int getMaxThreads() const noexcept { return maxThreads; }
+	int getMaxTasksPerDevice() const noexcept { return maxTasksPerDevice; }
+private:
+	struct QueuedTask {
+		int64_t deviceId;
+		Task task;
+	};
+
+	void run() noexcept;
+
+	// Returns the first queued task whose device has free capacity (the lock must be held)
+	deque<QueuedTask>::iterator getNextTask() noexcept;
+
+	const int maxThreads;
+	const int maxTasksPerDevice;
+
+	std::mutex cs;
+	std::condition_variable taskAvailable;
+
+	deque<QueuedTask> tasks;
+	unordered_map<int64_t, int> runningTasks;
+
+	vector<std::thread> threads;
+	int idleThreads = 0;
+	bool stopping = false;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_DEVICE_TASK_POOL_H)
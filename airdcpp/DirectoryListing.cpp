@@ -23,16 +23,18 @@
 #include "AirUtil.h"
 #include "BZUtils.h"
 #include "ClientManager.h"
+#include "FilelistReader.h"
 #include "FilteredFile.h"
 #include "LogManager.h"
 #include "QueueManager.h"
 #include "ResourceManager.h"
 #include "ShareManager.h"
 #include "SimpleXML.h"
-#include "SimpleXMLReader.h"
 #include "StringTokenizer.h"
 #include "User.h"
 
+#include <charconv>
+
 
 namespace dcpp {
 
@@ -254,7 +256,7 @@ void DirectoryListing::loadFile() {
 	}
 }
 
-class ListLoader : public SimpleXMLReader::CallBack {
+class ListLoader : public FilelistReader::CallBack {
 public:
 	ListLoader(DirectoryListing* aList, DirectoryListing::Directory* root, const string& aBase, bool aUpdating, const UserPtr& aUser, bool aCheckDupe, bool aPartialList, time_t aListDownloadDate) : 
 	  list(aList), cur(root), base(aBase), inListing(false), updating(aUpdating), user(aUser), checkDupe(aCheckDupe), partialList(aPartialList), dirsLoaded(0), listDownloadDate(aListDownloadDate) {
@@ -262,13 +264,23 @@ public:
 
 	virtual ~ListLoader() { }
 
-	void startTag(const string& name, StringPairList& attribs, bool simple);
-	void endTag(const string& name);
+	void startTag(string_view name, const FilelistReader::AttributeList& attribs, bool simple) override;
+	void endTag(string_view name) override;
 
 	//const string& getBase() const { return base; }
 	int getLoadedDirs() { return dirsLoaded; }
 private:
-	void validateName(const string& aName);
+	void validateName(string_view aName);
+
+	static int64_t toInt64(string_view aValue) noexcept {
+		int64_t ret = 0;
+		from_chars(aValue.data(), aValue.data() + aValue.size(), ret);
+		return ret;
+	}
+
+	// Reused for values that need to be passed as strings
+	string name;
+	string tmp;
 
 	DirectoryListing* list;
 	DirectoryListing::Directory* cur;
@@ -291,7 +303,7 @@ int DirectoryListing::loadPartialXml(const string& aXml, const string& aBase) {
 int DirectoryListing::loadXML(InputStream& is, bool aUpdating, const string& aBase, time_t aListDate) {
 	ListLoader ll(this, root.get(), aBase, aUpdating, getUser(), !isOwnList && isClientView && SETTING(DUPES_IN_FILELIST), partialList, aListDate);
 	try {
-		dcpp::SimpleXMLReader(&ll).parse(is);
+		FilelistReader(&ll).parse(is);
 	} catch(SimpleXMLException& e) {
 		throw AbortException(e.getError());
 	}
@@ -299,7 +311,7 @@ int DirectoryListing::loadXML(InputStream& is, bool aUpdating, const string& aBa
 	return ll.getLoadedDirs();
 }
 
-void ListLoader::validateName(const string& aName) {
+void ListLoader::validateName(string_view aName) {
 	if (aName.empty()) {
 		throw SimpleXMLException("Name attribute missing");
 	}
@@ -327,33 +339,34 @@ static const string sName = "Name";
 static const string sSize = "Size";
 static const string sTTH = "TTH";
 static const string sDate = "Date";
-void ListLoader::startTag(const string& name, StringPairList& attribs, bool aSimple) {
+void ListLoader::startTag(string_view aName, const FilelistReader::AttributeList& attribs, bool aSimple) {
 	if(list->getClosing()) {
 		throw AbortException();
 	}
 
 	if (inListing) {
-		if (name == sFile) {
-			const string& n = getAttrib(attribs, sName, 0);
+		if (aName == sFile) {
+			auto n = getAttrib(attribs, sName, 0);
 			validateName(n);
 
-			const string& s = getAttrib(attribs, sSize, 1);
+			auto s = getAttrib(attribs, sSize, 1);
 			if(s.empty())
 				return;
 
-			auto size = Util::toInt64(s);
+			auto size = toInt64(s);
 
-			const string& h = getAttrib(attribs, sTTH, 2);
+			auto h = getAttrib(attribs, sTTH, 2);
 			if (h.empty())
 				return;		
 
-			TTHValue tth(h); /// @todo verify validity?
+			tmp.assign(h.data(), h.size());
+			TTHValue tth(tmp); /// @todo verify validity?
 
-			auto f = make_shared<DirectoryListing::File>(cur, n, size, tth, checkDupe, Util::toTimeT(getAttrib(attribs, sDate, 3)));
-			cur->files.push_back(f);
-		} else if (name == sDirectory) {
-			const string& n = getAttrib(attribs, sName, 0);
+			cur->files.add(n, size, tth, static_cast<time_t>(toInt64(getAttrib(attribs, sDate, 3))), checkDupe);
+		} else if (aName == sDirectory) {
+			auto n = getAttrib(attribs, sName, 0);
 			validateName(n);
+			name.assign(n.data(), n.size());
 
 			bool incomp = getAttrib(attribs, sIncomplete, 1) == "1";
 			auto directoriesStr = getAttrib(attribs, sDirectories, 2);
@@ -361,19 +374,19 @@ void ListLoader::startTag(const string& name, StringPairList& attribs, bool aSim
 
 			DirectoryContentInfo contentInfo;
 			if (!incomp || !filesStr.empty() || !directoriesStr.empty()) {
-				contentInfo = DirectoryContentInfo(Util::toInt(directoriesStr), Util::toInt(filesStr));
+				contentInfo = DirectoryContentInfo(static_cast<int>(toInt64(directoriesStr)), static_cast<int>(toInt64(filesStr)));
 			}
 
 			bool children = getAttrib(attribs, sChildren, 2) == "1" || contentInfo.directories > 0; // DEPRECATED
 
-			const string& size = getAttrib(attribs, sSize, 2);
-			const string& date = getAttrib(attribs, sDate, 3);
+			auto size = getAttrib(attribs, sSize, 2);
+			auto date = static_cast<time_t>(toInt64(getAttrib(attribs, sDate, 3)));
 
 			DirectoryListing::Directory::Ptr d = nullptr;
 			if(updating) {
 				dirsLoaded++;
 
-				auto i = cur->directories.find(&n);
+				auto i = cur->directories.find(&name);
 				if (i != cur->directories.end()) {
 					d = i->second;
 				}
@@ -383,23 +396,24 @@ void ListLoader::startTag(const string& name, StringPairList& attribs, bool aSim
 				auto type = incomp ? (children ? DirectoryListing::Directory::TYPE_INCOMPLETE_CHILD : DirectoryListing::Directory::TYPE_INCOMPLETE_NOCHILD) :
 					DirectoryListing::Directory::TYPE_NORMAL;
 
-				d = DirectoryListing::Directory::create(cur, n, type, listDownloadDate, (partialList && checkDupe), contentInfo, size, Util::toTimeT(date));
+				tmp.assign(size.data(), size.size());
+				d = DirectoryListing::Directory::create(cur, name, type, listDownloadDate, (partialList && checkDupe), contentInfo, tmp, date);
 			} else {
 				if(!incomp) {
 					d->setComplete();
 				}
-				d->setRemoteDate(Util::toTimeT(date));
+				d->setRemoteDate(date);
 			}
 			cur = d.get();
 
 			if (aSimple) {
 				// To handle <Directory Name="..." />
-				endTag(name);
+				endTag(aName);
 			}
 		}
-	} else if(name == sFileListing) {
+	} else if(aName == sFileListing) {
 		if (updating) {
-			const string& b = getAttrib(attribs, sBase, 2);
+			string b(getAttrib(attribs, sBase, 2));
 			dcassert(Util::isAdcDirectoryPath(base));
 
 			// Validate the parsed base path
@@ -413,8 +427,8 @@ void ListLoader::startTag(const string& name, StringPairList& attribs, bool aSim
 
 			dcassert(list->findDirectory(base));
 
-			const string& baseDate = getAttrib(attribs, sBaseDate, 3);
-			cur->setRemoteDate(Util::toTimeT(baseDate));
+			auto baseDate = getAttrib(attribs, sBaseDate, 3);
+			cur->setRemoteDate(static_cast<time_t>(toInt64(baseDate)));
 		}
 
 		// Set the root complete only after we have finished loading 
@@ -424,16 +438,17 @@ void ListLoader::startTag(const string& name, StringPairList& attribs, bool aSim
 
 		if (aSimple) {
 			// To handle <Directory Name="..." />
-			endTag(name);
+			endTag(aName);
 		}
 	}
 }
 
-void ListLoader::endTag(const string& name) {
+void ListLoader::endTag(string_view aName) {
 	if(inListing) {
-		if(name == sDirectory) {
+		if(aName == sDirectory) {
+			cur->files.shrinkToFit();
 			cur = cur->getParent();
-		} else if(name == sFileListing) {
+		} else if(aName == sFileListing) {
 			// Cur should be the loaded base path now
 
 			cur->setComplete();
@@ -456,9 +471,105 @@ DirectoryListing::File::File(Directory* aDir, const string& aName, int64_t aSize
 	//dcdebug("DirectoryListing::File (copy) %s was created\n", aName.c_str());
 }
 
-DirectoryListing::File::File(const File& rhs, const void* aOwner) noexcept : name(rhs.name), size(rhs.size), parent(rhs.parent), tthRoot(rhs.tthRoot), dupe(rhs.dupe), remoteDate(rhs.remoteDate), owner(aOwner)
+DirectoryListing::File::File(const FileStore& aStore, size_t aIndex) noexcept : name(aStore.getName(aIndex)), size(aStore.getSize(aIndex)), parent(aStore.getParent(aIndex)), 
+	tthRoot(aStore.getTTH(aIndex)), dupe(aStore.getDupe(aIndex)), remoteDate(aStore.getRemoteDate(aIndex)), owner(aStore.getOwner(aIndex))
 {
-	//dcdebug("DirectoryListing::File (copy) %s was created\n", rhs.getName().c_str());
+
+}
+
+void DirectoryListing::FileStore::add(string_view aName, int64_t aSize, const TTHValue& aTTH, time_t aRemoteDate, bool aCheckDupe) noexcept {
+	auto dupe = aCheckDupe && aSize > 0 ? AirUtil::checkFileDupe(aTTH) : DUPE_NONE;
+	addRow(aName, aSize, aTTH, aRemoteDate, dupe);
+}
+
+void DirectoryListing::FileStore::push_back(const Item& aFile, const void* aOwner) noexcept {
+	// The name would refer to the pool that is being modified
+	dcassert(aFile.store != this);
+
+	addRow(aFile.getName(), aFile.getSize(), aFile.getTTH(), aFile.getRemoteDate(), aFile.getDupe());
+
+	if (aFile.getParent() != directory || aOwner) {
+		if (foreign.empty()) {
+			foreign.resize(size(), ForeignInfo{ nullptr, nullptr });
+		}
+
+		foreign.back() = ForeignInfo{ aFile.getParent(), aOwner };
+	} else if (!foreign.empty()) {
+		foreign.back() = ForeignInfo{ nullptr, nullptr };
+	}
+}
+
+void DirectoryListing::FileStore::addRow(string_view aName, int64_t aSize, const TTHValue& aTTH, time_t aRemoteDate, DupeType aDupe) noexcept {
+	names.append(aName.data(), aName.size());
+	nameEnds.push_back(static_cast<uint32_t>(names.size()));
+	sizes.push_back(aSize);
+	dates.push_back(aRemoteDate);
+	tths.push_back(aTTH);
+	dupes.push_back(aDupe);
+
+	if (!foreign.empty()) {
+		foreign.push_back(ForeignInfo{ nullptr, nullptr });
+	}
+}
+
+void DirectoryListing::FileStore::moveRow(size_t aFrom, size_t aTo) noexcept {
+	dcassert(aTo < aFrom);
+
+	// The rows before aFrom have been compacted already, the name can't be overwritten yet
+	auto name = getName(aFrom);
+	auto start = aTo == 0 ? 0 : nameEnds[aTo - 1];
+	memmove(&names[start], name.data(), name.size());
+	nameEnds[aTo] = start + static_cast<uint32_t>(name.size());
+
+	sizes[aTo] = sizes[aFrom];
+	dates[aTo] = dates[aFrom];
+	tths[aTo] = tths[aFrom];
+	dupes[aTo] = dupes[aFrom];
+	if (!foreign.empty()) {
+		foreign[aTo] = foreign[aFrom];
+	}
+}
+
+void DirectoryListing::FileStore::truncate(size_t aSize) noexcept {
+	if (aSize == size()) {
+		return;
+	}
+
+	names.resize(aSize == 0 ? 0 : nameEnds[aSize - 1]);
+	nameEnds.resize(aSize);
+	sizes.resize(aSize);
+	dates.resize(aSize);
+	tths.resize(aSize);
+	dupes.resize(aSize);
+	if (!foreign.empty()) {
+		foreign.resize(aSize);
+	}
+
+	shrinkToFit();
+}
+
+void DirectoryListing::FileStore::clear() noexcept {
+	string().swap(names);
+	decltype(nameEnds)().swap(nameEnds);
+	decltype(sizes)().swap(sizes);
+	decltype(dates)().swap(dates);
+	decltype(tths)().swap(tths);
+	decltype(dupes)().swap(dupes);
+	decltype(foreign)().swap(foreign);
+}
+
+void DirectoryListing::FileStore::shrinkToFit() noexcept {
+	names.shrink_to_fit();
+	nameEnds.shrink_to_fit();
+	sizes.shrink_to_fit();
+	dates.shrink_to_fit();
+	tths.shrink_to_fit();
+	dupes.shrink_to_fit();
+	foreign.shrink_to_fit();
+}
+
+bool DirectoryListing::FileStore::isInQueue(size_t aIndex) const noexcept {
+	return AirUtil::isQueueDupe(dupes[aIndex]) || AirUtil::isFinishedDupe(dupes[aIndex]);
 }
 
 DirectoryListing::Directory::Ptr DirectoryListing::Directory::create(Directory* aParent, const string& aName, DirType aType, time_t aUpdateDate, bool aCheckDupe, const DirectoryContentInfo& aContentInfo, const string& aSize, time_t aRemoteDate) {
@@ -503,7 +614,7 @@ DirectoryListing::VirtualDirectory::VirtualDirectory(const string& aFullAdcPath,
 }
 
 DirectoryListing::Directory::Directory(Directory* aParent, const string& aName, Directory::DirType aType, time_t aUpdateDate, bool aCheckDupe, const DirectoryContentInfo& aContentInfo, const string& aSize, time_t aRemoteDate /*0*/)
-	: name(aName), parent(aParent), type(aType), remoteDate(aRemoteDate), lastUpdateDate(aUpdateDate), contentInfo(aContentInfo) {
+	: files(this), name(aName), parent(aParent), type(aType), remoteDate(aRemoteDate), lastUpdateDate(aUpdateDate), contentInfo(aContentInfo) {
 
 	if (!aSize.empty()) {
 		partialSize = Util::toInt64(aSize);
@@ -528,8 +639,11 @@ void DirectoryListing::Directory::search(OrderedStringSet& aResults, SearchQuery
 		}
 	}
 
-	for (auto& f: files) {
-		if (aStrings.matchesFile(f->getName(), f->getSize(), f->getRemoteDate(), f->getTTH())) {
+	string fileName;
+	for (size_t i = 0; i < files.size(); ++i) {
+		auto n = files.getName(i);
+		fileName.assign(n.data(), n.size());
+		if (aStrings.matchesFile(fileName, files.getSize(i), files.getRemoteDate(i), files.getTTH(i))) {
 			aResults.insert(getAdcPath());
 			break;
 		}
@@ -595,8 +709,9 @@ void DirectoryListing::Directory::toBundleInfoList(const string& aTarget, Bundle
 	// Then add the files
 
 	//sort(files.begin(), files.end(), File::Sort());
-	for (const auto& f: files) {
-		aFiles.emplace_back(aTarget + f->getName(), f->getTTH(), f->getSize(), Priority::DEFAULT, f->getRemoteDate());
+	for (size_t i = 0; i < files.size(); ++i) {
+		auto n = files.getName(i);
+		aFiles.emplace_back(aTarget + string(n.data(), n.size()), files.getTTH(i), files.getSize(i), Priority::DEFAULT, files.getRemoteDate(i));
 	}
 }
 
@@ -659,33 +774,24 @@ DirectoryListing::Directory::Ptr DirectoryListing::findDirectory(const string& a
 }
 
 void DirectoryListing::Directory::findFiles(const boost::regex& aReg, File::List& aResults) const noexcept {
-	copy_if(files.begin(), files.end(), back_inserter(aResults), [&aReg](const File::Ptr& df) { return boost::regex_match(df->getName(), aReg); });
+	for (size_t i = 0; i < files.size(); ++i) {
+		auto n = files.getName(i);
+		if (boost::regex_match(n.begin(), n.end(), aReg)) {
+			aResults.push_back(files.get(i));
+		}
+	}
 
 	for (const auto& d : directories | map_values) {
 		d->findFiles(aReg, aResults);
 	}
 }
 
-struct HashContained {
-	HashContained(const DirectoryListing::Directory::TTHSet& l) : tl(l) { }
-	const DirectoryListing::Directory::TTHSet& tl;
-	bool operator()(const DirectoryListing::File::Ptr& i) const {
-		return tl.count(i->getTTH()) > 0;
-	}
-};
-
 struct DirectoryEmpty {
 	bool operator()(const DirectoryListing::Directory::Ptr& aDir) const {
 		return Util::directoryEmpty(aDir->getContentInfo());
 	}
 };
 
-struct SizeLess {
-	bool operator()(const DirectoryListing::File::Ptr& f) const {
-		return f->getSize() < Util::convertSize(SETTING(SKIP_SUBTRACT), Util::KB);
-	}
-};
-
 DirectoryListing::Directory::~Directory() {
 	//dcdebug("DirectoryListing::Directory %s deleted\n", name.c_str());
 }
@@ -716,10 +822,11 @@ void DirectoryListing::Directory::filterList(DirectoryListing::Directory::TTHSet
 		}
 	}
 
-	files.erase(remove_if(files.begin(), files.end(), HashContained(l)), files.end());
+	files.removeIf([&](size_t i) { return l.count(files.getTTH(i)) > 0; });
 
 	if((SETTING(SKIP_SUBTRACT) > 0) && (files.size() < 2)) {   //setting for only skip if folder filecount under x ?
-		files.erase(remove_if(files.begin(), files.end(), SizeLess()), files.end());
+		auto minSize = Util::convertSize(SETTING(SKIP_SUBTRACT), Util::KB);
+		files.removeIf([&](size_t i) { return files.getSize(i) < minSize; });
 	}
 }
 
@@ -727,8 +834,8 @@ void DirectoryListing::Directory::getHashList(DirectoryListing::Directory::TTHSe
 	for(const auto& d: directories | map_values)  
 		d->getHashList(l);
 
-	for(const auto& f: files) 
-		l.insert(f->getTTH());
+	for (size_t i = 0; i < files.size(); ++i)
+		l.insert(files.getTTH(i));
 }
 	
 void DirectoryListing::getLocalPaths(const File::Ptr& f, StringList& ret) const {
@@ -816,8 +923,8 @@ string DirectoryListing::Directory::getAdcPath() const noexcept {
 
 int64_t DirectoryListing::Directory::getFilesSize() const noexcept {
 	int64_t x = 0;
-	for (const auto& f: files) {
-		x += f->getSize();
+	for (size_t i = 0; i < files.size(); ++i) {
+		x += files.getSize(i);
 	}
 	return x;
 }
@@ -857,38 +964,41 @@ uint8_t DirectoryListing::Directory::checkShareDupes() noexcept {
 	}
 
 	first = true;
-	for(auto& f: files) {
+	for (size_t i = 0; i < files.size(); ++i) {
 		//don't count 0 byte files since it'll give lots of partial dupes
 		//of no interest
-		if(f->getSize() > 0) {			
+		if(files.getSize(i) > 0) {
+			auto fileDupe = files.getDupe(i);
+			auto inQueue = files.isInQueue(i);
+
 			//if it's the first file in the dir and no sub-folders exist mark it as a dupe.
-			if (dupe == DUPE_NONE && f->getDupe() == DUPE_SHARE_FULL && directories.empty() && first)
+			if (dupe == DUPE_NONE && fileDupe == DUPE_SHARE_FULL && directories.empty() && first)
 				setDupe(DUPE_SHARE_FULL);
-			else if (dupe == DUPE_NONE && f->isInQueue() && directories.empty() && first)
+			else if (dupe == DUPE_NONE && inQueue && directories.empty() && first)
 				setDupe(DUPE_QUEUE_FULL);
 
 			//if it's the first file in the dir and we do have sub-folders but no dupes, mark as partial.
-			else if (dupe == DUPE_NONE && f->getDupe() == DUPE_SHARE_FULL && !directories.empty() && first)
+			else if (dupe == DUPE_NONE && fileDupe == DUPE_SHARE_FULL && !directories.empty() && first)
 				setDupe(DUPE_SHARE_PARTIAL);
-			else if (dupe == DUPE_NONE && f->isInQueue() && !directories.empty() && first)
+			else if (dupe == DUPE_NONE && inQueue && !directories.empty() && first)
 				setDupe(DUPE_QUEUE_PARTIAL);
 			
 			//if it's not the first file in the dir and we still don't have a dupe, mark it as partial.
-			else if (dupe == DUPE_NONE && f->getDupe() == DUPE_SHARE_FULL && !first)
+			else if (dupe == DUPE_NONE && fileDupe == DUPE_SHARE_FULL && !first)
 				setDupe(DUPE_SHARE_PARTIAL);
-			else if (dupe == DUPE_NONE && f->isInQueue() && !first)
+			else if (dupe == DUPE_NONE && inQueue && !first)
 				setDupe(DUPE_QUEUE_PARTIAL);
 			
 			//if it's a dupe and we find a non-dupe, mark as partial.
-			else if (dupe == DUPE_SHARE_FULL && f->getDupe() != DUPE_SHARE_FULL)
+			else if (dupe == DUPE_SHARE_FULL && fileDupe != DUPE_SHARE_FULL)
 				setDupe(DUPE_SHARE_PARTIAL);
-			else if (dupe == DUPE_QUEUE_FULL && !f->isInQueue())
+			else if (dupe == DUPE_QUEUE_FULL && !inQueue)
 				setDupe(DUPE_QUEUE_PARTIAL);
 
 			//if we find different type of dupe, change to mixed
-			else if (AirUtil::isShareDupe(dupe) && f->isInQueue())
+			else if (AirUtil::isShareDupe(dupe) && inQueue)
 				setDupe(DUPE_SHARE_QUEUE);
-			else if (AirUtil::isQueueDupe(dupe) && f->getDupe() == DUPE_SHARE_FULL)
+			else if (AirUtil::isQueueDupe(dupe) && fileDupe == DUPE_SHARE_FULL)
 				setDupe(DUPE_SHARE_QUEUE);
 
 			first = false;
@@ -1141,14 +1251,85 @@ void DirectoryListing::endSearch(bool timedOut /*false*/) noexcept {
 	}
 }
 
+// Loads the content directly from the share
+// The result must be equal with loading a partial XML list generated by ShareManager (see ListLoader)
+class ShareListLoader : public FilelistVisitor {
+public:
+	ShareListLoader(DirectoryListing* aList, const string& aBase, time_t aListDownloadDate) : list(aList), base(aBase), listDownloadDate(aListDownloadDate) {
+	}
+
+	void onListing(time_t aBaseDate) override {
+		cur = list->createBaseDirectory(base, listDownloadDate).get();
+		cur->setRemoteDate(aBaseDate);
+		baseDirectory = cur;
+	}
+
+	void onDirectoryStart(const string& aName, time_t aDate, bool aIncomplete, const DirectoryContentInfo& aContentInfo, int64_t aSize) override {
+		if (list->getClosing()) {
+			throw AbortException();
+		}
+
+		dirsLoaded++;
+
+		DirectoryListing::Directory::Ptr d = nullptr;
+		auto i = cur->directories.find(&aName);
+		if (i != cur->directories.end()) {
+			d = i->second;
+		}
+
+		if (!d) {
+			auto type = aIncomplete ? (aContentInfo.directories > 0 ? DirectoryListing::Directory::TYPE_INCOMPLETE_CHILD : DirectoryListing::Directory::TYPE_INCOMPLETE_NOCHILD) :
+				DirectoryListing::Directory::TYPE_NORMAL;
+
+			d = DirectoryListing::Directory::create(cur, aName, type, listDownloadDate, false, aContentInfo, aSize == 0 ? Util::emptyString : Util::toString(aSize), aDate);
+		} else {
+			if (!aIncomplete) {
+				d->setComplete();
+			}
+			d->setRemoteDate(aDate);
+		}
+
+		cur = d.get();
+	}
+
+	void onDirectoryEnd() override {
+		cur->files.shrinkToFit();
+		cur = cur->getParent();
+	}
+
+	void onFile(const string& aName, int64_t aSize, const TTHValue& aTTH, time_t aDate) override {
+		cur->files.add(aName, aSize, aTTH, aDate, false);
+	}
+
+	void onListingEnd() noexcept {
+		dcassert(cur == baseDirectory);
+
+		baseDirectory->setComplete();
+
+		// Content info is not loaded for the base path
+		baseDirectory->setContentInfo(baseDirectory->getContentInfoRecursive(false));
+	}
+
+	int getLoadedDirs() const noexcept { return dirsLoaded; }
+private:
+	DirectoryListing* list;
+	DirectoryListing::Directory* cur = nullptr;
+	DirectoryListing::Directory* baseDirectory = nullptr;
+
+	const string base;
+	const time_t listDownloadDate;
+	int dirsLoaded = 0;
+};
+
 int DirectoryListing::loadShareDirectory(const string& aPath, bool aRecurse) {
-	auto mis = ShareManager::getInstance()->generatePartialList(aPath, aRecurse, getShareProfile());
-	if (mis) {
-		return loadXML(*mis, true, aPath);
+	ShareListLoader loader(this, aPath, GET_TIME());
+	if (!ShareManager::getInstance()->toFilelist(loader, aPath, getShareProfile(), aRecurse)) {
+		//might happen if have refreshed the share meanwhile
+		throw Exception(CSTRING(FILE_NOT_AVAILABLE));
 	}
 
-	//might happen if have refreshed the share meanwhile
-	throw Exception(CSTRING(FILE_NOT_AVAILABLE));
+	loader.onListingEnd();
+	return loader.getLoadedDirs();
 }
 
 void DirectoryListing::changeDirectoryImpl(const string& aAdcPath, bool aReload, bool aIsSearchChange, bool aForceQueue) noexcept {
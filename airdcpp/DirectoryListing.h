@@ -44,6 +44,7 @@ namespace dcpp {
 
 class ListLoader;
 class SearchQuery;
+class ShareListLoader;
 typedef uint32_t DirectoryListingToken;
 
 class DirectoryListing : public UserInfoBase, public TrackableDownloadItem,
@@ -52,6 +53,10 @@ class DirectoryListing : public UserInfoBase, public TrackableDownloadItem,
 {
 public:
 	class Directory;
+	class FileStore;
+	// Read-only copy of a file stored in a directory (see FileStore::get)
+	// A new object is created on each call so the identity of File::Ptr isn't stable between calls,
+	// use FileStore::Item for iterating the files without allocations
 	class File : boost::noncopyable {
 
 	public:
@@ -63,7 +68,9 @@ public:
 		typedef List::const_iterator Iter;
 		
 		File(Directory* aDir, const string& aName, int64_t aSize, const TTHValue& aTTH, bool checkDupe, time_t aRemoteDate) noexcept;
-		File(const File& rhs, const void* aOwner) noexcept;
+
+		// Materialize a file stored in the directory
+		File(const FileStore& aStore, size_t aIndex) noexcept;
 
 		~File() { }
 
@@ -72,12 +79,13 @@ public:
 			return parent->getAdcPath() + name;
 		}
 
-		GETSET(string, name, Name);
-		GETSET(int64_t, size, Size);
-		GETSET(Directory*, parent, Parent);
-		GETSET(TTHValue, tthRoot, TTH);
-		IGETSET(DupeType, dupe, Dupe, DUPE_NONE);
-		IGETSET(time_t, remoteDate, RemoteDate, 0);
+		// Changes must be made via the directory's FileStore
+		const string& getName() const noexcept { return name; }
+		int64_t getSize() const noexcept { return size; }
+		Directory* getParent() const noexcept { return parent; }
+		const TTHValue& getTTH() const noexcept { return tthRoot; }
+		DupeType getDupe() const noexcept { return dupe; }
+		time_t getRemoteDate() const noexcept { return remoteDate; }
 
 		bool isInQueue() const noexcept;
 
@@ -85,7 +93,137 @@ public:
 			return owner;
 		}
 	private:
-		const void* owner = nullptr;
+		const string name;
+		const int64_t size;
+		Directory* const parent;
+		const TTHValue tthRoot;
+		DupeType dupe = DUPE_NONE;
+		const time_t remoteDate;
+		const void* const owner = nullptr;
+	};
+
+	// Compact column storage for the files of a single directory
+	// The names are stored in one string pool and the other properties in separate arrays so that
+	// scanning the files doesn't require touching any per-file allocations
+	// File objects are created only when requested (they are copies and won't reflect later changes)
+	class FileStore : boost::noncopyable {
+	public:
+		// Non-owning reference to a stored file, valid until the files of the directory are modified
+		class Item {
+		public:
+			Item(const FileStore& aStore, size_t aIndex) noexcept : store(&aStore), index(aIndex) { }
+
+			string_view getName() const noexcept { return store->getName(index); }
+			int64_t getSize() const noexcept { return store->getSize(index); }
+			time_t getRemoteDate() const noexcept { return store->getRemoteDate(index); }
+			const TTHValue& getTTH() const noexcept { return store->getTTH(index); }
+			DupeType getDupe() const noexcept { return store->getDupe(index); }
+			bool isInQueue() const noexcept { return store->isInQueue(index); }
+			Directory* getParent() const noexcept { return store->getParent(index); }
+			const void* getOwner() const noexcept { return store->getOwner(index); }
+
+			File::Ptr toFile() const noexcept { return store->get(index); }
+		private:
+			friend class FileStore;
+
+			const FileStore* store;
+			size_t index;
+		};
+
+		class Iter {
+		public:
+			typedef std::input_iterator_tag iterator_category;
+			typedef Item value_type;
+			typedef ptrdiff_t difference_type;
+			typedef const Item* pointer;
+			typedef Item reference;
+
+			Iter(const FileStore& aStore, size_t aIndex) noexcept : store(&aStore), index(aIndex) { }
+
+			Item operator*() const noexcept { return Item(*store, index); }
+			Iter& operator++() noexcept { index++; return *this; }
+			bool operator==(const Iter& rhs) const noexcept { return index == rhs.index; }
+			bool operator!=(const Iter& rhs) const noexcept { return index != rhs.index; }
+		private:
+			const FileStore* store;
+			size_t index;
+		};
+
+		explicit FileStore(Directory* aDirectory) noexcept : directory(aDirectory) { }
+
+		size_t size() const noexcept { return sizes.size(); }
+		bool empty() const noexcept { return sizes.empty(); }
+
+		Iter begin() const noexcept { return Iter(*this, 0); }
+		Iter end() const noexcept { return Iter(*this, size()); }
+
+		File::Ptr get(size_t aIndex) const noexcept { return make_shared<File>(*this, aIndex); }
+		File::Ptr operator[](size_t aIndex) const noexcept { return get(aIndex); }
+
+		string_view getName(size_t aIndex) const noexcept {
+			auto start = aIndex == 0 ? 0 : nameEnds[aIndex - 1];
+			return string_view(names.data() + start, nameEnds[aIndex] - start);
+		}
+
+		int64_t getSize(size_t aIndex) const noexcept { return sizes[aIndex]; }
+		time_t getRemoteDate(size_t aIndex) const noexcept { return dates[aIndex]; }
+		const TTHValue& getTTH(size_t aIndex) const noexcept { return tths[aIndex]; }
+		DupeType getDupe(size_t aIndex) const noexcept { return dupes[aIndex]; }
+		bool isInQueue(size_t aIndex) const noexcept;
+
+		// Files copied from other directories (ADL search) keep their original parent
+		Directory* getParent(size_t aIndex) const noexcept { return foreign.empty() || !foreign[aIndex].parent ? directory : foreign[aIndex].parent; }
+		const void* getOwner(size_t aIndex) const noexcept { return foreign.empty() ? nullptr : foreign[aIndex].owner; }
+
+		void add(string_view aName, int64_t aSize, const TTHValue& aTTH, time_t aRemoteDate, bool aCheckDupe) noexcept;
+
+		// Copies the file information (aOwner is set for files copied by ADL search)
+		void push_back(const Item& aFile, const void* aOwner) noexcept;
+
+		// Removes the files for which aRemoveF(index) returns true
+		template<class RemoveF>
+		void removeIf(RemoveF&& aRemoveF) noexcept {
+			size_t kept = 0;
+			for (size_t i = 0; i < size(); ++i) {
+				if (aRemoveF(i)) {
+					continue;
+				}
+
+				if (kept != i) {
+					moveRow(i, kept);
+				}
+
+				kept++;
+			}
+
+			truncate(kept);
+		}
+
+		void clear() noexcept;
+
+		// Release the memory reserved for further additions (call after the directory has been loaded)
+		void shrinkToFit() noexcept;
+	private:
+		struct ForeignInfo {
+			Directory* parent;
+			const void* owner;
+		};
+
+		void addRow(string_view aName, int64_t aSize, const TTHValue& aTTH, time_t aRemoteDate, DupeType aDupe) noexcept;
+		void moveRow(size_t aFrom, size_t aTo) noexcept;
+		void truncate(size_t aSize) noexcept;
+
+		Directory* const directory;
+
+		string names;
+		vector<uint32_t> nameEnds;
+		vector<int64_t> sizes;
+		vector<time_t> dates;
+		vector<TTHValue> tths;
+		vector<DupeType> dupes;
+
+		// Allocated only when files are copied from other directories
+		vector<ForeignInfo> foreign;
 	};
 
 	class Directory : boost::noncopyable {
@@ -106,7 +244,7 @@ public:
 		typedef map<const string*, Ptr, noCaseStringLess> Map;
 		
 		Map directories;
-		File::List files;
+		FileStore files;
 
 		static Directory::Ptr create(Directory* aParent, const string& aName, DirType aType, time_t aUpdateDate, 
 			bool checkDupe = false, const DirectoryContentInfo& aContentInfo = DirectoryContentInfo(),
@@ -314,6 +452,7 @@ private:
 	void updateCurrentLocation(const Directory::Ptr& aCurrentDirectory) noexcept;
 
 	friend class ListLoader;
+	friend class ShareListLoader;
 
 	Directory::Ptr root;
 
@@ -62,6 +62,9 @@ Download::Download(UserConnection& conn, QueueItem& qi) noexcept : Transfer(conn
 		dcassert(!qi.isSet(QueueItem::FLAG_USER_LIST));
 		dcassert(!qi.isSet(QueueItem::FLAG_CLIENT_VIEW));
 		setBundle(qi.getBundle());
+
+		// Bundle priority limits
+		conn.updateLimiters();
 	}
 	
 	if(getType() == TYPE_FILE && qi.getSize() != -1) {
@@ -37,7 +37,8 @@ DualString::DualString(const string& aStr) : string(dcpp::Text::toLower(aStr)) {
 		int nb = dcpp::Text::utf8ToWc(b, cb);
 		if (ca != cb) {
 			if (!charSizes) {
-				initSizeArray(aStr.size());
+				// The lowercase string may be longer (the mask is stored based on its length)
+				initSizeArray(std::max(aStr.size(), string::size()));
 			}
 			charSizes[arrayPos] |= (1 << bitPos);
 		}
@@ -55,6 +56,18 @@ DualString::DualString(const string& aStr) : string(dcpp::Text::toLower(aStr)) {
 	}
 }
 
+DualString::DualString(string&& aLower, const MaskType* aCaseMask) : string(std::move(aLower)) {
+	if (aCaseMask) {
+		auto maskSize = getCaseMaskSize(string::size());
+		charSizes = new MaskType[maskSize];
+		std::copy(aCaseMask, aCaseMask + maskSize, charSizes);
+	}
+}
+
+size_t DualString::getCaseMaskSize(size_t aLowerLength) noexcept {
+	return (aLowerLength + ARRAY_BITS - 1) / ARRAY_BITS;
+}
+
 // Create an array with minumum possible length that will store the character sizes (unset=lowercase, set=uppercase)
 size_t DualString::initSizeArray(size_t strLen) {
 	size_t arrSize = strLen % ARRAY_BITS == 0 ? strLen / ARRAY_BITS : (strLen / ARRAY_BITS) + 1;
@@ -118,4 +131,21 @@ string DualString::getNormal() const {
 
 bool DualString::lowerCaseOnly() const noexcept {
 	return !charSizes; 
+}
+
+size_t DualString::getHeapSize() const noexcept {
+	size_t ret = 0;
+
+	// Short strings are stored inside the object
+	auto data = c_str();
+	auto object = reinterpret_cast<const char*>(static_cast<const string*>(this));
+	if (data < object || data >= object + sizeof(string)) {
+		ret += capacity() + 1;
+	}
+
+	if (charSizes) {
+		ret += ((size() + ARRAY_BITS - 1) / ARRAY_BITS) * sizeof(MaskType);
+	}
+
+	return ret;
 }
\ No newline at end of file
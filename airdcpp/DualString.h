@@ -32,6 +32,9 @@ public:
 	typedef uint32_t MaskType;
 
 	DualString(const string& aStr);
+
+	// Restore a string from the stored representation (the mask may be nullptr if there are no uppercase characters)
+	DualString(string&& aLower, const MaskType* aCaseMask);
 	~DualString();
 
 	const string& getLower() const { return *this; }
@@ -41,6 +44,13 @@ public:
 
 	bool lowerCaseOnly() const noexcept;
 
+	// Positions of uppercase characters, nullptr if the string is lowercase only
+	const MaskType* getCaseMask() const noexcept { return charSizes; }
+	static size_t getCaseMaskSize(size_t aLowerLength) noexcept;
+
+	// Bytes allocated outside the object
+	size_t getHeapSize() const noexcept;
+
 	DualString(DualString&& rhs);
 	DualString& operator=(DualString&&);
 	DualString(const DualString&) = delete;
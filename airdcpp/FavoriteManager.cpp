@@ -24,6 +24,7 @@
 #include "ResourceManager.h"
 #include "ShareManager.h"
 #include "SimpleXML.h"
+#include "ThrottleManager.h"
 #include "UserCommand.h"
 
 namespace dcpp {
@@ -256,6 +257,12 @@ void FavoriteManager::addSavedUser(const UserPtr& aUser) noexcept {
 	setDirty();
 }
 
+static void updateUserSpeedLimits(const CID& aCID, int aUploadLimit, int aDownloadLimit) noexcept {
+	auto tm = ThrottleManager::getInstance();
+	tm->setClassLimit(ThrottleManager::CLASS_USER, aCID.toBase32(), true, aUploadLimit);
+	tm->setClassLimit(ThrottleManager::CLASS_USER, aCID.toBase32(), false, aDownloadLimit);
+}
+
 void FavoriteManager::removeFavoriteUser(const UserPtr& aUser) noexcept {
 	{
 		WLock l(cs);
@@ -267,6 +274,7 @@ void FavoriteManager::removeFavoriteUser(const UserPtr& aUser) noexcept {
 		}
 	}
 
+	updateUserSpeedLimits(aUser->getCID(), 0, 0);
 	setDirty();
 }
 
@@ -288,6 +296,21 @@ void FavoriteManager::changeLimiterOverride(const UserPtr& aUser) noexcept {
 	}
 }
 
+void FavoriteManager::setUserSpeedLimits(const UserPtr& aUser, int aUploadLimit, int aDownloadLimit) noexcept {
+	{
+		WLock l(cs);
+		auto i = users.find(aUser->getCID());
+		if (i == users.end())
+			return;
+
+		i->second.setUploadLimit(aUploadLimit);
+		i->second.setDownloadLimit(aDownloadLimit);
+	}
+
+	updateUserSpeedLimits(aUser->getCID(), aUploadLimit, aDownloadLimit);
+	setDirty();
+}
+
 bool FavoriteManager::hasFavoriteDir(const string& aPath) const noexcept {
 	RLock l(cs);
 	return favoriteDirectories.find(aPath) != favoriteDirectories.end();
@@ -538,6 +561,8 @@ void FavoriteManager::saveFavoriteUsers(SimpleXML& aXml) noexcept {
 			aXml.addChildAttrib("LastSeen", i.second.getLastSeen());
 			aXml.addChildAttrib("GrantSlot", i.second.isSet(FavoriteUser::FLAG_GRANTSLOT));
 			aXml.addChildAttrib("SuperUser", i.second.isSet(FavoriteUser::FLAG_SUPERUSER));
+			aXml.addChildAttrib("UploadLimit", i.second.getUploadLimit());
+			aXml.addChildAttrib("DownloadLimit", i.second.getDownloadLimit());
 			aXml.addChildAttrib("UserDescription", i.second.getDescription());
 			aXml.addChildAttrib("Nick", i.second.getNick());
 			aXml.addChildAttrib("URL", i.second.getUrl());
@@ -803,6 +828,10 @@ void FavoriteManager::loadFavoriteUsers(SimpleXML& aXml) {
 
 			i->second.setLastSeen(lastSeen);
 			i->second.setDescription(aXml.getChildAttrib("UserDescription"));
+
+			i->second.setUploadLimit(aXml.getIntChildAttrib("UploadLimit"));
+			i->second.setDownloadLimit(aXml.getIntChildAttrib("DownloadLimit"));
+			updateUserSpeedLimits(u->getCID(), i->second.getUploadLimit(), i->second.getDownloadLimit());
 			
 		}
 		aXml.stepOut();
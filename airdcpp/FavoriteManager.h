@@ -54,6 +54,9 @@ public:
 	void setAutoGrant(const UserPtr& aUser, bool grant) noexcept;
 	time_t getLastSeen(const UserPtr& aUser) const noexcept;
 	void changeLimiterOverride(const UserPtr& aUser) noexcept;
+
+	// Sets the speed limits (KiB/s, 0 = unlimited) for all connections of a favorite user
+	void setUserSpeedLimits(const UserPtr& aUser, int aUploadLimit, int aDownloadLimit) noexcept;
 // Favorite Hubs
 	void autoConnect() noexcept;
 	FavoriteHubEntryList& getFavoriteHubs() noexcept { return favoriteHubs; }
@@ -42,6 +42,10 @@ public:
 	GETSET(string, url, Url);
 	GETSET(time_t, lastSeen, LastSeen);
 	GETSET(string, description, Description);
+
+	// KiB/s, 0 = unlimited
+	IGETSET(int, uploadLimit, UploadLimit, 0);
+	IGETSET(int, downloadLimit, DownloadLimit, 0);
 };
 
 } // namespace dcpp
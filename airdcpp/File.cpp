@@ -31,6 +31,7 @@
 #include <errno.h>
 #include <dirent.h>
 #include <fnmatch.h>
+#include <sys/mman.h>
 #include <utime.h>
 #endif
 
@@ -194,6 +195,38 @@ size_t File::write(const void* buf, size_t len) {
 	dcassert(x == len);
 	return x;
 }
+
+size_t File::readAt(void* buf, size_t& len, int64_t aPos) {
+	OVERLAPPED over = { 0 };
+	over.Offset = static_cast<DWORD>(aPos & 0xffffffff);
+	over.OffsetHigh = static_cast<DWORD>(aPos >> 32);
+
+	DWORD x;
+	if(!::ReadFile(h, buf, (DWORD)len, &x, &over)) {
+		auto err = GetLastError();
+		if(err != ERROR_HANDLE_EOF) {
+			throw FileException(Util::translateError(err));
+		}
+
+		x = 0;
+	}
+	len = x;
+	return x;
+}
+
+size_t File::writeAt(const void* buf, size_t len, int64_t aPos) {
+	OVERLAPPED over = { 0 };
+	over.Offset = static_cast<DWORD>(aPos & 0xffffffff);
+	over.OffsetHigh = static_cast<DWORD>(aPos >> 32);
+
+	DWORD x;
+	if(!::WriteFile(h, buf, (DWORD)len, &x, &over)) {
+		throw FileException(Util::translateError(GetLastError()));
+	}
+	dcassert(x == len);
+	return x;
+}
+
 void File::setEOF() {
 	dcassert(isOpen());
 	if(!SetEndOfFile(h)) {
@@ -500,6 +533,39 @@ size_t File::write(const void* buf, size_t len) {
 	return len;
 }
 
+size_t File::readAt(void* buf, size_t& len, int64_t aPos) {
+	ssize_t result;
+	do {
+		result = ::pread(h, buf, len, (off_t)aPos);
+	} while (result == -1 && errno == EINTR);
+
+	if (result == -1) {
+		throw FileException(Util::translateError(errno));
+	}
+	len = result;
+	return (size_t)result;
+}
+
+size_t File::writeAt(const void* buf, size_t len, int64_t aPos) {
+	ssize_t result;
+	char* pointer = (char*)buf;
+	ssize_t left = len;
+
+	while (left > 0) {
+		result = ::pwrite(h, pointer, left, (off_t)aPos);
+		if (result == -1) {
+			if (errno != EINTR) {
+				throw FileException(Util::translateError(errno));
+			}
+		} else {
+			pointer += result;
+			left -= result;
+			aPos += result;
+		}
+	}
+	return len;
+}
+
 // some ftruncate implementations can't extend files like SetEndOfFile,
 // not sure if the client code needs this...
 int File::extendFile(int64_t len) noexcept {
@@ -1186,6 +1252,47 @@ time_t FileItem::getLastWriteTime() const noexcept {
 
 #endif // _WIN32
 
+MappedFile::MappedFile(const string& aFileName) : file(aFileName, File::READ, File::OPEN | File::SHARED_WRITE, File::BUFFER_RANDOM) {
+	size = static_cast<size_t>(file.getSize());
+	if (size == 0) {
+		return;
+	}
+
+#ifdef _WIN32
+	mapping = CreateFileMapping(file.getNativeHandle(), NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping) {
+		throw FileException(Util::translateError(GetLastError()));
+	}
+
+	data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!data) {
+		auto error = GetLastError();
+		CloseHandle(mapping);
+		throw FileException(Util::translateError(error));
+	}
+#else
+	auto p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file.getNativeHandle(), 0);
+	if (p == MAP_FAILED) {
+		throw FileException(Util::translateError(errno));
+	}
+
+	data = static_cast<const uint8_t*>(p);
+#endif
+}
+
+MappedFile::~MappedFile() {
+	if (!data) {
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle(mapping);
+#else
+	::munmap(const_cast<uint8_t*>(data), size);
+#endif
+}
+
 #ifdef _WIN32
 FILE* dcpp_fopen(const char* filename, const char* mode) {
 	return _wfopen(Text::toT(filename).c_str(), Text::toT(mode).c_str());
@@ -123,8 +123,14 @@ public:
 	string getRealPath() const;
 
 	size_t read(void* buf, size_t& len) override;
+	File* getDirectFile(int64_t& maxBytes_) noexcept override { maxBytes_ = -1; return this; }
 	size_t write(const void* buf, size_t len) override;
 
+	// Positional I/O, can be used concurrently from multiple threads
+	// The current file position isn't used (it may or may not be changed depending on the platform)
+	size_t readAt(void* buf, size_t& len, int64_t aPos);
+	size_t writeAt(const void* buf, size_t len, int64_t aPos);
+
 	// This has no effect if aForce is false
 	// Generally the operating system should decide when the buffered data is written on disk
 	size_t flushBuffers(bool aForce = true) override;
@@ -228,6 +234,26 @@ protected:
 	HandleType h;
 };
 
+// Read-only memory mapping of a whole file
+class MappedFile : boost::noncopyable {
+public:
+	// Throws FileException
+	explicit MappedFile(const string& aFileName);
+	~MappedFile();
+
+	// nullptr for empty files
+	const uint8_t* getData() const noexcept { return data; }
+	size_t getSize() const noexcept { return size; }
+private:
+	File file;
+
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE mapping = NULL;
+#endif
+};
+
 class FileFindIter {
 public:
 	// End iterator constructor
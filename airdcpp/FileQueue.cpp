@@ -102,11 +102,12 @@ void FileQueue::matchDir(const DirectoryListing::Directory::Ptr& aDir, QueueItem
 		}
 	}
 
-	for(const auto& f: aDir->files) {
-		auto tthRange = tthIndex.equal_range(const_cast<TTHValue*>(&f->getTTH()));
+	const auto& files = aDir->files;
+	for (size_t i = 0; i < files.size(); ++i) {
+		auto tthRange = tthIndex.equal_range(const_cast<TTHValue*>(&files.getTTH(i)));
 
 		for_each(tthRange, [&](const pair<TTHValue*, QueueItemPtr>& tqp) {
-			if (!tqp.second->isDownloaded() && tqp.second->getSize() == f->getSize() && find(ql_, tqp.second) == ql_.end()) {
+			if (!tqp.second->isDownloaded() && tqp.second->getSize() == files.getSize(i) && find(ql_, tqp.second) == ql_.end()) {
 				ql_.push_back(tqp.second);
 			}
 		});
@@ -26,6 +26,20 @@
 #include "Text.h"
 #include "Util.h"
 
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __NR_io_uring_setup
+#define HAVE_IO_URING
+#endif
+#endif
+
 namespace dcpp {
 
 using std::make_pair;
@@ -41,7 +55,11 @@ const size_t FileReader::DEFAULT_BLOCK_SIZE = 1024 * 1024;
 size_t FileReader::read(const string& aPath, const DataCallback& callback) {
 	size_t ret = READ_FAILED;
 
-	if (preferredStrategy == ASYNC) {
+	if (preferredStrategy == URING) {
+		ret = readUring(aPath, callback);
+	}
+
+	if (ret == READ_FAILED && preferredStrategy != SYNC) {
 		ret = readAsync(aPath, callback);
 	}
 
@@ -213,5 +231,326 @@ size_t FileReader::readAsync(const string& file, const DataCallback& callback) {
 	return READ_FAILED;
 }
 
+#endif
+
+#ifdef HAVE_IO_URING
+
+namespace {
+
+// Set if the kernel doesn't support io_uring at all (no need to try again for each file)
+static std::atomic<bool> uringUnsupported = { false };
+
+// Minimal io_uring wrapper using raw system calls (liburing isn't required)
+class Uring : boost::noncopyable {
+public:
+	Uring() { }
+
+	~Uring() {
+		if (sqes != MAP_FAILED) {
+			::munmap(sqes, sqesSize);
+		}
+
+		if (cqRing != MAP_FAILED && cqRing != sqRing) {
+			::munmap(cqRing, cqRingSize);
+		}
+
+		if (sqRing != MAP_FAILED) {
+			::munmap(sqRing, sqRingSize);
+		}
+
+		if (fd != -1) {
+			::close(fd);
+		}
+	}
+
+	bool init(unsigned aEntries) noexcept {
+		io_uring_params p = { };
+		fd = static_cast<int>(::syscall(__NR_io_uring_setup, aEntries, &p));
+		if (fd < 0) {
+			if (errno == ENOSYS || errno == EPERM) {
+				// Not compiled in or disabled by the administrator
+				uringUnsupported = true;
+			}
+
+			dcdebug("io_uring setup failed: %s\n", Util::translateError(errno).c_str());
+			return false;
+		}
+
+		sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+
+		auto singleMmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (singleMmap) {
+			sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+		}
+
+		sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (sqRing == MAP_FAILED) {
+			return false;
+		}
+
+		cqRing = singleMmap ? sqRing : ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cqRing == MAP_FAILED) {
+			return false;
+		}
+
+		sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+		sqes = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+		if (sqes == MAP_FAILED) {
+			return false;
+		}
+
+		auto sq = static_cast<uint8_t*>(sqRing);
+		sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+		sqMask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+		sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+
+		auto cq = static_cast<uint8_t*>(cqRing);
+		cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+		cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+		cqMask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+		cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+		return true;
+	}
+
+	// Pinning the buffers may fail because of RLIMIT_MEMLOCK with older kernels
+	bool registerBuffers(const vector<iovec>& aBuffers) noexcept {
+		return ::syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, aBuffers.data(), aBuffers.size()) == 0;
+	}
+
+	// Queue a read, the index is returned with the completion
+	// Registered buffers are referred to with the same index
+	void queueRead(int aFd, const iovec* aBuffer, unsigned aIndex, int64_t aPos, bool aFixed) noexcept {
+		auto tail = *sqTail;
+		auto& sqe = static_cast<io_uring_sqe*>(sqes)[tail & sqMask];
+		memset(&sqe, 0, sizeof(sqe));
+
+		sqe.fd = aFd;
+		sqe.off = aPos;
+		sqe.user_data = aIndex;
+		if (aFixed) {
+			sqe.opcode = IORING_OP_READ_FIXED;
+			sqe.addr = reinterpret_cast<uint64_t>(aBuffer->iov_base);
+			sqe.len = static_cast<uint32_t>(aBuffer->iov_len);
+			sqe.buf_index = static_cast<uint16_t>(aIndex);
+		} else {
+			sqe.opcode = IORING_OP_READV;
+			sqe.addr = reinterpret_cast<uint64_t>(aBuffer);
+			sqe.len = 1;
+		}
+
+		sqArray[tail & sqMask] = tail & sqMask;
+		__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+		pending++;
+	}
+
+	// Submit the queued reads and wait for one completion
+	// Returns a negative error code if the system call fails
+	int submitAndWait(unsigned& index_, int& result_) noexcept {
+		for (;;) {
+			auto head = *cqHead;
+			if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+				const auto& cqe = cqes[head & cqMask];
+				index_ = static_cast<unsigned>(cqe.user_data);
+				result_ = cqe.res;
+				__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+				return 0;
+			}
+
+			auto ret = ::syscall(__NR_io_uring_enter, fd, pending, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+			if (ret < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+
+				return -errno;
+			}
+
+			pending -= static_cast<unsigned>(ret);
+		}
+	}
+private:
+	int fd = -1;
+	unsigned pending = 0;
+
+	void* sqRing = MAP_FAILED;
+	size_t sqRingSize = 0;
+	void* cqRing = MAP_FAILED;
+	size_t cqRingSize = 0;
+	void* sqes = MAP_FAILED;
+	size_t sqesSize = 0;
+
+	unsigned* sqTail = nullptr;
+	unsigned* sqArray = nullptr;
+	unsigned sqMask = 0;
+
+	unsigned* cqHead = nullptr;
+	unsigned* cqTail = nullptr;
+	unsigned cqMask = 0;
+	io_uring_cqe* cqes = nullptr;
+};
+
+struct FileHandle : boost::noncopyable {
+	FileHandle(int h) : h(h) { }
+	~FileHandle() { ::close(h); }
+
+	operator int() { return h; }
+
+	int h;
+};
+
+}
+
+size_t FileReader::readUring(const string& aPath, const DataCallback& callback) {
+	// Reads in flight
+	static const unsigned QUEUE_DEPTH = 4;
+
+	// Required by O_DIRECT for offsets, lengths and buffer addresses (logical block size of the device)
+	static const size_t ALIGNMENT = 4096;
+
+	if (uringUnsupported) {
+		return READ_FAILED;
+	}
+
+	auto tmp = ::open(aPath.c_str(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+	if (tmp == -1) {
+		// Not all file systems support unbuffered reads
+		dcdebug("Failed to open unbuffered file: %s\n", Util::translateError(errno).c_str());
+		return READ_FAILED;
+	}
+
+	FileHandle h(tmp);
+
+	struct stat st;
+	if (::fstat(h, &st) != 0) {
+		return READ_FAILED;
+	}
+
+	Uring ring;
+	if (!ring.init(QUEUE_DEPTH)) {
+		return READ_FAILED;
+	}
+
+	auto bufSize = getBlockSize(ALIGNMENT);
+	buffer.resize(bufSize * QUEUE_DEPTH + ALIGNMENT);
+
+	auto buf = static_cast<uint8_t*>(align(&buffer[0], ALIGNMENT));
+
+	vector<iovec> buffers;
+	for (unsigned i = 0; i < QUEUE_DEPTH; ++i) {
+		buffers.push_back({ buf + i * bufSize, bufSize });
+	}
+
+	auto fixed = ring.registerBuffers(buffers);
+
+	// Completions may arrive in any order, the data must be passed to the callback in file order
+	struct Slot {
+		int64_t pos = -1;
+		int result = 0;
+		bool done = false;
+	};
+
+	Slot slots[QUEUE_DEPTH];
+
+	const int64_t fileSize = st.st_size;
+	int64_t queuePos = 0;
+	int64_t callbackPos = 0;
+	unsigned inFlight = 0;
+
+	auto queueRead = [&](unsigned aIndex) {
+		slots[aIndex].pos = queuePos;
+		slots[aIndex].done = false;
+		ring.queueRead(h, &buffers[aIndex], aIndex, queuePos, fixed);
+
+		queuePos += bufSize;
+		inFlight++;
+	};
+
+	// The kernel may still be writing into our buffers
+	auto waitInFlight = [&] {
+		unsigned index;
+		int result;
+		while (inFlight > 0 && ring.submitAndWait(index, result) == 0) {
+			inFlight--;
+		}
+	};
+
+	for (unsigned i = 0; i < QUEUE_DEPTH && queuePos < fileSize; ++i) {
+		queueRead(i);
+	}
+
+	size_t total = 0;
+	bool go = true;
+	while (inFlight > 0) {
+		unsigned index;
+		int result;
+		auto err = ring.submitAndWait(index, result);
+		if (err < 0) {
+			// The reads weren't submitted
+			if (total == 0) {
+				dcdebug("io_uring submit failed: %s\n", Util::translateError(-err).c_str());
+				return READ_FAILED;
+			}
+
+			throw FileException(Util::translateError(-err));
+		}
+
+		inFlight--;
+		slots[index].result = result;
+		slots[index].done = true;
+
+		// Pass all consecutive completed blocks
+		for (;;) {
+			auto s = find_if(slots, slots + QUEUE_DEPTH, [&](const Slot& aSlot) { return aSlot.pos == callbackPos; });
+			if (s == slots + QUEUE_DEPTH || !s->done) {
+				break;
+			}
+
+			if (s->result < 0) {
+				waitInFlight();
+				if (total == 0) {
+					dcdebug("First io_uring read failed: %s\n", Util::translateError(-s->result).c_str());
+					return READ_FAILED;
+				}
+
+				throw FileException(Util::translateError(-s->result));
+			}
+
+			s->pos = -1;
+
+			auto n = static_cast<size_t>(s->result);
+			if (n > 0) {
+				try {
+					go = callback(buffers[s - slots].iov_base, n);
+				} catch (...) {
+					waitInFlight();
+					throw;
+				}
+
+				total += n;
+			}
+
+			// A short read means that the end of file was reached (or the file was truncated)
+			if (n < bufSize || !go) {
+				waitInFlight();
+				return total;
+			}
+
+			callbackPos += bufSize;
+			if (queuePos < fileSize) {
+				queueRead(static_cast<unsigned>(s - slots));
+			}
+		}
+	}
+
+	return total;
+}
+
+#else
+
+size_t FileReader::readUring(const string& /*aPath*/, const DataCallback& /*callback*/) {
+	return READ_FAILED;
+}
+
 #endif
 }
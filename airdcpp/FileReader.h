@@ -38,6 +38,8 @@ class FileReader : boost::noncopyable {
 public:
 
 	enum Strategy {
+		// io_uring with multiple unbuffered reads in flight (Linux only, falls back to ASYNC)
+		URING = 2,
 		ASYNC = 1,
 		SYNC = 0
 	};
@@ -73,6 +75,7 @@ private:
 	size_t getBlockSize(size_t alignment);
 	void* align(void* buf, size_t alignment);
 
+	size_t readUring(const string& aFile, const DataCallback& callback);
 	size_t readAsync(const string& aFile, const DataCallback& callback);
 	size_t readSync(const string& aFile, const DataCallback& callback);
 };
@@ -0,0 +1,516 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "FilelistReader.h"
+
+#include "Exception.h"
+#include "StreamBase.h"
+#include "Text.h"
+#include "Util.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+# define FILELISTREADER_X86
+# include <emmintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+# endif
+#endif
+
+namespace dcpp {
+
+namespace {
+
+inline bool isSpace(char c) noexcept {
+	return c == 0x20 || c == 0x09 || c == 0x0d || c == 0x0a;
+}
+
+// Same characters as with SimpleXMLReader
+inline bool isNameStartChar(char c) noexcept {
+	return c == ':' || c == '_' || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+inline bool isNameChar(char c) noexcept {
+	return isNameStartChar(c) || c == '-' || c == '.' || (c >= '0' && c <= '9');
+}
+
+inline bool skipSpace(const char*& pos_, const char* aEnd) noexcept {
+	while (pos_ < aEnd && isSpace(*pos_)) {
+		pos_++;
+	}
+
+	return pos_ < aEnd;
+}
+
+inline bool startsWith(const char* aPos, const char* aEnd, string_view aStr) noexcept {
+	return static_cast<size_t>(aEnd - aPos) >= aStr.size() && memcmp(aPos, aStr.data(), aStr.size()) == 0;
+}
+
+#ifdef FILELISTREADER_X86
+inline int lowestBit(uint32_t aMask) noexcept {
+#ifdef _MSC_VER
+	unsigned long ret;
+	_BitScanForward(&ret, aMask);
+	return static_cast<int>(ret);
+#else
+	return __builtin_ctz(aMask);
+#endif
+}
+#endif
+
+// Returns the position of the first aA or aB character (or aEnd if neither one was found)
+inline const char* findAny(const char* aPos, const char* aEnd, char aA, char aB) noexcept {
+#ifdef FILELISTREADER_X86
+	const auto a = _mm_set1_epi8(aA);
+	const auto b = _mm_set1_epi8(aB);
+	for (; aEnd - aPos >= 16; aPos += 16) {
+		const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aPos));
+		const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, a), _mm_cmpeq_epi8(block, b))));
+		if (mask != 0) {
+			return aPos + lowestBit(mask);
+		}
+	}
+#endif
+
+	for (; aPos < aEnd; ++aPos) {
+		if (*aPos == aA || *aPos == aB) {
+			return aPos;
+		}
+	}
+
+	return aEnd;
+}
+
+inline bool isAscii(const char* aPos, const char* aEnd) noexcept {
+#ifdef FILELISTREADER_X86
+	auto bits = _mm_setzero_si128();
+	for (; aEnd - aPos >= 16; aPos += 16) {
+		bits = _mm_or_si128(bits, _mm_loadu_si128(reinterpret_cast<const __m128i*>(aPos)));
+	}
+
+	if (_mm_movemask_epi8(bits) != 0) {
+		return false;
+	}
+#endif
+
+	for (; aPos < aEnd; ++aPos) {
+		if (static_cast<uint8_t>(*aPos) & 0x80) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+}
+
+FilelistReader::FilelistReader(CallBack* aCallback) : cb(aCallback) {
+	elements.reserve(MAX_NESTING);
+	attribs.reserve(16);
+	values.reserve(16);
+}
+
+string_view FilelistReader::CallBack::getAttrib(const AttributeList& aAttribs, string_view aName, size_t aHint) noexcept {
+	aHint = min(aHint, aAttribs.size());
+
+	auto matchName = [&aName](const Attribute& aAttrib) { return aAttrib.name == aName; };
+	auto i = find_if(aAttribs.begin() + aHint, aAttribs.end(), matchName);
+	if (i == aAttribs.end()) {
+		i = find_if(aAttribs.begin(), aAttribs.begin() + aHint, matchName);
+		return i == aAttribs.begin() + aHint ? string_view() : i->value;
+	}
+
+	return i->value;
+}
+
+void FilelistReader::error(const char* aMessage, const char* aPos) const {
+	throw SimpleXMLException(Util::toString(bufOffset + (aPos - buf.data())) + ": " + aMessage);
+}
+
+void FilelistReader::parse(InputStream& aStream) {
+	buf.resize(BUF_SIZE);
+
+	for (;;) {
+		while (parseNext()) {
+			// Continue
+		}
+
+		if (!fill(aStream)) {
+			// Open elements or an incomplete tag?
+			if (elementCount > 0 || bufPos < bufEnd) {
+				error("Unexpected end of stream", buf.data() + bufPos);
+			}
+
+			return;
+		}
+	}
+}
+
+bool FilelistReader::fill(InputStream& aStream) {
+	// Keep the unparsed data
+	if (bufPos > 0) {
+		memmove(&buf[0], &buf[bufPos], bufEnd - bufPos);
+		bufOffset += bufPos;
+		bufEnd -= bufPos;
+		bufPos = 0;
+	}
+
+	if (bufEnd == buf.size()) {
+		// A single tag doesn't fit in the buffer
+		if (buf.size() >= MAX_BUF_SIZE) {
+			error("Buffer overflow", buf.data());
+		}
+
+		buf.resize(buf.size() * 2);
+	}
+
+	auto len = buf.size() - bufEnd;
+	aStream.read(&buf[bufEnd], len);
+	bufEnd += len;
+	return len > 0;
+}
+
+bool FilelistReader::parseNext() {
+	const char* pos = buf.data() + bufPos;
+	const char* end = buf.data() + bufEnd;
+
+	// Skip the content until the next tag
+	pos = static_cast<const char*>(memchr(pos, '<', end - pos));
+	if (!pos) {
+		bufPos = bufEnd;
+		return false;
+	}
+
+	bufPos = pos - buf.data();
+	if (end - pos < 2) {
+		return false;
+	}
+
+	const auto c = pos[1];
+	if (isNameStartChar(c)) {
+		return parseStartTag(pos, end);
+	} else if (c == '/') {
+		return parseEndTag(pos, end);
+	} else if (c == '?') {
+		return parseDeclaration(pos, end);
+	} else if (c == '!') {
+		if (startsWith(pos, end, "<!--")) {
+			return skipPast(pos + 4, end, "-->");
+		} else if (startsWith(pos, end, "<![CDATA[")) {
+			return skipPast(pos + 9, end, "]]>");
+		} else if (end - pos < 9) {
+			return false;
+		}
+	}
+
+	error("Expecting content, element or comment", pos);
+}
+
+bool FilelistReader::skipPast(const char* aPos, const char* aEnd, string_view aTerminator) {
+	auto i = search(aPos, aEnd, aTerminator.begin(), aTerminator.end());
+	if (i == aEnd) {
+		return false;
+	}
+
+	bufPos = (i + aTerminator.size()) - buf.data();
+	return true;
+}
+
+bool FilelistReader::parseDeclaration(const char* aPos, const char* aEnd) {
+	auto declEnd = search(aPos + 2, aEnd, "?>", "?>" + 2);
+	if (declEnd == aEnd) {
+		return false;
+	}
+
+	string_view decl(aPos + 2, declEnd - aPos - 2);
+	if (decl.compare(0, 4, "xml ") == 0) {
+		auto p = decl.find("encoding");
+		if (p != string_view::npos) {
+			auto valueStart = decl.find_first_of("\"'", p);
+			if (valueStart != string_view::npos) {
+				auto valueEnd = decl.find(decl[valueStart], valueStart + 1);
+				if (valueEnd != string_view::npos) {
+					encoding = Text::toLower(string(decl.substr(valueStart + 1, valueEnd - valueStart - 1)));
+				}
+			}
+		}
+	}
+
+	bufPos = (declEnd + 2) - buf.data();
+	return true;
+}
+
+bool FilelistReader::parseStartTag(const char* aPos, const char* aEnd) {
+	if (elementCount >= MAX_NESTING) {
+		error("Max nesting exceeded", aPos);
+	}
+
+	auto pos = aPos + 1;
+	const auto nameStart = pos;
+	while (pos < aEnd && isNameChar(*pos)) {
+		pos++;
+	}
+
+	if (pos == aEnd) {
+		return false;
+	}
+
+	if (static_cast<size_t>(pos - nameStart) > MAX_NAME_SIZE) {
+		error("Buffer overflow", pos);
+	}
+
+	if (!isSpace(*pos) && *pos != '/' && *pos != '>') {
+		error("Error while parsing element start", pos);
+	}
+
+	const string_view name(nameStart, pos - nameStart);
+
+	attribs.clear();
+	values.clear();
+	decodeBuf.clear();
+
+	bool simple = false;
+	for (;;) {
+		if (!skipSpace(pos, aEnd)) {
+			return false;
+		}
+
+		const auto c = *pos;
+		if (c == '>') {
+			pos++;
+			break;
+		} else if (c == '/') {
+			if (pos + 1 == aEnd) {
+				return false;
+			}
+
+			if (pos[1] != '>') {
+				error("Expecting >", pos + 1);
+			}
+
+			pos += 2;
+			simple = true;
+			break;
+		} else if (!isNameStartChar(c)) {
+			error("Expecting attribute | /> | >", pos);
+		}
+
+		// Attribute name
+		const auto attribStart = pos;
+		while (pos < aEnd && isNameChar(*pos)) {
+			pos++;
+		}
+
+		if (pos == aEnd) {
+			return false;
+		}
+
+		if (static_cast<size_t>(pos - attribStart) > MAX_NAME_SIZE) {
+			error("Buffer overflow", pos);
+		}
+
+		if (!isSpace(*pos) && *pos != '=') {
+			error("Expecting attribute name", pos);
+		}
+
+		attribs.push_back({ string_view(attribStart, pos - attribStart), string_view() });
+
+		// Value
+		if (!skipSpace(pos, aEnd)) {
+			return false;
+		}
+
+		if (*pos != '=') {
+			error("Expecting attribute =", pos);
+		}
+
+		pos++;
+		if (!skipSpace(pos, aEnd)) {
+			return false;
+		}
+
+		const auto quote = *pos;
+		if (quote != '"' && quote != '\'') {
+			error("Expecting attribute value start", pos);
+		}
+
+		pos++;
+		if (!parseValue(pos, aEnd, quote)) {
+			return false;
+		}
+	}
+
+	// Validate the values
+	const auto isUtf8 = encoding.empty() || encoding == Text::utf8;
+	for (auto& v: values) {
+		auto data = (v.decoded ? decodeBuf.data() : buf.data()) + v.offset;
+		if (!isUtf8) {
+			auto converted = Text::toUtf8(string(data, v.length), encoding);
+			v.offset = decodeBuf.size();
+			v.length = converted.size();
+			v.decoded = true;
+			decodeBuf += converted;
+		} else if (!isAscii(data, data + v.length) && !Text::validateUtf8(data, v.length)) {
+			error("Malformed UTF-8 data", pos);
+		}
+	}
+
+	// The decode buffer won't be modified after this
+	for (size_t i = 0; i < attribs.size(); ++i) {
+		const auto& v = values[i];
+		attribs[i].value = string_view((v.decoded ? decodeBuf.data() : buf.data()) + v.offset, v.length);
+	}
+
+	bufPos = pos - buf.data();
+
+	if (!simple) {
+		if (elements.size() == elementCount) {
+			elements.emplace_back();
+		}
+
+		elements[elementCount++].assign(name.data(), name.size());
+	}
+
+	cb->startTag(name, attribs, simple);
+	return true;
+}
+
+bool FilelistReader::parseValue(const char*& pos_, const char* aEnd, char aQuote) {
+	auto pos = pos_;
+	auto next = findAny(pos, aEnd, aQuote, '&');
+	if (next == aEnd) {
+		return false;
+	}
+
+	if (*next == aQuote) {
+		// Use the data from the read buffer
+		if (static_cast<size_t>(next - pos) > MAX_VALUE_SIZE) {
+			error("Buffer overflow", next);
+		}
+
+		values.push_back({ static_cast<size_t>(pos - buf.data()), static_cast<size_t>(next - pos), false });
+		pos_ = next + 1;
+		return true;
+	}
+
+	// Entity references need to be decoded
+	const auto offset = decodeBuf.size();
+	for (;;) {
+		decodeBuf.append(pos, next);
+		if (decodeBuf.size() - offset > MAX_VALUE_SIZE) {
+			error("Buffer overflow", next);
+		}
+
+		if (*next == aQuote) {
+			break;
+		}
+
+		auto len = parseEntity(next, aEnd, decodeBuf);
+		if (len == 0) {
+			return false;
+		}
+
+		pos = next + len;
+		next = findAny(pos, aEnd, aQuote, '&');
+		if (next == aEnd) {
+			return false;
+		}
+	}
+
+	values.push_back({ offset, decodeBuf.size() - offset, true });
+	pos_ = next + 1;
+	return true;
+}
+
+size_t FilelistReader::parseEntity(const char* aPos, const char* aEnd, string& decoded_) const {
+	if (aEnd - aPos < 8) {
+		return 0;
+	}
+
+	string_view ref(aPos + 1, 7);
+	if (ref.compare(0, 3, "lt;") == 0) {
+		decoded_ += '<';
+		return 4;
+	} else if (ref.compare(0, 3, "gt;") == 0) {
+		decoded_ += '>';
+		return 4;
+	} else if (ref.compare(0, 4, "amp;") == 0) {
+		decoded_ += '&';
+		return 5;
+	} else if (ref.compare(0, 5, "quot;") == 0) {
+		decoded_ += '"';
+		return 6;
+	} else if (ref.compare(0, 5, "apos;") == 0) {
+		decoded_ += '\'';
+		return 6;
+	} else if (ref[0] == '#') {
+		// Numeric references are ignored (1-5 decimal or 1-4 hex digits)
+		auto hex = ref[1] == 'x' || ref[1] == 'X';
+		auto digitStart = hex ? 2U : 1U;
+		auto maxDigits = hex ? 4U : 5U;
+		for (auto i = digitStart; i <= digitStart + maxDigits && i < ref.size(); ++i) {
+			auto c = static_cast<unsigned char>(ref[i]);
+			if (c == ';' && i > digitStart) {
+				return i + 2;
+			}
+
+			if (!(hex ? isxdigit(c) : isdigit(c))) {
+				break;
+			}
+		}
+	}
+
+	error("Expecting attribute value", aPos);
+}
+
+bool FilelistReader::parseEndTag(const char* aPos, const char* aEnd) {
+	auto pos = aPos + 2;
+	if (elementCount == 0) {
+		error("Expecting element end", pos);
+	}
+
+	if (!skipSpace(pos, aEnd)) {
+		return false;
+	}
+
+	const auto& top = elements[elementCount - 1];
+	if (static_cast<size_t>(aEnd - pos) < top.size()) {
+		return false;
+	}
+
+	if (top.compare(0, top.size(), pos, top.size()) != 0) {
+		error("Expecting element end", pos);
+	}
+
+	pos += top.size();
+	if (!skipSpace(pos, aEnd)) {
+		return false;
+	}
+
+	if (*pos != '>') {
+		error("Expecting >", pos);
+	}
+
+	bufPos = (pos + 1) - buf.data();
+	elementCount--;
+
+	cb->endTag(top);
+	return true;
+}
+
+} // namespace dcpp
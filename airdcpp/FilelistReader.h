@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_FILELISTREADER_H_
+#define DCPLUSPLUS_DCPP_FILELISTREADER_H_
+
+#include "typedefs.h"
+
+#include <string_view>
+
+#include <boost/noncopyable.hpp>
+
+namespace dcpp {
+
+class InputStream;
+
+/**
+ * Streaming parser for XML filelists
+ *
+ * Handles the XML subset used in filelists (elements with attributes and comments). Names and
+ * attribute values are passed as views to the read buffer, and values are copied only when they
+ * contain entity references. Text content and CDATA sections are skipped.
+ *
+ * The same validation rules and limits apply as with SimpleXMLReader.
+ */
+class FilelistReader : boost::noncopyable {
+public:
+	struct Attribute {
+		std::string_view name;
+		std::string_view value;
+	};
+
+	typedef vector<Attribute> AttributeList;
+
+	struct CallBack : private boost::noncopyable {
+		virtual ~CallBack() { }
+
+		// The views are valid only during the call
+		virtual void startTag(std::string_view aName, const AttributeList& aAttribs, bool aSimple) = 0;
+		virtual void endTag(std::string_view aName) = 0;
+	protected:
+		// Returns an empty value if the attribute doesn't exist
+		static std::string_view getAttrib(const AttributeList& aAttribs, std::string_view aName, size_t aHint) noexcept;
+	};
+
+	explicit FilelistReader(CallBack* aCallback);
+
+	// Throws SimpleXMLException
+	void parse(InputStream& aStream);
+private:
+	static const size_t BUF_SIZE = 256 * 1024;
+	static const size_t MAX_BUF_SIZE = 16 * 1024 * 1024;
+
+	static const size_t MAX_NAME_SIZE = 1024;
+	static const size_t MAX_VALUE_SIZE = 96 * 1024;
+	static const size_t MAX_NESTING = 32;
+
+	// Parse the next tag from the buffer
+	// Returns false if more data is needed
+	bool parseNext();
+	bool parseStartTag(const char* aPos, const char* aEnd);
+	bool parseEndTag(const char* aPos, const char* aEnd);
+	bool parseDeclaration(const char* aPos, const char* aEnd);
+	bool skipPast(const char* aPos, const char* aEnd, std::string_view aTerminator);
+
+	// Returns false if more data is needed
+	bool parseValue(const char*& pos_, const char* aEnd, char aQuote);
+
+	// Returns the length of the entity reference or 0 if more data is needed
+	size_t parseEntity(const char* aPos, const char* aEnd, string& decoded_) const;
+
+	// Returns false at the end of the stream
+	bool fill(InputStream& aStream);
+
+	[[noreturn]] void error(const char* aMessage, const char* aPos) const;
+
+	CallBack* const cb;
+
+	string buf;
+	size_t bufPos = 0;
+	size_t bufEnd = 0;
+
+	// Stream position of the buffer start
+	int64_t bufOffset = 0;
+
+	string encoding;
+
+	// Open elements (the strings are reused)
+	StringList elements;
+	size_t elementCount = 0;
+
+	// Attributes of the current tag
+	struct Value {
+		size_t offset;
+		size_t length;
+
+		// Stored in the decode buffer
+		bool decoded;
+	};
+
+	AttributeList attribs;
+	vector<Value> values;
+	string decodeBuf;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_FILELISTREADER_H_)
@@ -19,6 +19,7 @@
 #include "stdinc.h"
 #include "HashManager.h"
 
+#include "DeviceTaskPool.h"
 #include "File.h"
 #include "FileReader.h"
 #include "LogManager.h"
@@ -279,6 +280,17 @@ bool HashManager::addFile(const string& aPath, const HashedFile& fi_) {
 	store->addFile(Text::toLower(aPath), fi_);
 	return true;
 }
+shared_ptr<DeviceTaskPool> HashManager::getHashWorkers() noexcept {
+	auto threads = SETTING(HASH_WORKER_THREADS);
+
+	Lock l(hashWorkersCS);
+	if (!hashWorkers || hashWorkers->getMaxThreads() != threads) {
+		hashWorkers = make_shared<DeviceTaskPool>(threads, threads);
+	}
+
+	return hashWorkers;
+}
+
 void HashManager::stopHashing(const string& baseDir) noexcept {
 	WLock l(Hasher::hcs);
 	for (auto h: hashers)
@@ -33,6 +33,7 @@
 
 namespace dcpp {
 
+class DeviceTaskPool;
 class Hasher;
 class HashStore;
 class HashedFile;
@@ -143,6 +144,12 @@ private:
 	typedef vector<Hasher*> HasherList;
 	HasherList hashers;
 
+	// Worker threads for hashing large files in parallel, shared by all hashers (created when needed)
+	// The pool is replaced if the thread count setting is changed (hashers that are using the old pool will keep it alive)
+	shared_ptr<DeviceTaskPool> getHashWorkers() noexcept;
+	shared_ptr<DeviceTaskPool> hashWorkers;
+	CriticalSection hashWorkersCS;
+
 	unique_ptr<HashStore> store;
 
 	/** Single node tree where node = root, no storage in HashData.dat */
@@ -21,6 +21,7 @@
 #include "Hasher.h"
 
 #include "AirUtil.h"
+#include "DeviceTaskPool.h"
 #include "Exception.h"
 #include "File.h"
 #include "FileReader.h"
@@ -38,6 +39,90 @@ namespace dcpp {
 	SharedMutex Hasher::hcs;
 	const int64_t Hasher::MIN_BLOCK_SIZE = 64 * 1024;
 
+	const int64_t ParallelTreeHasher::MAX_PART_SIZE = 1024 * 1024;
+
+	ParallelTreeHasher::ParallelTreeHasher(TigerTree& aTree, const shared_ptr<DeviceTaskPool>& aWorkers, size_t aMaxPendingParts) noexcept :
+		tree(aTree), workers(aWorkers), partSize(min(aTree.getBlockSize(), MAX_PART_SIZE)), parts(aMaxPendingParts + 1) {
+
+		dcassert(aTree.getBlockSize() % partSize == 0);
+	}
+
+	ParallelTreeHasher::~ParallelTreeHasher() {
+		// Workers may still be accessing the part data
+		for (size_t i = 0; i < pendingCount; ++i) {
+			auto& part = parts[(firstPending + i) % parts.size()];
+			if (part.hashed.valid()) {
+				part.hashed.wait();
+			}
+		}
+	}
+
+	void ParallelTreeHasher::update(const void* aData, size_t aLen) {
+		auto data = reinterpret_cast<const uint8_t*>(aData);
+		while (aLen > 0) {
+			auto& part = parts[(firstPending + pendingCount) % parts.size()];
+			if (part.data.empty()) {
+				part.data.resize(static_cast<size_t>(partSize));
+			}
+
+			auto n = min(aLen, static_cast<size_t>(partSize) - part.size);
+			memcpy(&part.data[part.size], data, n);
+			part.size += n;
+			data += n;
+			aLen -= n;
+
+			if (part.size == static_cast<size_t>(partSize)) {
+				hashPart(part);
+				pendingCount++;
+
+				// Free the next part for reading
+				if (pendingCount == parts.size()) {
+					addOldestPart();
+				}
+			}
+		}
+	}
+
+	void ParallelTreeHasher::finish() {
+		auto& last = parts[(firstPending + pendingCount) % parts.size()];
+		if (last.size > 0) {
+			hashPart(last);
+			pendingCount++;
+		}
+
+		while (pendingCount > 0) {
+			addOldestPart();
+		}
+	}
+
+	void ParallelTreeHasher::hashPart(Part& aPart) noexcept {
+		auto hashed = make_shared<std::promise<void>>();
+		aPart.hashed = hashed->get_future();
+
+		workers->addTask(0, [&aPart, hashed, this] {
+			try {
+				TigerTree partTree(partSize);
+				partTree.update(&aPart.data[0], aPart.size);
+				partTree.finalize();
+
+				aPart.hash = partTree.getRoot();
+				hashed->set_value();
+			} catch (...) {
+				hashed->set_exception(std::current_exception());
+			}
+		});
+	}
+
+	void ParallelTreeHasher::addOldestPart() {
+		auto& part = parts[firstPending];
+		firstPending = (firstPending + 1) % parts.size();
+		pendingCount--;
+
+		part.hashed.get();
+		tree.update(part.hash, static_cast<int64_t>(part.size));
+		part.size = 0;
+	}
+
 
 	bool Hasher::pause() noexcept {
 		paused = true;
@@ -242,13 +327,19 @@ namespace dcpp {
 
 					TigerTree tt(bs);
 
+					// Hashing is the bottleneck with fast disks, use the reader thread only for reading large files
+					unique_ptr<ParallelTreeHasher> parallelHasher;
+					if (SETTING(HASH_WORKER_THREADS) > 1 && size >= ParallelTreeHasher::MAX_PART_SIZE * 4) {
+						parallelHasher = make_unique<ParallelTreeHasher>(tt, HashManager::getInstance()->getHashWorkers(), SETTING(HASH_WORKER_THREADS) * 2);
+					}
+
 					CRC32Filter crc32;
 
 					auto fileCRC = sfv.hasFile(Text::toLower(Util::getFileName(fname)));
 
 					uint64_t lastRead = GET_TICK();
 
-					FileReader fr(FileReader::ASYNC);
+					FileReader fr(FileReader::URING);
 					fr.read(fname, [&](const void* buf, size_t n) -> bool {
 						if (SETTING(MAX_HASH_SPEED) > 0) {
 							uint64_t now = GET_TICK();
@@ -262,7 +353,11 @@ namespace dcpp {
 							lastRead = GET_TICK();
 						}
 
-						tt.update(buf, n);
+						if (parallelHasher) {
+							parallelHasher->update(buf, n);
+						} else {
+							tt.update(buf, n);
+						}
 
 						if (fileCRC) {
 							crc32(buf, n);
@@ -279,6 +374,10 @@ namespace dcpp {
 						return !stopping;
 					});
 
+					if (parallelHasher) {
+						parallelHasher->finish();
+					}
+
 					tt.finalize();
 
 					failed = (fileCRC && crc32.getValue() != *fileCRC) || stopping;
@@ -22,15 +22,59 @@
 #include "typedefs.h"
 
 #include "CriticalSection.h"
+#include "MerkleTree.h"
 #include "Semaphore.h"
 #include "SFVReader.h"
 #include "SortedVector.h"
 #include "Thread.h"
 #include "Util.h"
 
+#include <future>
+
 namespace dcpp {
+	class DeviceTaskPool;
+
 	typedef int64_t devid;
 
+	// Calculates the tree of a file in parallel
+	// The data is split into parts that are hashed by the worker threads while the file is being read and the part hashes
+	// are added in the tree in order (leaves won't depend on each other so the tree is identical to a sequentially hashed one)
+	class ParallelTreeHasher : boost::noncopyable {
+	public:
+		// The actual part size is limited by the block size of the tree
+		static const int64_t MAX_PART_SIZE;
+
+		ParallelTreeHasher(TigerTree& aTree, const shared_ptr<DeviceTaskPool>& aWorkers, size_t aMaxPendingParts) noexcept;
+
+		// Waits for the pending parts
+		~ParallelTreeHasher();
+
+		void update(const void* aData, size_t aLen);
+
+		// Adds the remaining parts in the tree (the tree must still be finalized by the caller)
+		void finish();
+	private:
+		struct Part {
+			ByteVector data;
+			size_t size = 0;
+
+			TTHValue hash;
+			std::future<void> hashed;
+		};
+
+		void hashPart(Part& aPart) noexcept;
+		void addOldestPart();
+
+		TigerTree& tree;
+		const shared_ptr<DeviceTaskPool> workers;
+		const int64_t partSize;
+
+		// Ring of parts (the part after the pending ones is being filled)
+		vector<Part> parts;
+		size_t firstPending = 0;
+		size_t pendingCount = 0;
+	};
+
 	class Hasher : public Thread {
 	public:
 		/** We don't keep leaves for blocks smaller than this... */
@@ -29,7 +29,7 @@ const string HubSettings::boolNames[BoolCount] = {
 	"ShowJoins", "FavShowJoins", "LogMainChat", "ShowChatNotify"
 };
 const string HubSettings::intNames[IntCount] = {
-	"MinSearchInterval", "IncomingConnections", "IncomingConnections6", "ShareProfile"
+	"MinSearchInterval", "IncomingConnections", "IncomingConnections6", "ShareProfile", "UploadLimit", "DownloadLimit"
 };
 
 HubSettings::HubSettings() {
@@ -68,6 +68,8 @@ struct HubSettings
 		Connection,
 		Connection6,
 		ShareProfile,
+		UploadLimit,
+		DownloadLimit,
 		// don't forget to edit intNames in HubSettings.cpp when adding a def here!
 
 		HubIntLast
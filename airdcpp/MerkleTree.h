@@ -121,6 +121,24 @@ public:
 		fileSize += len;
 	}
 
+	/**
+	 * Update the merkle tree with a hash that has been calculated separately for the next part of the data
+	 * (the root of a tree with the same base block size that was updated with that part only).
+	 * @param aHash Root hash of the part
+	 * @param len Length of the part, must be a power of two multiple of baseBlockSize and
+	 *            not larger than the block size, unless it's the last part.
+	 */
+	void update(const MerkleValue& aHash, int64_t len) {
+		if(len == blockSize) {
+			dcassert(blocks.empty());
+			leaves.push_back(aHash);
+		} else {
+			blocks.emplace_back(aHash, len);
+			reduceBlocks();
+		}
+		fileSize += len;
+	}
+
 	uint8_t* finalize() {
 		// No updates yet, make sure we have at least one leaf for 0-length files...
 		if(leaves.empty() && blocks.empty()) {
@@ -175,10 +175,17 @@ private:
 	UserPtr user;
 	uint32_t sid;
 
-	typedef map<short, string> InfMap;
+	// Field code -> value, sorted by the code (there are only a few dozen fields)
+	typedef vector<pair<short, string>> InfMap;
 	InfMap info;
 
-	static SharedMutex cs;
+	// The identities share a fixed set of locks (picked by the object address)
+	// so that updating the fields of different users won't contend with each other
+	static const size_t LOCK_STRIPES = 64;
+	static SharedMutex cs[LOCK_STRIPES];
+	SharedMutex& getLock() const noexcept;
+
+	InfMap::const_iterator findField(short aCode) const noexcept;
 };
 
 class OnlineUser :  public FastAlloc<OnlineUser>, public intrusive_ptr_base<OnlineUser>, private boost::noncopyable {
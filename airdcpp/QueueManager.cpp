@@ -40,6 +40,7 @@
 #include "SFVReader.h"
 #include "ShareManager.h"
 #include "SimpleXMLReader.h"
+#include "ThrottleManager.h"
 #include "Transfer.h"
 #include "UploadManager.h"
 #include "UserConnection.h"
@@ -2162,6 +2163,13 @@ void QueueManager::setBundlePriority(const BundlePtr& aBundle, Priority p, bool
 		connectBundleSources(aBundle);
 	}
 
+	// running downloads of the bundle may use a different priority limit now
+	auto tm = ThrottleManager::getInstance();
+	if (tm->getClassLimit(ThrottleManager::CLASS_PRIORITY, ThrottleManager::getPriorityKey(oldPrio), false) > 0 ||
+		tm->getClassLimit(ThrottleManager::CLASS_PRIORITY, ThrottleManager::getPriorityKey(p), false) > 0) {
+		ConnectionManager::getInstance()->updateLimiters();
+	}
+
 	dcassert(!aBundle->isFileBundle() || aBundle->getPriority() == aBundle->getQueueItems().front()->getPriority());
 }
 
@@ -53,18 +53,40 @@ void SSLSocket::connect(const AddressInfo& aAddr, const string& aPort, const str
 	Socket::connect(aAddr, aPort, aLocalPort);
 }
 
+void SSLSocket::initSSL() {
+	ssl.reset(SSL_new(ctx));
+	if(!ssl)
+		checkSSL(-1);
+
+	if(!verifyData) {
+		SSL_set_verify(ssl, SSL_VERIFY_NONE, NULL);
+	} else SSL_set_ex_data(ssl, CryptoManager::idxVerifyData, verifyData.get());
+
+#ifdef SSL_OP_ENABLE_KTLS
+	if(kernelTlsRequested) {
+		// Falls back to userspace encryption if the kernel or the negotiated cipher isn't supported
+		SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+	}
+#endif
+}
+
+void SSLSocket::onHandshakeCompleted() noexcept {
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+	if(kernelTlsRequested) {
+		kernelTlsSend = BIO_get_ktls_send(SSL_get_wbio(ssl));
+		kernelTlsRecv = BIO_get_ktls_recv(SSL_get_rbio(ssl));
+		dcdebug("Kernel TLS: send %s, receive %s\n", kernelTlsSend ? "enabled" : "disabled", kernelTlsRecv ? "enabled" : "disabled");
+	}
+#endif
+}
+
 bool SSLSocket::waitConnected(uint64_t millis) {
 	if(!ssl) {
 		if(!Socket::waitConnected(millis)) {
 			return false;
 		}
-		ssl.reset(SSL_new(ctx));
-		if(!ssl)
-			checkSSL(-1);
 
-		if(!verifyData) {
-			SSL_set_verify(ssl, SSL_VERIFY_NONE, NULL);
-		} else SSL_set_ex_data(ssl, CryptoManager::idxVerifyData, verifyData.get());
+		initSSL();
 
 		if (!hostname.empty()) {
 			// https://github.com/openssl/openssl/issues/7147#issuecomment-419621673
@@ -82,6 +104,7 @@ bool SSLSocket::waitConnected(uint64_t millis) {
 		int ret = SSL_is_server(ssl) ? SSL_accept(ssl) : SSL_connect(ssl);
 		if(ret == 1) {
 			dcdebug("Connected to SSL server using %s as %s\n", SSL_get_cipher(ssl), SSL_is_server(ssl) ? "server" : "client");
+			onHandshakeCompleted();
 			return true;
 		}
 		if(!waitWant(ret, millis)) {
@@ -95,14 +118,8 @@ bool SSLSocket::waitAccepted(uint64_t millis) {
 		if(!Socket::waitAccepted(millis)) {
 			return false;
 		}
-		ssl.reset(SSL_new(ctx));
-		if(!ssl)
-			checkSSL(-1);
-
-		if(!verifyData) {
-			SSL_set_verify(ssl, SSL_VERIFY_NONE, NULL);
-		} else SSL_set_ex_data(ssl, CryptoManager::idxVerifyData, verifyData.get());
 
+		initSSL();
 		checkSSL(SSL_set_fd(ssl, static_cast<int>(getSock())));
 	}
 
@@ -114,6 +131,7 @@ bool SSLSocket::waitAccepted(uint64_t millis) {
 		int ret = SSL_accept(ssl);
 		if(ret == 1) {
 			dcdebug("Connected to SSL client using %s\n", SSL_get_cipher(ssl));
+			onHandshakeCompleted();
 			return true;
 		}
 		if(!waitWant(ret, millis)) {
@@ -257,7 +275,7 @@ std::string SSLSocket::getEncryptionInfo() const noexcept {
 
 	string cipher = SSL_get_cipher_name(ssl);
 	string protocol = SSL_get_version(ssl);
-	return protocol + " / " + cipher;
+	return protocol + " / " + cipher + (isKernelTls() ? " / kTLS" : "");
 }
 
 ByteVector SSLSocket::getKeyprint() const noexcept {
@@ -57,6 +57,13 @@ public:
 	virtual void close() noexcept override;
 
 	virtual bool isSecure() const noexcept override { return true; }
+
+	// Records are encrypted by the kernel so file data can be sent as it is
+	virtual bool isSendFileSupported() const noexcept override { return kernelTlsSend; }
+	virtual bool isKernelTls() const noexcept override { return kernelTlsSend || kernelTlsRecv; }
+
+	/** Let OpenSSL enable kernel TLS after the handshake if the kernel and cipher support it (must be called before connecting) */
+	void requestKernelTls() noexcept { kernelTlsRequested = true; }
 	virtual bool isTrusted() const noexcept override;
 	virtual bool isKeyprintMatch() const noexcept override;
 	virtual string getEncryptionInfo() const noexcept override;
@@ -78,6 +85,13 @@ private:
 	int checkSSL(int ret);
 	bool waitWant(int ret, uint64_t millis);
 	string hostname;
+
+	void initSSL();
+	void onHandshakeCompleted() noexcept;
+
+	bool kernelTlsRequested = false;
+	bool kernelTlsSend = false;
+	bool kernelTlsRecv = false;
 };
 
 } // namespace dcpp
@@ -31,6 +31,7 @@
 #include "ShareManager.h"
 #include "SimpleXML.h"
 #include "StringTokenizer.h"
+#include "Text.h"
 #include "TimerManager.h"
 
 #include <openssl/evp.h>
@@ -606,7 +607,119 @@ void SearchManager::onPSR(const AdcCommand& aCmd, UserPtr from, const string& aR
 
 }
 
+// Incoming searches that haven't been handled yet
+#define MAX_QUEUED_SEARCHES 200
+
+// Searches older than this won't be answered (ms)
+#define MAX_SEARCH_QUEUE_TIME 10000
+
+#define MAX_CACHED_RESULTS 500
+
+// How long the results of a search can be reused (ms)
+#define RESULT_CACHE_TIME 10000
+
+SearchResponsePool& SearchManager::getResponsePool() noexcept {
+	// The thread count can't be read before the settings have been loaded
+	std::call_once(responsePoolCreated, [this] {
+		responsePool = make_unique<SearchResponsePool>(SETTING(SEARCH_RESPONSE_THREADS), MAX_QUEUED_SEARCHES, MAX_SEARCH_QUEUE_TIME);
+	});
+
+	return *responsePool;
+}
+
+void SearchManager::shutdown() noexcept {
+	getResponsePool().stop();
+}
+
 void SearchManager::respond(const AdcCommand& adc, OnlineUser& aUser, bool isUdpActive, const string& hubIpPort, ProfileToken aProfile) {
+	auto priority = SearchResponsePool::PRIORITY_NORMAL;
+	if (adc.getType() == AdcCommand::TYPE_DIRECT) {
+		priority = SearchResponsePool::PRIORITY_HIGH;
+	} else {
+		string token;
+		if (adc.getParam("TO", 0, token) && token.find("/as") != string::npos) {
+			priority = SearchResponsePool::PRIORITY_LOW;
+		}
+	}
+
+	OnlineUserPtr user(&aUser);
+	auto added = getResponsePool().addTask(priority, [=] {
+		handleSearch(adc, *user, isUdpActive, hubIpPort, aProfile);
+	});
+
+	if (!added && DEBUG_SEARCH) {
+		dbgMsg("ADC respond: too many queued searches, search from " + aUser.getIdentity().getNick() + " was dropped", LogMessage::SEV_WARNING);
+	}
+}
+
+string SearchManager::getResultCacheKey(const AdcCommand& aCmd, ProfileToken aProfile, const string& aPath, int aMaxResults) noexcept {
+	// Include only the parameters that affect the results, in a fixed order
+	StringList params;
+	for (const auto& p: aCmd.getParameters()) {
+		if (p.size() < 2) {
+			continue;
+		}
+
+		auto code = AdcCommand::toCode(p.c_str());
+		if (code == AdcCommand::toCode("AN") || code == AdcCommand::toCode("NO") || code == AdcCommand::toCode("EX")) {
+			// matching is case-insensitive
+			params.push_back(Text::toLower(p));
+		} else if (code == AdcCommand::toCode("GR") || code == AdcCommand::toCode("RX") || code == AdcCommand::toCode("GE") ||
+			code == AdcCommand::toCode("LE") || code == AdcCommand::toCode("EQ") || code == AdcCommand::toCode("TY") ||
+			code == AdcCommand::toCode("MT") || code == AdcCommand::toCode("OT") || code == AdcCommand::toCode("NT") ||
+			code == AdcCommand::toCode("PP")) {
+			params.push_back(p);
+		}
+	}
+
+	sort(params.begin(), params.end());
+
+	auto key = Util::toString(aProfile) + '\n' + Util::toString(aMaxResults) + '\n' + aPath;
+	for (const auto& p: params) {
+		key += '\n';
+		key += p;
+	}
+
+	return key;
+}
+
+bool SearchManager::getCachedResults(const string& aKey, SearchResultList& results_) noexcept {
+	Lock l(resultCacheCs);
+	auto i = resultCacheIndex.find(aKey);
+	if (i == resultCacheIndex.end()) {
+		return false;
+	}
+
+	auto cached = i->second;
+	if (cached->expires < GET_TICK()) {
+		resultCache.erase(cached);
+		resultCacheIndex.erase(i);
+		return false;
+	}
+
+	resultCache.splice(resultCache.begin(), resultCache, cached);
+	results_ = cached->results;
+	return true;
+}
+
+void SearchManager::addCachedResults(const string& aKey, const SearchResultList& aResults) noexcept {
+	Lock l(resultCacheCs);
+	auto i = resultCacheIndex.find(aKey);
+	if (i != resultCacheIndex.end()) {
+		resultCache.erase(i->second);
+		resultCacheIndex.erase(i);
+	}
+
+	resultCache.push_front({ aKey, aResults, GET_TICK() + RESULT_CACHE_TIME });
+	resultCacheIndex.emplace(aKey, resultCache.begin());
+
+	if (resultCache.size() > MAX_CACHED_RESULTS) {
+		resultCacheIndex.erase(resultCache.back().key);
+		resultCache.pop_back();
+	}
+}
+
+void SearchManager::handleSearch(const AdcCommand& adc, OnlineUser& aUser, bool isUdpActive, const string& hubIpPort, ProfileToken aProfile) {
 	auto isDirect = adc.getType() == 'D';
 	string path = ADC_ROOT_STR, key;
 	int maxResults = isUdpActive ? 10 : 5;
@@ -627,8 +740,16 @@ void SearchManager::respond(const AdcCommand& adc, OnlineUser& aUser, bool isUdp
 	string token;
 	adc.getParam("TO", 0, token);
 
+	// TTH searches are cheap and their results may depend on the user (temp shares)
+	auto cacheKey = srch.root ? Util::emptyString : getResultCacheKey(adc, aProfile, path, maxResults);
+
 	try {
-		ShareManager::getInstance()->adcSearch(results, srch, aProfile, aUser.getUser()->getCID(), path, token.find("/as") != string::npos);
+		if (cacheKey.empty() || !getCachedResults(cacheKey, results)) {
+			ShareManager::getInstance()->adcSearch(results, srch, aProfile, aUser.getUser()->getCID(), path, token.find("/as") != string::npos);
+			if (!cacheKey.empty()) {
+				addCachedResults(cacheKey, results);
+			}
+		}
 	} catch(const ShareException& e) {
 		if (replyDirect) {
 			//path not found (direct search)
@@ -674,12 +795,19 @@ void SearchManager::respond(const AdcCommand& adc, OnlineUser& aUser, bool isUdp
 	}
 
 
-	adc.getParam("KY", 0, key);
-	for(const auto& sr: results) {
-		AdcCommand cmd = sr->toRES(AdcCommand::TYPE_UDP);
-		if(!token.empty())
-			cmd.addParam("TO", token);
-		ClientManager::getInstance()->sendUDP(cmd, aUser.getUser()->getCID(), false, false, key, aUser.getHubUrl());
+	if (!results.empty()) {
+		adc.getParam("KY", 0, key);
+
+		vector<AdcCommand> commands;
+		commands.reserve(results.size());
+		for(const auto& sr: results) {
+			AdcCommand cmd = sr->toRES(AdcCommand::TYPE_UDP);
+			if(!token.empty())
+				cmd.addParam("TO", token);
+			commands.push_back(move(cmd));
+		}
+
+		ClientManager::getInstance()->sendUDP(commands, aUser.getUser()->getCID(), false, false, key, aUser.getHubUrl());
 	}
 
 end:
@@ -29,6 +29,7 @@
 #include "GetSet.h"
 #include "Message.h"
 #include "Search.h"
+#include "SearchResponsePool.h"
 #include "Singleton.h"
 #include "Speaker.h"
 #include "UDPServer.h"
@@ -79,8 +80,12 @@ public:
 	SearchQueueInfo search(const SearchPtr& aSearch) noexcept;
 	SearchQueueInfo search(StringList& aHubUrls, const SearchPtr& aSearch, void* aOwner = nullptr) noexcept;
 	
+	// Queues the search to be answered by the response pool
 	void respond(const AdcCommand& cmd, OnlineUser& aUser, bool isUdpActive, const string& hubIpPort, ProfileToken aProfile);
 
+	// Stops answering incoming searches
+	void shutdown() noexcept;
+
 	const string& getPort() const;
 
 	void listen();
@@ -128,6 +133,30 @@ private:
 
 	~SearchManager();
 
+	void handleSearch(const AdcCommand& cmd, OnlineUser& aUser, bool isUdpActive, const string& hubIpPort, ProfileToken aProfile);
+
+	SearchResponsePool& getResponsePool() noexcept;
+	unique_ptr<SearchResponsePool> responsePool;
+	std::once_flag responsePoolCreated;
+
+	// Recent results of non-TTH searches (the same searches are often received from multiple hubs)
+	struct CachedResults {
+		string key;
+		SearchResultList results;
+		uint64_t expires;
+	};
+
+	typedef list<CachedResults> ResultCacheList;
+
+	// Most recently used first
+	ResultCacheList resultCache;
+	unordered_map<string, ResultCacheList::iterator> resultCacheIndex;
+	CriticalSection resultCacheCs;
+
+	static string getResultCacheKey(const AdcCommand& aCmd, ProfileToken aProfile, const string& aPath, int aMaxResults) noexcept;
+	bool getCachedResults(const string& aKey, SearchResultList& results_) noexcept;
+	void addCachedResults(const string& aKey, const SearchResultList& aResults) noexcept;
+
 	string getPartsString(const PartsInfo& partsInfo) const;
 	
 	void on(TimerManagerListener::Minute, uint64_t aTick) noexcept;
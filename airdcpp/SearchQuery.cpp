@@ -114,6 +114,20 @@ double SearchQuery::getRelevanceScore(const SearchQuery& aSearch, int aLevel, bo
 	return scores;
 }
 
+double SearchQuery::getMaxRelevanceScore(const SearchQuery& aSearch, int aLevel) noexcept {
+	double levelScores = aLevel > 0 ? 9 / static_cast<double>(aLevel) : 10;
+	if (aSearch.include.count() == 0) {
+		return levelScores / 10;
+	}
+
+	// Assume sorted matches with maximum points (and no recursion) from each category in getRelevanceScore,
+	// each pattern may get at most 40 points from toPointList
+	auto includeCount = static_cast<double>(aSearch.include.count());
+	double scores = levelScores + 120 + (includeCount * 40.0) + 30 + 30 + 5;
+	double maxPoints = 10 + 120 + (includeCount * 20.0) + 20.0 + 30 + 30 + 5;
+	return scores / maxPoints;
+}
+
 SearchQuery::ResultPointsList SearchQuery::toPointList(const string& aName) const noexcept {
 	ResultPointsList ret(lastIncludePositions.size());
 	for (size_t j = 0; j < lastIncludePositions.size(); ++j) {
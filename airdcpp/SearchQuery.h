@@ -49,6 +49,9 @@ namespace dcpp {
 		// Gets a score (0-1) based on how well the current item matches the provided search (which must have been fully matched first)
 		static double getRelevanceScore(const SearchQuery& aSearch, int aLevel, bool aIsDirectory, const string& aName) noexcept;
 
+		// Gets the highest relevance score that any item on the same or deeper level could get with the provided search
+		static double getMaxRelevanceScore(const SearchQuery& aSearch, int aLevel) noexcept;
+
 		// Count points per pattern based on the matching positions (based on the surrounding separators)
 		ResultPointsList toPointList(const string& aName) const noexcept;
 
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "SearchResponsePool.h"
+
+#include "TimerManager.h"
+#include "debug.h"
+
+namespace dcpp {
+
+SearchResponsePool::SearchResponsePool(int aMaxThreads, size_t aMaxQueued, uint64_t aMaxQueueTime) noexcept :
+	maxThreads(max(aMaxThreads, 1)), maxQueued(max(aMaxQueued, static_cast<size_t>(1))), maxQueueTime(aMaxQueueTime) {
+
+}
+
+SearchResponsePool::~SearchResponsePool() {
+	stop();
+}
+
+void SearchResponsePool::stop() noexcept {
+	{
+		std::lock_guard<std::mutex> l(cs);
+		stopping = true;
+		for (auto& q : tasks) {
+			q.clear();
+		}
+
+		queued = 0;
+	}
+
+	taskAvailable.notify_all();
+	for (auto& t : threads) {
+		if (t.joinable()) {
+			t.join();
+		}
+	}
+}
+
+size_t SearchResponsePool::getQueueSize() noexcept {
+	std::lock_guard<std::mutex> l(cs);
+	return queued;
+}
+
+bool SearchResponsePool::dropTask(TaskPriority aPriority) noexcept {
+	for (int prio = PRIORITY_LOW; prio < aPriority; prio++) {
+		auto& q = tasks[prio];
+		if (!q.empty()) {
+			q.pop_front();
+			queued--;
+			droppedTasks++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool SearchResponsePool::addTask(TaskPriority aPriority, Task&& aTask) noexcept {
+	{
+		std::lock_guard<std::mutex> l(cs);
+		if (stopping) {
+			return false;
+		}
+
+		if (queued >= maxQueued && !dropTask(aPriority)) {
+			droppedTasks++;
+			return false;
+		}
+
+		tasks[aPriority].push_back({ GET_TICK(), move(aTask) });
+		queued++;
+
+		// Threads are created only when there's something to run
+		if (idleThreads == 0 && static_cast<int>(threads.size()) < maxThreads) {
+			threads.emplace_back([this] { run(); });
+			return true;
+		}
+	}
+
+	taskAvailable.notify_one();
+	return true;
+}
+
+void SearchResponsePool::run() noexcept {
+	std::unique_lock<std::mutex> l(cs);
+	for (;;) {
+		if (stopping) {
+			return;
+		}
+
+		if (queued == 0) {
+			idleThreads++;
+			taskAvailable.wait(l);
+			idleThreads--;
+			continue;
+		}
+
+		// Highest priority first
+		auto prio = static_cast<int>(PRIORITY_LAST) - 1;
+		while (tasks[prio].empty()) {
+			prio--;
+		}
+
+		auto next = move(tasks[prio].front());
+		tasks[prio].pop_front();
+		queued--;
+
+		if (next.added + maxQueueTime < GET_TICK()) {
+			droppedTasks++;
+			continue;
+		}
+
+		l.unlock();
+		try {
+			next.task();
+		} catch (...) {
+			dcassert(0);
+		}
+
+		l.lock();
+	}
+}
+
+} // namespace dcpp
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_SEARCH_RESPONSE_POOL_H
+#define DCPLUSPLUS_DCPP_SEARCH_RESPONSE_POOL_H
+
+#include "typedefs.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace dcpp {
+
+/* Worker pool for answering incoming searches so that search floods won't block the hub connections
+   Tasks are run in priority order. The queue is bounded: when it's full, the oldest tasks with the lowest
+   priority are dropped first. Tasks that have been queued for too long are dropped as well (the searcher
+   isn't likely to be waiting for the results anymore). */
+
+class SearchResponsePool : boost::noncopyable {
+public:
+	typedef std::function<void()> Task;
+
+	enum TaskPriority {
+		PRIORITY_LOW, // automatic searches
+		PRIORITY_NORMAL,
+		PRIORITY_HIGH, // direct searches
+		PRIORITY_LAST
+	};
+
+	SearchResponsePool(int aMaxThreads, size_t aMaxQueued, uint64_t aMaxQueueTime) noexcept;
+
+	// Waits for the running tasks to complete, tasks that haven't been started are discarded
+	~SearchResponsePool();
+
+	// Returns false if the task was dropped
+	bool addTask(TaskPriority aPriority, Task&& aTask) noexcept;
+
+	// Discards the queued tasks and waits for the running ones to complete
+	// New tasks won't be accepted after this
+	void stop() noexcept;
+
+	int getMaxThreads() const noexcept { return maxThreads; }
+	size_t getQueueSize() noexcept;
+	uint64_t getDroppedTasks() const noexcept { return droppedTasks; }
+private:
+	struct QueuedTask {
+		uint64_t added;
+		Task task;
+	};
+
+	void run() noexcept;
+
+	// Drops the oldest task with lower priority than aPriority to make room for a new one (the lock must be held)
+	bool dropTask(TaskPriority aPriority) noexcept;
+
+	const int maxThreads;
+	const size_t maxQueued;
+	const uint64_t maxQueueTime;
+
+	std::mutex cs;
+	std::condition_variable taskAvailable;
+
+	deque<QueuedTask> tasks[PRIORITY_LAST];
+	size_t queued = 0;
+	atomic<uint64_t> droppedTasks { 0 };
+
+	vector<std::thread> threads;
+	int idleThreads = 0;
+	bool stopping = false;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_SEARCH_RESPONSE_POOL_H)
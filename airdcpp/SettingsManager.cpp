@@ -240,7 +240,8 @@ const string SettingsManager::settingTags[] =
 
 	"FullListDLLimit", "LastListProfile", "MaxHashingThreads", "HashersPerVolume", "SubtractlistSkip", "BloomMode", "AwayIdleTime",
 	"SearchHistoryMax", "ExcludeHistoryMax", "DirectoryHistoryMax", "MinDupeCheckSize", "DbCacheSize", "DLAutoDisconnectMode", 
-	"RemovedTrees", "RemovedFiles", "MultithreadedRefresh",
+	"RemovedTrees", "RemovedFiles", "MultithreadedRefresh", "RefreshScanThreads", "RefreshScanThreadsPerVolume", "HashWorkerThreads", "SocketReactorThreads", "SearchResponseThreads", "UdpReceiveSockets", "UdpWorkerThreads",
+	"MaxDownloadSpeedLowest", "MaxDownloadSpeedLow", "MaxDownloadSpeedNormal", "MaxDownloadSpeedHigh", "MaxDownloadSpeedHighest",
 	"MaxRunningBundles", "DefaultShareProfile", "UpdateChannel",
 
 	"AutoSearchEvery", "ASDelayHours",
@@ -324,6 +325,7 @@ const string SettingsManager::settingTags[] =
 	"FLReportDupeFiles", "UseUploadBundles", "LogIgnored", "RemoveFinishedBundles", "AlwaysCCPM",
 
 	"PopupBotPms", "PopupHubPms", "SortFavUsersFirst",
+	"ShareSearchIndex", "ConcurrentShareSearch", "ShareMonitoring", "KernelTls",
 #ifdef HAVE_GUI
 	// Windows GUI
 	"BoldFinishedDownloads", "BoldFinishedUploads", "BoldHub", "BoldPm",
@@ -599,6 +601,17 @@ SettingsManager::SettingsManager() : connectionRegex("(\\d+(\\.\\d+)?)")
 	setDefault(MAX_HASHING_THREADS, std::thread::hardware_concurrency());
 
 	setDefault(HASHERS_PER_VOLUME, 1);
+	setDefault(HASH_WORKER_THREADS, std::thread::hardware_concurrency());
+	setDefault(SOCKET_REACTOR_THREADS, 2);
+	setDefault(SEARCH_RESPONSE_THREADS, 2);
+	setDefault(UDP_RECEIVE_SOCKETS, 1);
+	setDefault(UDP_WORKER_THREADS, 2);
+
+	setDefault(MAX_DOWNLOAD_SPEED_LOWEST, 0);
+	setDefault(MAX_DOWNLOAD_SPEED_LOW, 0);
+	setDefault(MAX_DOWNLOAD_SPEED_NORMAL, 0);
+	setDefault(MAX_DOWNLOAD_SPEED_HIGH, 0);
+	setDefault(MAX_DOWNLOAD_SPEED_HIGHEST, 0);
 
 	setDefault(MIN_DUPE_CHECK_SIZE, 512);
 	setDefault(SKIP_EMPTY_DIRS_SHARE, true);
@@ -609,6 +622,8 @@ SettingsManager::SettingsManager() : connectionRegex("(\\d+(\\.\\d+)?)")
 
 	setDefault(DL_AUTO_DISCONNECT_MODE, QUEUE_FILE);
 	setDefault(REFRESH_THREADING, MULTITHREAD_MANUAL);
+	setDefault(REFRESH_SCAN_THREADS, 8);
+	setDefault(REFRESH_SCAN_THREADS_PER_VOLUME, 4);
 
 	setDefault(REMOVE_EXPIRED_AS, false);
 
@@ -644,6 +659,10 @@ SettingsManager::SettingsManager() : connectionRegex("(\\d+(\\.\\d+)?)")
 	setDefault(POPUP_HUB_PMS, true);
 	setDefault(POPUP_BOT_PMS, true);
 	setDefault(SORT_FAVUSERS_FIRST, false);
+	setDefault(SHARE_SEARCH_INDEX, false);
+	setDefault(CONCURRENT_SHARE_SEARCH, false);
+	setDefault(SHARE_MONITORING, false);
+	setDefault(KERNEL_TLS, false);
 
 #ifdef _WIN32
 	setDefault(NMDC_ENCODING, Text::systemCharset);
@@ -1356,6 +1375,10 @@ HubSettings SettingsManager::getHubSettings() const noexcept {
 	ret.get(HubSettings::AwayMsg) = get(DEFAULT_AWAY_MESSAGE);
 	ret.get(HubSettings::NmdcEncoding) = get(NMDC_ENCODING);
 	ret.get(HubSettings::ShareProfile) = get(DEFAULT_SP);
+
+	// hub specific speed limits are only set for favorite hubs
+	ret.get(HubSettings::UploadLimit) = 0;
+	ret.get(HubSettings::DownloadLimit) = 0;
 	return ret;
 }
 
@@ -135,7 +135,8 @@ public:
 
 		FULL_LIST_DL_LIMIT, LAST_LIST_PROFILE, MAX_HASHING_THREADS, HASHERS_PER_VOLUME, SKIP_SUBTRACT, BLOOM_MODE, AWAY_IDLE_TIME,
 		HISTORY_SEARCH_MAX, HISTORY_DIR_MAX, HISTORY_EXCLUDE_MAX, MIN_DUPE_CHECK_SIZE, DB_CACHE_SIZE, DL_AUTO_DISCONNECT_MODE, 
-		CUR_REMOVED_TREES, CUR_REMOVED_FILES, REFRESH_THREADING,
+		CUR_REMOVED_TREES, CUR_REMOVED_FILES, REFRESH_THREADING, REFRESH_SCAN_THREADS, REFRESH_SCAN_THREADS_PER_VOLUME, HASH_WORKER_THREADS, SOCKET_REACTOR_THREADS, SEARCH_RESPONSE_THREADS, UDP_RECEIVE_SOCKETS, UDP_WORKER_THREADS,
+		MAX_DOWNLOAD_SPEED_LOWEST, MAX_DOWNLOAD_SPEED_LOW, MAX_DOWNLOAD_SPEED_NORMAL, MAX_DOWNLOAD_SPEED_HIGH, MAX_DOWNLOAD_SPEED_HIGHEST,
 		MAX_RUNNING_BUNDLES, DEFAULT_SP, UPDATE_CHANNEL,
 
 		AUTOSEARCH_EVERY, AS_DELAY_HOURS,
@@ -219,6 +220,7 @@ public:
 		FL_REPORT_FILE_DUPES, USE_UPLOAD_BUNDLES, LOG_IGNORED, REMOVE_FINISHED_BUNDLES, ALWAYS_CCPM,
 
 		POPUP_BOT_PMS, POPUP_HUB_PMS, SORT_FAVUSERS_FIRST,
+		SHARE_SEARCH_INDEX, CONCURRENT_SHARE_SEARCH, SHARE_MONITORING, KERNEL_TLS,
 #ifdef HAVE_GUI
 		// Windows GUI
 		BOLD_FINISHED_DOWNLOADS, BOLD_FINISHED_UPLOADS, BOLD_HUB, BOLD_PM,
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "ShareCache.h"
+
+#include "ZUtils.h"
+
+namespace dcpp {
+
+// The records are read directly from the mapped file
+static_assert(sizeof(ShareCache::Header) == 40, "Invalid header size");
+static_assert(sizeof(ShareCache::DirectoryRecord) == 32, "Invalid directory record size");
+static_assert(sizeof(ShareCache::FileRecord) == 56, "Invalid file record size");
+
+const char ShareCache::MAGIC[4] = { 'A', 'S', 'C', 'B' };
+
+namespace {
+
+void updateChecksum(CRC32Filter& crc_, const void* aData, size_t aLen) noexcept {
+	// zlib takes 32 bit lengths
+	auto p = static_cast<const uint8_t*>(aData);
+	while (aLen > 0) {
+		auto chunk = min<size_t>(aLen, 1 << 30);
+		crc_(p, chunk);
+		p += chunk;
+		aLen -= chunk;
+	}
+}
+
+}
+
+ShareCache::Name ShareCache::Writer::addName(const DualString& aName) noexcept {
+	Name ret;
+	ret.offset = static_cast<uint32_t>(strings.size());
+	ret.length = static_cast<uint32_t>(aName.getLower().size());
+	ret.caseMask = NO_INDEX;
+
+	strings += aName.getLower();
+
+	auto mask = aName.getCaseMask();
+	if (mask) {
+		ret.caseMask = static_cast<uint32_t>(caseMasks.size());
+		caseMasks.insert(caseMasks.end(), mask, mask + DualString::getCaseMaskSize(ret.length));
+	}
+
+	return ret;
+}
+
+uint32_t ShareCache::Writer::addDirectory(const DualString& aName, uint32_t aParent, time_t aLastWrite) noexcept {
+	DirectoryRecord d = {};
+	d.name = addName(aName);
+	d.parent = aParent;
+	d.lastWrite = aLastWrite;
+
+	directories.push_back(d);
+	return static_cast<uint32_t>(directories.size() - 1);
+}
+
+void ShareCache::Writer::addFile(const DualString& aName, int64_t aSize, time_t aLastWrite, const TTHValue& aTTH) noexcept {
+	dcassert(!directories.empty());
+
+	FileRecord f = {};
+	f.name = addName(aName);
+	f.size = aSize;
+	f.lastWrite = aLastWrite;
+	memcpy(f.tth, aTTH.data, TTHValue::BYTES);
+
+	files.push_back(f);
+	directories.back().fileCount++;
+}
+
+void ShareCache::Writer::save(const string& aPath) const {
+	Header header = {};
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.directoryCount = static_cast<uint32_t>(directories.size());
+	header.fileCount = static_cast<uint32_t>(files.size());
+	header.caseMaskCount = static_cast<uint32_t>(caseMasks.size());
+	header.stringsSize = static_cast<uint32_t>(strings.size());
+	header.lastWrite = directories.empty() ? 0 : directories.front().lastWrite;
+
+	const pair<const void*, size_t> sections[] = {
+		{ directories.data(), directories.size() * sizeof(DirectoryRecord) },
+		{ files.data(), files.size() * sizeof(FileRecord) },
+		{ caseMasks.data(), caseMasks.size() * sizeof(DualString::MaskType) },
+		{ strings.data(), strings.size() },
+	};
+
+	CRC32Filter crc;
+	for (const auto& s: sections) {
+		updateChecksum(crc, s.first, s.second);
+	}
+
+	header.checksum = crc.getValue();
+
+	{
+		// Create a temp file first in case we get interrupted
+		File f(aPath + ".tmp", File::WRITE, File::TRUNCATE | File::CREATE, File::BUFFER_SEQUENTIAL);
+		f.write(&header, sizeof(Header));
+		for (const auto& s: sections) {
+			if (s.second > 0) {
+				f.write(s.first, s.second);
+			}
+		}
+	}
+
+	File::deleteFile(aPath);
+	File::renameFile(aPath + ".tmp", aPath);
+}
+
+ShareCache::Reader::Reader(const string& aPath) : file(aPath) {
+	if (file.getSize() < sizeof(Header)) {
+		throw Exception("Invalid cache file");
+	}
+
+	memcpy(&header, file.getData(), sizeof(Header));
+	if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+		throw Exception("Invalid cache file");
+	}
+
+	if (header.version != VERSION) {
+		throw Exception("Unsupported cache version");
+	}
+
+	auto expectedSize = sizeof(Header) +
+		static_cast<uint64_t>(header.directoryCount) * sizeof(DirectoryRecord) +
+		static_cast<uint64_t>(header.fileCount) * sizeof(FileRecord) +
+		static_cast<uint64_t>(header.caseMaskCount) * sizeof(DualString::MaskType) +
+		header.stringsSize;
+
+	if (expectedSize != file.getSize() || header.directoryCount == 0) {
+		throw Exception("Invalid cache file size");
+	}
+
+	auto p = file.getData() + sizeof(Header);
+	CRC32Filter crc;
+	updateChecksum(crc, p, file.getSize() - sizeof(Header));
+	if (crc.getValue() != header.checksum) {
+		throw Exception("Cache checksum mismatch");
+	}
+
+	directories = reinterpret_cast<const DirectoryRecord*>(p);
+	p += header.directoryCount * sizeof(DirectoryRecord);
+
+	files = reinterpret_cast<const FileRecord*>(p);
+	p += header.fileCount * sizeof(FileRecord);
+
+	caseMasks = reinterpret_cast<const DualString::MaskType*>(p);
+	p += header.caseMaskCount * sizeof(DualString::MaskType);
+
+	strings = reinterpret_cast<const char*>(p);
+
+	// The loader relies on these
+	uint64_t totalFiles = 0;
+	for (uint32_t i = 0; i < header.directoryCount; ++i) {
+		const auto& d = directories[i];
+		if (i == 0 ? d.parent != NO_INDEX : d.parent >= i) {
+			throw Exception("Invalid directory structure");
+		}
+
+		totalFiles += d.fileCount;
+	}
+
+	if (totalFiles != header.fileCount) {
+		throw Exception("Invalid directory structure");
+	}
+}
+
+DualString ShareCache::Reader::getName(const Name& aName) const {
+	if (static_cast<uint64_t>(aName.offset) + aName.length > header.stringsSize) {
+		throw Exception("Invalid name");
+	}
+
+	const DualString::MaskType* mask = nullptr;
+	if (aName.caseMask != NO_INDEX) {
+		if (static_cast<uint64_t>(aName.caseMask) + DualString::getCaseMaskSize(aName.length) > header.caseMaskCount) {
+			throw Exception("Invalid name");
+		}
+
+		mask = caseMasks + aName.caseMask;
+	}
+
+	return DualString(string(strings + aName.offset, aName.length), mask);
+}
+
+} // namespace dcpp
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_SHARE_CACHE_H
+#define DCPLUSPLUS_DCPP_SHARE_CACHE_H
+
+#include "typedefs.h"
+
+#include "DualString.h"
+#include "Exception.h"
+#include "File.h"
+#include "MerkleTree.h"
+
+namespace dcpp {
+
+/**
+ * Binary share cache file for a single root directory
+ *
+ * Layout: header, directory records, file records, case masks of names, name strings.
+ * Directories are stored in depth-first order and the files of each directory follow
+ * the files of the previous directory. The records use the native byte order and
+ * they are accessed directly from the mapped file.
+ */
+class ShareCache {
+public:
+	static const uint32_t VERSION = 1;
+	static const uint32_t NO_INDEX = UINT32_MAX;
+
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		// CRC32 of everything after the header
+		uint32_t checksum;
+		uint32_t directoryCount;
+		uint32_t fileCount;
+		uint32_t caseMaskCount;
+		uint32_t stringsSize;
+		uint32_t reserved;
+		int64_t lastWrite;
+	};
+
+	// Names are stored in lowercase, the case mask (if any) restores the original form
+	struct Name {
+		uint32_t offset;
+		uint32_t length;
+		uint32_t caseMask;
+	};
+
+	struct DirectoryRecord {
+		Name name;
+		uint32_t parent;
+		uint32_t fileCount;
+		uint32_t reserved;
+		int64_t lastWrite;
+	};
+
+	struct FileRecord {
+		Name name;
+		uint32_t reserved;
+		int64_t size;
+		int64_t lastWrite;
+		uint8_t tth[TTHValue::BYTES];
+	};
+
+	class Writer : boost::noncopyable {
+	public:
+		// The first directory is the root
+		uint32_t addDirectory(const DualString& aName, uint32_t aParent, time_t aLastWrite) noexcept;
+
+		// Adds a file for the last added directory
+		void addFile(const DualString& aName, int64_t aSize, time_t aLastWrite, const TTHValue& aTTH) noexcept;
+
+		// Writes the file via a temp file
+		// Throws FileException
+		void save(const string& aPath) const;
+	private:
+		Name addName(const DualString& aName) noexcept;
+
+		vector<DirectoryRecord> directories;
+		vector<FileRecord> files;
+		vector<DualString::MaskType> caseMasks;
+		string strings;
+	};
+
+	class Reader : boost::noncopyable {
+	public:
+		// Validates the structure and the checksum
+		// Throws FileException or Exception
+		explicit Reader(const string& aPath);
+
+		time_t getLastWrite() const noexcept { return static_cast<time_t>(header.lastWrite); }
+
+		uint32_t getDirectoryCount() const noexcept { return header.directoryCount; }
+		uint32_t getFileCount() const noexcept { return header.fileCount; }
+
+		const DirectoryRecord& getDirectory(uint32_t aIndex) const noexcept { return directories[aIndex]; }
+		const FileRecord& getFile(uint32_t aIndex) const noexcept { return files[aIndex]; }
+
+		// Throws Exception if the name is out of bounds
+		DualString getName(const Name& aName) const;
+	private:
+		MappedFile file;
+
+		Header header;
+		const DirectoryRecord* directories = nullptr;
+		const FileRecord* files = nullptr;
+		const DualString::MaskType* caseMasks = nullptr;
+		const char* strings = nullptr;
+	};
+private:
+	static const char MAGIC[4];
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_SHARE_CACHE_H)
@@ -24,6 +24,7 @@
 #include "BZUtils.h"
 #include "ClientManager.h"
 #include "DCPlusPlus.h"
+#include "DeviceTaskPool.h"
 #include "ErrorCollector.h"
 #include "File.h"
 #include "FilteredFile.h"
@@ -32,7 +33,9 @@
 #include "ResourceManager.h"
 #include "ScopedFunctor.h"
 #include "SearchResult.h"
+#include "ShareMonitor.h"
 #include "SharePathValidator.h"
+#include "SharedFileStream.h"
 #include "SimpleXML.h"
 #include "StringTokenizer.h"
 #include "Transfer.h"
@@ -103,8 +106,21 @@ void ShareManager::log(const string& aMsg, LogMessage::Severity aSeverity) noexc
 // Note that settings are loaded before this function is called
 // This function shouldn't initialize anything that is needed by the startup wizard
 void ShareManager::startup(StartupLoader& aLoader) noexcept {
+	if (SETTING(SHARE_SEARCH_INDEX)) {
+		// Roots have been loaded already, the content will be added when the cache is applied
+		WLock l(cs);
+		treeRevision++;
+		searchIndex = make_unique<SearchIndex>();
+		for (const auto& d : rootPaths | map_values) {
+			searchIndex->addTree(*d);
+		}
+	}
+
+	// Left from an earlier session
+	deleteFilelistFragments();
+
 	bool refreshed = false;
-	if (!loadCache(aLoader.progressF)) {
+	if (!loadCache(aLoader)) {
 		// Refresh involves hooks, let everything load first
 		aLoader.addPostLoadTask([this, &aLoader] {
 			aLoader.stepF(STRING(REFRESHING_SHARE));
@@ -115,6 +131,10 @@ void ShareManager::startup(StartupLoader& aLoader) noexcept {
 	}
 
 	addAsyncTask([=] {
+		if (SETTING(SHARE_MONITORING)) {
+			startMonitoring();
+		}
+
 		TimerManager::getInstance()->addListener(this);
 
 		if (SETTING(STARTUP_REFRESH) && !refreshed) {
@@ -124,7 +144,8 @@ void ShareManager::startup(StartupLoader& aLoader) noexcept {
 }
 
 void ShareManager::shutdown(function<void(float)> progressF) noexcept {
-	saveXmlList(progressF);
+	saveCache(progressF);
+	deleteFilelistFragments();
 
 	try {
 		RLock l (cs);
@@ -139,6 +160,10 @@ void ShareManager::shutdown(function<void(float)> progressF) noexcept {
 	} catch(...) { }
 
 	TimerManager::getInstance()->removeListener(this);
+	if (monitor) {
+		monitor->stop();
+	}
+
 	join();
 }
 
@@ -174,7 +199,14 @@ ShareManager::Directory::Directory(DualString&& aRealName, const ShareManager::D
 }
 
 ShareManager::Directory::~Directory() { 
-	for_each(files, DeleteFunction());
+	for (const auto& f : files) {
+		fileArena.destroy(f);
+	}
+}
+
+void ShareManager::Directory::reserveFiles(size_t aCount) noexcept {
+	fileArena.reserve(aCount);
+	files.reserve(files.size() + aCount);
 }
 
 void ShareManager::Directory::updateModifyDate() {
@@ -335,8 +367,17 @@ bool ShareManager::RootDirectory::hasRootProfile(ProfileToken aProfile) const no
 
 ShareManager::RootDirectory::RootDirectory(const string& aRootPath, const string& aVname, const ProfileTokenSet& aProfiles, bool aIncoming, time_t aLastRefreshTime) noexcept :
 	path(aRootPath), pathLower(Text::toLower(aRootPath)), virtualName(make_unique<DualString>(aVname)), 
-	incoming(aIncoming), rootProfiles(aProfiles), lastRefreshTime(aLastRefreshTime) {
+	incoming(aIncoming), rootProfiles(aProfiles), lastRefreshTime(aLastRefreshTime), revision(nextRevision++) {
+
+}
 
+atomic<uint64_t> ShareManager::RootDirectory::nextRevision { 1 };
+
+void ShareManager::RootDirectory::setCacheDirty(bool aDirty) noexcept {
+	cacheDirty = aDirty;
+	if (aDirty) {
+		revision = nextRevision++;
+	}
 }
 
 ShareManager::RootDirectory::Ptr ShareManager::RootDirectory::create(const string& aRootPath, const string& aVname, const ProfileTokenSet& aProfiles, bool aIncoming, time_t aLastRefreshTime) noexcept {
@@ -859,7 +900,10 @@ bool ShareManager::Directory::setParent(const Directory::Ptr& aDirectory, const
 
 void ShareManager::Directory::cleanIndices(Directory& aDirectory, int64_t& sharedSize_, File::TTHMap& tthIndex_, Directory::MultiMap& dirNames_) noexcept {
 	aDirectory.cleanIndices(sharedSize_, tthIndex_, dirNames_);
+	removeFromParent(aDirectory);
+}
 
+void ShareManager::Directory::removeFromParent(Directory& aDirectory) noexcept {
 	if (aDirectory.parent) {
 		aDirectory.parent->directories.erase_key(aDirectory.realName.getLower());
 		aDirectory.parent = nullptr;
@@ -909,14 +953,40 @@ static const string DATE = "Date";
 static const string SHARE = "Share";
 static const string SVERSION = "Version";
 
-struct ShareManager::ShareLoader : public SimpleXMLReader::ThreadedCallBack, public ShareManager::RefreshInfo {
-	ShareLoader(const string& aPath, const ShareManager::Directory::Ptr& aOldRoot, ShareManager::ShareBloom& aBloom) :
+struct ShareManager::CacheLoader : public ShareManager::RefreshInfo {
+	CacheLoader(const string& aPath, const ShareManager::Directory::Ptr& aOldRoot, ShareManager::ShareBloom& aBloom, const string& aCachePath) :
 		ShareManager::RefreshInfo(aPath, aOldRoot, 0, aBloom),
+		cachePath(aCachePath)
+	{
+
+	}
+
+	virtual ~CacheLoader() { }
+
+	// Throws on errors
+	virtual void load() = 0;
+
+	const string cachePath;
+
+	// The cache should be written again after loading
+	bool cacheDirty = false;
+};
+
+struct ShareManager::ShareLoader : public SimpleXMLReader::ThreadedCallBack, public ShareManager::CacheLoader {
+	ShareLoader(const string& aPath, const ShareManager::Directory::Ptr& aOldRoot, ShareManager::ShareBloom& aBloom) :
 		ThreadedCallBack(aOldRoot->getRoot()->getCacheXmlPath()),
+		ShareManager::CacheLoader(aPath, aOldRoot, aBloom, aOldRoot->getRoot()->getCacheXmlPath()),
 		curDirPath(aOldRoot->getRoot()->getPath()),
 		curDirPathLower(aOldRoot->getRoot()->getPathLower())
 	{ 
 		cur = newShareDirectory;
+
+		// Migrate to the binary format
+		cacheDirty = true;
+	}
+
+	void load() override {
+		SimpleXMLReader(this).parse(*file);
 	}
 
 
@@ -984,21 +1054,108 @@ private:
 	string curDirPath;
 };
 
-typedef shared_ptr<ShareManager::ShareLoader> ShareLoaderPtr;
-typedef vector<ShareLoaderPtr> LoaderList;
+struct ShareManager::BinaryShareLoader : public ShareManager::CacheLoader {
+	BinaryShareLoader(const string& aPath, const ShareManager::Directory::Ptr& aOldRoot, ShareManager::ShareBloom& aBloom) :
+		ShareManager::CacheLoader(aPath, aOldRoot, aBloom, aOldRoot->getRoot()->getCachePath()),
+		curDirPath(aOldRoot->getRoot()->getPath()),
+		curDirPathLower(aOldRoot->getRoot()->getPathLower())
+	{
+
+	}
+
+	void load() override {
+		ShareCache::Reader reader(cachePath);
+		newShareDirectory->setLastWrite(reader.getLastWrite());
+
+		// Directories are stored in depth-first order, keep the path to the current one
+		struct Level {
+			uint32_t index;
+			Directory::Ptr directory;
+			size_t pathLength;
+			size_t pathLowerLength;
+		};
+
+		vector<Level> levels;
+		levels.push_back({ 0, newShareDirectory, curDirPath.size(), curDirPathLower.size() });
+
+		uint32_t fileIndex = 0;
+		loadFiles(reader, reader.getDirectory(0).fileCount, newShareDirectory, fileIndex);
+
+		for (uint32_t i = 1; i < reader.getDirectoryCount(); ++i) {
+			const auto& record = reader.getDirectory(i);
+			while (levels.back().index != record.parent) {
+				levels.pop_back();
+				if (levels.empty()) {
+					throw Exception("Invalid directory structure");
+				}
+			}
+
+			const auto& parent = levels.back();
+			curDirPath.resize(parent.pathLength);
+			curDirPathLower.resize(parent.pathLowerLength);
+
+			auto directory = ShareManager::Directory::createNormal(reader.getName(record.name), parent.directory, record.lastWrite, lowerDirNameMapNew, bloom);
+			if (!directory) {
+				throw Exception("Duplicate directory name");
+			}
+
+			curDirPath += directory->realName.getNormal() + PATH_SEPARATOR;
+			curDirPathLower += directory->realName.getLower() + PATH_SEPARATOR;
+			levels.push_back({ i, directory, curDirPath.size(), curDirPathLower.size() });
+
+			loadFiles(reader, record.fileCount, directory, fileIndex);
+		}
+	}
+private:
+	void loadFiles(const ShareCache::Reader& aReader, uint32_t aCount, const Directory::Ptr& aDirectory, uint32_t& fileIndex_) {
+		aDirectory->reserveFiles(aCount);
+		for (uint32_t i = 0; i < aCount; ++i) {
+			const auto& record = aReader.getFile(fileIndex_++);
+			auto name = aReader.getName(record.name);
+			auto fileName = name.getNormal();
+
+			try {
+				// The hash database is authoritative, rewrite the cache if it contains outdated information
+				HashedFile fi;
+				HashManager::getInstance()->getFileInfo(curDirPathLower + name.getLower(), curDirPath + fileName, fi);
+				if (fi.getRoot() != TTHValue(record.tth) || fi.getSize() != record.size) {
+					cacheDirty = true;
+				}
+
+				addFile(move(name), aDirectory, fi, tthIndexNew, bloom, stats.addedSize);
+			} catch (Exception& e) {
+				stats.hashSize += File::getSize(curDirPath + fileName);
+				dcdebug("Error loading file list %s \n", e.getError().c_str());
+			}
+		}
+	}
+
+	string curDirPath;
+	string curDirPathLower;
+};
+
+typedef shared_ptr<ShareManager::CacheLoader> CacheLoaderPtr;
+typedef vector<CacheLoaderPtr> LoaderList;
 
-bool ShareManager::loadCache(function<void(float)> progressF) noexcept {
+bool ShareManager::loadCache(StartupLoader& aLoader) noexcept {
 	HashManager::HashPauser pauser;
 
 	Util::migrate(Util::getPath(Util::PATH_SHARECACHE), "ShareCache_*");
 
+	auto start = GET_TICK();
 	LoaderList cacheLoaders;
+	size_t migratedRoots = 0;
 
 	// Create loaders
 	for (const auto& rp: rootPaths) {
 		try {
-			auto loader = std::make_shared<ShareLoader>(rp.first, rp.second, *bloom.get());
-			cacheLoaders.emplace_back(loader);
+			if (Util::fileExists(rp.second->getRoot()->getCachePath())) {
+				cacheLoaders.push_back(std::make_shared<BinaryShareLoader>(rp.first, rp.second, *bloom.get()));
+			} else {
+				// Old XML cache
+				cacheLoaders.push_back(std::make_shared<ShareLoader>(rp.first, rp.second, *bloom.get()));
+				migratedRoots++;
+			}
 		} catch (const FileException&) {
 			log(STRING_F(SHARE_CACHE_FILE_MISSING, rp.first), LogMessage::SEV_ERROR);
 			return false;
@@ -1009,8 +1166,8 @@ bool ShareManager::loadCache(function<void(float)> progressF) noexcept {
 		// Remove obsolete cache files
 		auto fileList = File::findFiles(Util::getPath(Util::PATH_SHARECACHE), "ShareCache_*", File::TYPE_FILE);
 		for (const auto& p: fileList) {
-			auto rp = find_if(cacheLoaders, [&p](const ShareLoaderPtr& aLoader) {
-				return p == aLoader->xmlPath;
+			auto rp = find_if(cacheLoaders, [&p](const CacheLoaderPtr& aLoader) {
+				return p == aLoader->cachePath;
 			});
 
 			if (rp == cacheLoaders.end()) {
@@ -1033,22 +1190,21 @@ bool ShareManager::loadCache(function<void(float)> progressF) noexcept {
 		bool hasFailedCaches = false;
 
 		try {
-			parallel_for_each(cacheLoaders.begin(), cacheLoaders.end(), [&](ShareLoaderPtr& i) {
-				//log("Thread: " + Util::toString(::GetCurrentThreadId()) + "Size " + Util::toString(loader.size), LogMessage::SEV_INFO);
+			parallel_for_each(cacheLoaders.begin(), cacheLoaders.end(), [&](CacheLoaderPtr& i) {
 				auto& loader = *i;
 				try {
-					SimpleXMLReader(&loader).parse(*loader.file);
-				} catch (SimpleXMLException& e) {
-					log(STRING_F(LOAD_FAILED_X, loader.xmlPath % e.getError()), LogMessage::SEV_ERROR);
+					loader.load();
+				} catch (Exception& e) {
+					log(STRING_F(LOAD_FAILED_X, loader.cachePath % e.getError()), LogMessage::SEV_ERROR);
 					hasFailedCaches = true;
-					File::deleteFile(loader.xmlPath);
+					File::deleteFile(loader.cachePath);
 				} catch (...) {
 					hasFailedCaches = true;
-					File::deleteFile(loader.xmlPath);
+					File::deleteFile(loader.cachePath);
 				}
 
-				if (progressF) {
-					progressF(static_cast<float>(loaded++) / static_cast<float>(dirCount));
+				if (aLoader.progressF) {
+					aLoader.progressF(static_cast<float>(loaded++) / static_cast<float>(dirCount));
 				}
 			});
 		} catch (std::exception& e) {
@@ -1065,10 +1221,16 @@ bool ShareManager::loadCache(function<void(float)> progressF) noexcept {
 	// Apply the changes
 	ShareRefreshStats stats;
 	for (const auto& l : cacheLoaders) {
+		if (l->cacheDirty) {
+			l->newShareDirectory->getRoot()->setCacheDirty(true);
+		}
+
 		applyRefreshChanges(*l, nullptr);
 		stats.merge(l->stats);
 	}
 
+	aLoader.addTiming(migratedRoots == 0 ? "Share cache" : "Share cache (" + Util::toString(migratedRoots) + " roots migrated from XML)", GET_TICK() - start);
+
 #ifdef _DEBUG
 	//validateDirectoryTreeDebug();
 #endif
@@ -1125,6 +1287,49 @@ void ShareManager::Directory::countStats(time_t& totalAge_, size_t& totalDirs_,
 	totalFiles_ += files.size();
 }
 
+void ShareManager::Directory::countMemoryUsage(ShareMemoryStats& stats_) const noexcept {
+	stats_.directoryCount++;
+	stats_.directoryBytes += sizeof(Directory) + (files.capacity() * sizeof(File*)) + (directories.capacity() * sizeof(Ptr));
+	stats_.nameBytes += realName.getHeapSize();
+
+	stats_.fileBytes += fileArena.getAllocatedBytes();
+	for (const auto& f : files) {
+		stats_.fileCount++;
+		stats_.nameBytes += f->name.getHeapSize();
+	}
+
+	for (const auto& d : directories) {
+		d->countMemoryUsage(stats_);
+	}
+}
+
+// Hash nodes are assumed to contain the next pointer and the cached hash
+template<class T>
+static size_t getHashMapMemoryUsage(const T& aMap) noexcept {
+	return (aMap.size() * (sizeof(typename T::value_type) + (sizeof(void*) * 2))) + (aMap.bucket_count() * sizeof(void*));
+}
+
+ShareManager::ShareMemoryStats ShareManager::getMemoryStats() const noexcept {
+	ShareMemoryStats stats;
+
+	RLock l(cs);
+	for (const auto& d : rootPaths | map_values) {
+		if (!d->getParent()) {
+			d->countMemoryUsage(stats);
+		}
+	}
+
+	stats.tthIndexBytes = getHashMapMemoryUsage(tthIndex);
+	stats.directoryNameIndexBytes = getHashMapMemoryUsage(lowerDirNameMap);
+	stats.bloomBytes = bloom->getTableSize() / 8;
+
+	if (searchIndex) {
+		stats.searchIndexBytes = searchIndex->getDirectories().getMemoryUsage() + searchIndex->getFiles().getMemoryUsage();
+	}
+
+	return stats;
+}
+
 void ShareManager::countStats(time_t& totalAge_, size_t& totalDirs_, int64_t& totalSize_, size_t& totalFiles_, size_t& lowerCaseFiles_, size_t& totalStrLen_, size_t& roots_) const noexcept{
 	RLock l(cs);
 	for (const auto& d : rootPaths | map_values) {
@@ -1179,6 +1384,25 @@ ShareManager::ShareSearchStats ShareManager::getSearchMatchingStats() const noex
 	stats.autoSearches = autoSearches;
 	stats.tthSearches = tthSearches;
 
+	stats.indexedSearches = indexedSearches;
+	stats.indexHitRatio = Util::countAverage(indexedSearches, recursiveSearches - filteredSearches);
+	stats.indexCandidateMatchRatio = Util::countAverage(indexCandidateMatches, indexCandidates);
+	stats.averageIndexSearchMatchUs = Util::countAverageInt64(indexSearchTimeUs, indexedSearches);
+	stats.averageTreeSearchMatchUs = Util::countAverageInt64(treeSearchTimeUs, recursiveSearches - filteredSearches - indexedSearches);
+	stats.concurrentSearches = concurrentSearches;
+
+	{
+		RLock l(cs);
+		stats.refreshApplies = refreshApplies;
+		stats.preparedRefreshApplies = preparedRefreshApplies;
+		stats.maxRefreshApplyMs = maxRefreshApplyTime;
+
+		if (searchIndex) {
+			stats.indexTrigramCount = searchIndex->getDirectories().getTrigramCount() + searchIndex->getFiles().getTrigramCount();
+			stats.indexPostingCount = searchIndex->getDirectories().getPostingCount() + searchIndex->getFiles().getPostingCount();
+		}
+	}
+
 	return stats;
 }
 
@@ -1212,6 +1436,28 @@ Average name length of a shared item: %d bytes (total size %s)")
 		% Util::formatBytes(itemStats.totalNameSize)
 	);
 
+	auto memoryStats = getMemoryStats();
+	ret += boost::str(boost::format(
+"\r\n\r\n-=[ Share memory usage (estimated) ]=-\r\n\r\n\
+Directories: %s (%d bytes per directory)\r\n\
+Files: %s (%d bytes per file)\r\n\
+Names: %s\r\n\
+TTH index: %s\r\n\
+Directory name index: %s\r\n\
+Bloom filter: %s\r\n\
+Search index: %s\r\n\
+Total: %s")
+
+		% Util::formatBytes(memoryStats.directoryBytes) % Util::countAverageInt64(memoryStats.directoryBytes, memoryStats.directoryCount)
+		% Util::formatBytes(memoryStats.fileBytes) % Util::countAverageInt64(memoryStats.fileBytes, memoryStats.fileCount)
+		% Util::formatBytes(memoryStats.nameBytes)
+		% Util::formatBytes(memoryStats.tthIndexBytes)
+		% Util::formatBytes(memoryStats.directoryNameIndexBytes)
+		% Util::formatBytes(memoryStats.bloomBytes)
+		% Util::formatBytes(memoryStats.searchIndexBytes)
+		% Util::formatBytes(memoryStats.getTotalBytes())
+	);
+
 	auto searchStats = getSearchMatchingStats();
 	ret += boost::str(boost::format(
 "\r\n\r\n-=[ Search statistics ]=-\r\n\r\n\
@@ -1220,7 +1466,12 @@ Incoming text searches: %d (of which %d were matched per second)\r\n\
 Filtered text searches: %d%% (%d%% of the matched ones returned results)\r\n\
 Average search tokens (non-filtered only): %d (%d bytes per token)\r\n\
 Auto searches (text, ADC only): %d%%\r\n\
-Average time for matching a recursive search: %d ms\r\n\
+Average time for matching a recursive search: %d ms (name matcher: %s)\r\n\
+Searches matched via the name index: %d%% (%d%% of index candidates were matched)\r\n\
+Average matching time (name index / directory tree): %d / %d us\r\n\
+Name index size: %d trigrams, %d postings\r\n\
+Searches with roots matched concurrently: %d%%\r\n\
+Refreshes applied with prepared changes: %d%% (longest write lock for applying a refresh: %d ms)\r\n\
 TTH searches: %d%% (hash bloom mode: %s)")
 
 		% searchStats.totalSearches % searchStats.totalSearchesPerSecond
@@ -1228,11 +1479,44 @@ TTH searches: %d%% (hash bloom mode: %s)")
 		% Util::countPercentage(searchStats.filteredSearches, searchStats.recursiveSearches) % Util::countPercentage(searchStats.recursiveSearchesResponded, searchStats.recursiveSearches - searchStats.filteredSearches)
 		% searchStats.averageSearchTokenCount  % searchStats.averageSearchTokenLength
 		% Util::countAverage(searchStats.autoSearches, searchStats.recursiveSearches)
-		% searchStats.averageSearchMatchMs
+		% searchStats.averageSearchMatchMs % StringSearch::getMatcherName()
+		% (searchStats.indexHitRatio * 100.00) % (searchStats.indexCandidateMatchRatio * 100.00)
+		% searchStats.averageIndexSearchMatchUs % searchStats.averageTreeSearchMatchUs
+		% searchStats.indexTrigramCount % searchStats.indexPostingCount
+		% Util::countPercentage(searchStats.concurrentSearches, searchStats.recursiveSearches - searchStats.filteredSearches)
+		% Util::countPercentage(searchStats.preparedRefreshApplies, searchStats.refreshApplies) % searchStats.maxRefreshApplyMs
 		% Util::countPercentage(searchStats.tthSearches, searchStats.totalSearches)
 		% (SETTING(BLOOM_MODE) != SettingsManager::BLOOM_DISABLED ? "Enabled" : "Disabled") // bloom mode
 	);
 
+	if (monitor) {
+		auto monitorStats = monitor->getStats();
+		ret += boost::str(boost::format(
+"\r\n\r\n-=[ Share monitoring ]=-\r\n\r\n\
+Watched directories: %d (failed watches: %d)\r\n\
+File system events: %d (%d%% coalesced with pending changes)\r\n\
+Refresh tasks: %d (%d directories, total duration %d seconds)\r\n\
+Full refreshes because of lost events: %d\r\n\
+Estimated time saved compared to full refreshes: %d seconds")
+
+			% monitorStats.watchCount % monitorStats.failedWatches
+			% monitorStats.events % Util::countPercentage(monitorStats.coalescedEvents, monitorStats.events)
+			% monitorRefreshTasks % monitorRefreshedDirectories % (monitorRefreshTime / 1000)
+			% monitorFullRefreshes
+			% (monitorTimeSaved / 1000)
+		);
+	}
+
+	auto fileStats = SharedFileStream::getStats();
+	ret += boost::str(boost::format(
+"\r\n\r\n-=[ Shared file access ]=-\r\n\r\n\
+Reads/writes: %d / %d\r\n\
+Operations started while another one of the same file was in progress: %d (%d%%)")
+
+		% fileStats.reads % fileStats.writes
+		% fileStats.concurrentOperations % Util::countPercentage(fileStats.concurrentOperations, fileStats.reads + fileStats.writes)
+	);
+
 	return ret;
 }
 
@@ -1446,14 +1730,65 @@ bool ShareManager::RefreshInfo::checkContent(const Directory::Ptr& aDirectory) n
 	return true;
 }
 
-ShareManager::ShareBuilder::ShareBuilder(const string& aPath, const Directory::Ptr& aOldRoot, time_t aLastWrite, ShareBloom& bloom_, ShareManager* aSm) :
-	sm(*aSm), RefreshInfo(aPath, aOldRoot, aLastWrite, bloom_) {
+ShareManager::ShareBuilder::ShareBuilder(const string& aPath, const Directory::Ptr& aOldRoot, time_t aLastWrite, ShareBloom& bloom_, ShareManager* aSm, DeviceTaskPool* aScanPool) :
+	sm(*aSm), RefreshInfo(aPath, aOldRoot, aLastWrite, bloom_), scanPool(aScanPool) {
+
+}
+
+ShareManager::ShareBuilder::ScannedItem::ScannedItem(string&& aName, const FileItemInfoBase& aInfo) noexcept :
+	name(move(aName)), directory(aInfo.isDirectory()), hidden(aInfo.isHidden()), link(aInfo.isLink()),
+	size(directory ? 0 : aInfo.getSize()), lastWriteTime(aInfo.getLastWriteTime()) {
+
+}
+
+ShareManager::ShareBuilder::ScannedItemList ShareManager::ShareBuilder::listDirectory(const string& aPath, const bool& aStopping) {
+	ScannedItemList ret;
+
+	FileFindIter end;
+	for (FileFindIter i(aPath, "*"); i != end && !aStopping; ++i) {
+		auto name = i->getFileName();
+		if (name.empty()) {
+			break;
+		}
+
+		ret.emplace_back(move(name), *i);
+	}
+
+	return ret;
+}
+
+ShareManager::ShareBuilder::ScanResult ShareManager::ShareBuilder::scanDirectory(const string& aPath, const bool& aStopping) noexcept {
+	if (!scanPool) {
+		// List when the content is needed
+		return std::async(std::launch::deferred, [aPath, &aStopping] {
+			return listDirectory(aPath, aStopping);
+		});
+	}
+
+	auto result = make_shared<std::promise<ScannedItemList>>();
+	auto ret = result->get_future();
+
+	// Tasks that are still queued when the refresh finishes will be discarded by the pool
+	scanPool->addTask(deviceId, [result, aPath, &aStopping] {
+		try {
+			result->set_value(aStopping ? ScannedItemList() : listDirectory(aPath, aStopping));
+		} catch (...) {
+			result->set_exception(std::current_exception());
+		}
+	});
 
+	return ret;
 }
 
 bool ShareManager::ShareBuilder::buildTree(const bool& aStopping) noexcept {
 	try {
-		buildTree(path, Text::toLower(path), newShareDirectory, oldShareDirectory, aStopping);
+		// Mount points inside the refreshed path are counted towards the same device
+		if (scanPool) {
+			deviceId = File::getDeviceId(path);
+		}
+
+		auto content = scanDirectory(path, aStopping);
+		buildTree(path, Text::toLower(path), newShareDirectory, oldShareDirectory, content.get(), aStopping);
 	} catch (const std::bad_alloc&) {
 		log(STRING_F(DIR_REFRESH_FAILED, path % STRING(OUT_OF_MEMORY)), LogMessage::SEV_ERROR);
 		return false;
@@ -1486,15 +1821,13 @@ bool ShareManager::ShareBuilder::validateFileItem(const FileItemInfoBase& aFileI
 	return true;
 }
 
-void ShareManager::ShareBuilder::buildTree(const string& aPath, const string& aPathLower, const Directory::Ptr& aParent, const Directory::Ptr& aOldParent, const bool& aStopping) {
+void ShareManager::ShareBuilder::buildTree(const string& aPath, const string& aPathLower, const Directory::Ptr& aParent, const Directory::Ptr& aOldParent, const ScannedItemList& aItems, const bool& aStopping) {
 	ErrorCollector errors;
-	FileFindIter end;
-	for(FileFindIter i(aPath, "*"); i != end && !aStopping; ++i) {
-		const auto name = i->getFileName();
-		if(name.empty()) {
-			return;
-		}
+	vector<PendingDirectory> subDirectories;
 
+	aParent->reserveFiles(count_if(aItems.begin(), aItems.end(), [](const ScannedItem& aItem) { return !aItem.isDirectory(); }));
+	for (auto i = aItems.begin(); i != aItems.end() && !aStopping; ++i) {
+		const auto& name = i->name;
 		const auto isDirectory = i->isDirectory();
 		if (!isDirectory) {
 			errors.increaseTotal();
@@ -1527,17 +1860,11 @@ void ShareManager::ShareBuilder::buildTree(const string& aPath, const string& aP
 
 			}
 
-			// Add it
+			// Add it (the content is listed in the background)
 			auto curDir = Directory::createNormal(move(dualName), aParent, i->getLastWriteTime(), lowerDirNameMapNew, bloom);
 			if (curDir) {
-				buildTree(curPath, curPathLower, curDir, oldDir, aStopping);
-				if (checkContent(curDir)) {
-					if (isNew) {
-						stats.newDirectoryCount++;
-					} else {
-						stats.existingDirectoryCount++;
-					}
-				}
+				auto content = scanDirectory(curPath, aStopping);
+				subDirectories.push_back({ move(curPath), move(curPathLower), curDir, oldDir, isNew, move(content) });
 			}
 		} else {
 			// Not a directory, assume it's a file...
@@ -1584,6 +1911,21 @@ void ShareManager::ShareBuilder::buildTree(const string& aPath, const string& aP
 	if (!msg.empty()) {
 		log(STRING_F(SHARE_FILES_BLOCKED, aPath % msg), LogMessage::SEV_INFO);
 	}
+
+	for (auto& d : subDirectories) {
+		if (aStopping) {
+			break;
+		}
+
+		buildTree(d.path, d.pathLower, d.directory, d.oldDirectory, d.content.get(), aStopping);
+		if (checkContent(d.directory)) {
+			if (d.isNew) {
+				stats.newDirectoryCount++;
+			} else {
+				stats.existingDirectoryCount++;
+			}
+		}
+	}
 }
 
 #ifdef _DEBUG
@@ -1958,10 +2300,14 @@ bool ShareManager::addRootDirectory(const ShareDirectoryInfoPtr& aDirectoryInfo)
 		if (i != rootPaths.end()) {
 			return false;
 		} else {
+			treeRevision++;
 			dcassert(find_if(rootPaths | map_keys, IsParentOrExact(path, PATH_SEPARATOR)).base() == rootPaths.end());
 
 			// It's a new parent, will be handled in the task thread
-			Directory::createRoot(path, aDirectoryInfo->virtualName, aDirectoryInfo->profiles, aDirectoryInfo->incoming, File::getLastModified(path), rootPaths, lowerDirNameMap, *bloom.get(), 0);
+			auto dir = Directory::createRoot(path, aDirectoryInfo->virtualName, aDirectoryInfo->profiles, aDirectoryInfo->incoming, File::getLastModified(path), rootPaths, lowerDirNameMap, *bloom.get(), 0);
+			if (searchIndex) {
+				searchIndex->addDirectory(*dir);
+			}
 		}
 	}
 
@@ -1988,16 +2334,26 @@ bool ShareManager::removeRootDirectory(const string& aPath) noexcept {
 		}
 
 		auto sd = k->second;
+		treeRevision++;
 
 		dirtyProfiles = k->second->getRoot()->getRootProfiles();
 
 		rootPaths.erase(k);
 
 		// Remove the root
+		if (searchIndex) {
+			searchIndex->removeTree(*sd);
+		}
+
 		Directory::cleanIndices(*sd, sharedSize, tthIndex, lowerDirNameMap);
+		File::deleteFile(sd->getRoot()->getCachePath());
 		File::deleteFile(sd->getRoot()->getCacheXmlPath());
 	}
 
+	if (monitor) {
+		monitor->removeDirectory(aPath);
+	}
+
 	HashManager::getInstance()->stopHashing(aPath);
 
 	log(STRING_F(SHARED_DIR_REMOVED, aPath), LogMessage::SEV_INFO);
@@ -2028,16 +2384,25 @@ bool ShareManager::updateRootDirectory(const ShareDirectoryInfoPtr& aDirectoryIn
 		WLock l(cs);
 		auto p = rootPaths.find(aDirectoryInfo->path);
 		if (p != rootPaths.end()) {
+			treeRevision++;
 			auto vName = validateVirtualName(aDirectoryInfo->virtualName);
 			rootDirectory = p->second->getRoot();
 
 			// Make sure that all removed profiles are set dirty as well
 			dirtyProfiles.insert(rootDirectory->getRootProfiles().begin(), rootDirectory->getRootProfiles().end());
 
+			if (searchIndex) {
+				searchIndex->removeDirectory(*p->second);
+			}
+
 			removeDirName(*p->second, lowerDirNameMap);
 			rootDirectory->setName(vName);
 			addDirName(p->second, lowerDirNameMap, *bloom.get());
 
+			if (searchIndex) {
+				searchIndex->addDirectory(*p->second);
+			}
+
 			rootDirectory->setIncoming(aDirectoryInfo->incoming);
 			rootDirectory->setRootProfiles(aDirectoryInfo->profiles);
 		} else {
@@ -2070,6 +2435,7 @@ void ShareManager::reportTaskStatus(const ShareRefreshTask& aTask, bool aFinishe
 			msg = aFinished ? STRING(FILE_LIST_REFRESH_FINISHED) : STRING(FILE_LIST_REFRESH_INITIATED);
 			break;
 		case (ShareRefreshType::REFRESH_DIRS):
+		case (ShareRefreshType::MONITORING):
 			if (!aTask.displayName.empty()) {
 				msg = aFinished ? STRING_F(VIRTUAL_DIRECTORY_REFRESHED, aTask.displayName) : STRING_F(FILE_LIST_REFRESH_INITIATED_VPATH, aTask.displayName);
 			} else if (aTask.dirs.size() == 1) {
@@ -2189,6 +2555,14 @@ void ShareManager::runRefreshTask(const ShareRefreshTask& aTask, function<void(f
 		return;
 	}
 
+	auto startTime = GET_TICK();
+
+	// Directory listing is mostly waiting for the storage (especially with network drives)
+	unique_ptr<DeviceTaskPool> scanPool;
+	if (SETTING(REFRESH_SCAN_THREADS) > 1) {
+		scanPool = make_unique<DeviceTaskPool>(SETTING(REFRESH_SCAN_THREADS), SETTING(REFRESH_SCAN_THREADS_PER_VOLUME));
+	}
+
 	ShareBuilderSet refreshDirs;
 
 	ShareBloom* refreshBloom = aTask.type == ShareRefreshType::REFRESH_ALL ? new ShareBloom(1 << 20) : bloom.get();
@@ -2198,7 +2572,7 @@ void ShareManager::runRefreshTask(const ShareRefreshTask& aTask, function<void(f
 		RLock l(cs);
 		for (auto& refreshPath : dirs) {
 			auto directory = findDirectory(refreshPath);
-			refreshDirs.insert(std::make_shared<ShareBuilder>(refreshPath, directory, File::getLastModified(refreshPath), *refreshBloom, this));
+			refreshDirs.insert(std::make_shared<ShareBuilder>(refreshPath, directory, File::getLastModified(refreshPath), *refreshBloom, this, scanPool.get()));
 		}
 	}
 
@@ -2228,9 +2602,16 @@ void ShareManager::runRefreshTask(const ShareRefreshTask& aTask, function<void(f
 
 			// Apply the changes
 			if (succeed) {
+				{
+					RLock l(cs);
+					prepareRefreshChanges(ri);
+				}
+
 				{
 					WLock l(cs);
+					auto applyStart = GET_TICK();
 					applyRefreshChanges(ri, &dirtyProfiles);
+					maxRefreshApplyTime = max(maxRefreshApplyTime, GET_TICK() - applyStart);
 				}
 
 				totalStats.merge(ri.stats);
@@ -2274,6 +2655,22 @@ void ShareManager::runRefreshTask(const ShareRefreshTask& aTask, function<void(f
 		setProfilesDirty(dirtyProfiles, aTask.priority == ShareRefreshPriority::MANUAL || aTask.type == ShareRefreshType::REFRESH_ALL || aTask.type == ShareRefreshType::BUNDLE);
 	}
 
+	auto duration = GET_TICK() - startTime;
+	if (aTask.type == ShareRefreshType::REFRESH_ALL || aTask.type == ShareRefreshType::STARTUP) {
+		if (allBuildersSucceed) {
+			lastFullRefreshDuration = duration;
+		}
+	} else if (aTask.type == ShareRefreshType::MONITORING) {
+		monitorRefreshTime += duration;
+		if (lastFullRefreshDuration > duration) {
+			monitorTimeSaved += lastFullRefreshDuration - duration;
+		}
+	}
+
+	if (monitor) {
+		addMonitoredDirectories(aTask.dirs);
+	}
+
 	reportTaskStatus(aTask, true, &totalStats);
 	fire(ShareManagerListener::RefreshCompleted(), aTask, allBuildersSucceed, totalStats);
 }
@@ -2292,7 +2689,7 @@ void ShareRefreshStats::merge(const ShareRefreshStats& aOther) noexcept {
 	existingDirectoryCount += aOther.existingDirectoryCount;
 }
 
-void ShareManager::RefreshInfo::applyRefreshChanges(Directory::MultiMap& lowerDirNameMap_, Directory::Map& rootPaths_, HashFileMap& tthIndex_, int64_t& sharedBytes_, ProfileTokenSet* dirtyProfiles_) noexcept {
+void ShareManager::RefreshInfo::applyRefreshChanges(Directory::MultiMap& lowerDirNameMap_, Directory::Map& rootPaths_, HashFileMap& tthIndex_, int64_t& sharedBytes_, ProfileTokenSet* dirtyProfiles_, SearchIndex* searchIndex_) noexcept {
 #ifdef _DEBUG
 	for (const auto& d: lowerDirNameMapNew | map_values) {
 		checkAddedDirNameDebug(d, lowerDirNameMap_);
@@ -2306,6 +2703,14 @@ void ShareManager::RefreshInfo::applyRefreshChanges(Directory::MultiMap& lowerDi
 	lowerDirNameMap_.insert(lowerDirNameMapNew.begin(), lowerDirNameMapNew.end());
 	tthIndex_.insert(tthIndexNew.begin(), tthIndexNew.end());
 
+	if (searchIndex_) {
+		if (preparedChanges) {
+			searchIndex_->applyPrepared(preparedChanges->searchIndex);
+		} else {
+			searchIndex_->addItems(lowerDirNameMapNew, tthIndexNew);
+		}
+	}
+
 	for (const auto& rp : rootPathsNew) {
 		//dcassert(rootPaths_.find(rp.first) == rootPaths_.end());
 		rootPaths_[rp.first] = rp.second;
@@ -2320,6 +2725,7 @@ void ShareManager::RefreshInfo::applyRefreshChanges(Directory::MultiMap& lowerDi
 	// Save some memory
 	lowerDirNameMapNew.clear();
 	tthIndexNew.clear();
+	preparedChanges.reset();
 	oldShareDirectory = nullptr;
 	newShareDirectory = nullptr;
 }
@@ -2395,9 +2801,68 @@ bool ShareManager::abortRefresh(optional<ShareRefreshTaskToken> aToken) noexcept
 	return !paths.empty();
 }
 
+void ShareManager::prepareRefreshChanges(RefreshInfo& ri) const noexcept {
+	auto changes = make_unique<RefreshInfo::PreparedChanges>();
+	changes->treeRevision = treeRevision;
+
+	if (ri.oldShareDirectory) {
+		collectRemovedItems(*ri.oldShareDirectory, tthIndex, lowerDirNameMap, *changes);
+		if (searchIndex) {
+			SearchIndex::prepareRemoved(*ri.oldShareDirectory, changes->searchIndex);
+		}
+	}
+
+	if (searchIndex) {
+		SearchIndex::prepareAdded(ri.lowerDirNameMapNew, ri.tthIndexNew, changes->searchIndex);
+		searchIndex->prepareMerged(changes->searchIndex);
+	}
+
+	ri.preparedChanges = move(changes);
+}
+
+void ShareManager::collectRemovedItems(const Directory& aDirectory, const HashFileMap& aTTHIndex, const Directory::MultiMap& aDirNames, RefreshInfo::PreparedChanges& changes_) noexcept {
+	for (const auto& d : aDirectory.getDirectories()) {
+		collectRemovedItems(*d, aTTHIndex, aDirNames, changes_);
+	}
+
+	{
+		auto directories = aDirNames.equal_range(const_cast<string*>(&aDirectory.getVirtualNameLower()));
+		for (auto i = directories.first; i != directories.second; ++i) {
+			if (i->second.get() == &aDirectory) {
+				changes_.removedDirectories.push_back(i);
+				break;
+			}
+		}
+	}
+
+	for (const auto& f : aDirectory.files) {
+		auto flst = aTTHIndex.equal_range(const_cast<TTHValue*>(&f->getTTH()));
+		for (auto i = flst.first; i != flst.second; ++i) {
+			if (i->second == f) {
+				changes_.removedFiles.push_back(i);
+				break;
+			}
+		}
+
+		changes_.removedSize += f->getSize();
+	}
+}
+
 bool ShareManager::applyRefreshChanges(RefreshInfo& ri, ProfileTokenSet* aDirtyProfiles) {
 	Directory::Ptr parent = nullptr;
 
+	// Prepared changes can't be used if the containers have been modified after they were collected
+	if (ri.preparedChanges && ri.preparedChanges->treeRevision != treeRevision) {
+		ri.preparedChanges.reset();
+	}
+
+	refreshApplies++;
+	if (ri.preparedChanges) {
+		preparedRefreshApplies++;
+	}
+
+	treeRevision++;
+
 	// Recursively remove the content of this dir from TTHIndex and directory name map
 	if (ri.oldShareDirectory) {
 		// Root removed while refreshing?
@@ -2408,62 +2873,214 @@ bool ShareManager::applyRefreshChanges(RefreshInfo& ri, ProfileTokenSet* aDirtyP
 		parent = ri.oldShareDirectory->getParent();
 
 		// Remove the old directory
-		Directory::cleanIndices(*ri.oldShareDirectory, sharedSize, tthIndex, lowerDirNameMap);
+		if (ri.preparedChanges) {
+			const auto& changes = *ri.preparedChanges;
+			for (const auto& i : changes.removedFiles) {
+				tthIndex.erase(i);
+			}
+
+			for (const auto& i : changes.removedDirectories) {
+				lowerDirNameMap.erase(i);
+			}
+
+			sharedSize -= changes.removedSize;
+			dcassert(sharedSize >= 0);
+
+			// The search index is updated with the new content in one go
+
+			Directory::removeFromParent(*ri.oldShareDirectory);
+		} else {
+			if (searchIndex) {
+				searchIndex->removeTree(*ri.oldShareDirectory);
+			}
+
+			Directory::cleanIndices(*ri.oldShareDirectory, sharedSize, tthIndex, lowerDirNameMap);
+		}
 	}
 
+	auto onNotAdded = [&] {
+		if (ri.preparedChanges && ri.oldShareDirectory && searchIndex) {
+			searchIndex->removePrepared(ri.preparedChanges->searchIndex);
+		}
+
+		return false;
+	};
+
 	// Set the parent for refreshed subdirectories
 	// (previous directory should always be available for roots)
 	if (!ri.oldShareDirectory || !ri.oldShareDirectory->isRoot()) {
 		// All content was removed?
 		if (!ri.checkContent(ri.newShareDirectory)) {
-			return false;
+			return onNotAdded();
 		}
 
 		if (!parent) {
+			auto parentPath = Util::getParentDir(ri.path);
+			if (ri.preparedChanges && searchIndex && !findDirectory(parentPath)) {
+				// The merged search index lists don't contain the parent directories that will be created, update the index item by item instead
+				if (ri.oldShareDirectory) {
+					searchIndex->removePrepared(ri.preparedChanges->searchIndex);
+				}
+
+				ri.preparedChanges.reset();
+			}
+
 			// Create new parent
-			parent = getDirectory(Util::getParentDir(ri.path));
+			parent = getDirectory(parentPath);
 			if (!parent) {
-				return false;
+				return onNotAdded();
 			}
 		}
 
 		// Set the parent
 		if (!Directory::setParent(ri.newShareDirectory, parent)) {
-			return false;
+			return onNotAdded();
 		}
 	}
 
-	ri.applyRefreshChanges(lowerDirNameMap, rootPaths, tthIndex, sharedSize, aDirtyProfiles);
+	ri.applyRefreshChanges(lowerDirNameMap, rootPaths, tthIndex, sharedSize, aDirtyProfiles, searchIndex.get());
 	dcdebug("Share changes applied for the directory %s\n", ri.path.c_str());
 	return true;
 }
 
-void ShareManager::on(TimerManagerListener::Minute, uint64_t aTick) noexcept {
-	if(lastSave == 0 || lastSave + 15*60*1000 <= aTick) {
-		saveXmlList();
+void ShareManager::startMonitoring() noexcept {
+	if (!ShareMonitor::isSupported()) {
+		log("Share monitoring isn't supported on this platform", LogMessage::SEV_WARNING);
+		return;
 	}
 
-	if(SETTING(AUTO_REFRESH_TIME) > 0 && lastFullUpdate + SETTING(AUTO_REFRESH_TIME) * 60 * 1000 <= aTick) {
-		lastIncomingUpdate = aTick;
-		lastFullUpdate = aTick;
-		refresh(ShareRefreshType::REFRESH_ALL, ShareRefreshPriority::SCHEDULED);
-	} else if(SETTING(INCOMING_REFRESH_TIME) > 0 && lastIncomingUpdate + SETTING(INCOMING_REFRESH_TIME) * 60 * 1000 <= aTick) {
-		lastIncomingUpdate = aTick;
-		refresh(ShareRefreshType::REFRESH_INCOMING, ShareRefreshPriority::SCHEDULED);
+	auto shareMonitor = make_unique<ShareMonitor>();
+	if (!shareMonitor->start()) {
+		log("Failed to start share monitoring", LogMessage::SEV_ERROR);
+		return;
+	}
+
+	monitor = move(shareMonitor);
+
+	RefreshPathList roots;
+	{
+		RLock l(cs);
+		boost::copy(rootPaths | map_keys, inserter(roots, roots.begin()));
 	}
+
+	addMonitoredDirectories(roots);
 }
 
-ShareDirectoryInfoPtr ShareManager::getRootInfo(const Directory::Ptr& aDir) const noexcept {
-	auto& rootDir = aDir->getRoot();
+void ShareManager::getDirectoryPaths(const Directory& aDirectory, const string& aPath, StringList& paths_) noexcept {
+	paths_.push_back(aPath);
+	for (const auto& d : aDirectory.getDirectories()) {
+		getDirectoryPaths(*d, aPath + d->realName.getNormal() + PATH_SEPARATOR, paths_);
+	}
+}
 
-	size_t fileCount = 0, folderCount = 0;
-	int64_t size = 0;
-	aDir->getContentInfo(size, fileCount, folderCount);
+void ShareManager::addMonitoredDirectories(const RefreshPathList& aPaths) noexcept {
+	StringList paths;
 
-	auto info = std::make_shared<ShareDirectoryInfo>(aDir->getRealPath());
-	info->profiles = rootDir->getRootProfiles();
-	info->incoming = rootDir->getIncoming();
-	info->size = size;
+	{
+		RLock l(cs);
+		for (const auto& p : aPaths) {
+			auto directory = findDirectory(p);
+			if (directory) {
+				getDirectoryPaths(*directory, directory->getRealPath(), paths);
+			}
+		}
+	}
+
+	monitor->addDirectories(paths);
+}
+
+void ShareManager::handleMonitorChanges(uint64_t aTick) noexcept {
+	// Wait until the directory has been quiet for a while (copying of large files, extracting etc.)
+	const uint64_t CHANGE_DELAY_MS = 10 * 1000;
+
+	auto overflow = false;
+	auto changedPaths = monitor->getChangedDirectories(aTick, CHANGE_DELAY_MS, overflow);
+	if (overflow) {
+		log("Share monitoring: file system events were lost, refreshing the whole share", LogMessage::SEV_WARNING);
+
+		monitorFullRefreshes++;
+		refresh(ShareRefreshType::REFRESH_ALL, ShareRefreshPriority::SCHEDULED);
+		return;
+	}
+
+	if (changedPaths.empty()) {
+		return;
+	}
+
+	StringList refreshPaths, removedPaths;
+
+	{
+		RLock l(cs);
+		for (const auto& p : changedPaths) {
+			StringList remainingTokens;
+			auto directory = findDirectory(p, remainingTokens);
+			if (!directory) {
+				// Parent of a root
+				continue;
+			}
+
+			if (remainingTokens.empty()) {
+				refreshPaths.push_back(p);
+			} else {
+				// Not shared anymore
+				removedPaths.push_back(p);
+			}
+		}
+	}
+
+	for (const auto& p : removedPaths) {
+		monitor->removeDirectory(p);
+	}
+
+	// Subdirectories are refreshed with their parents
+	sort(refreshPaths.begin(), refreshPaths.end());
+	refreshPaths.erase(unique(refreshPaths.begin(), refreshPaths.end(), [](const string& aParent, const string& aSub) {
+		return AirUtil::isParentOrExactLocal(aParent, aSub);
+	}), refreshPaths.end());
+
+	if (refreshPaths.empty()) {
+		return;
+	}
+
+	auto result = addRefreshTask(ShareRefreshPriority::SCHEDULED, refreshPaths, ShareRefreshType::MONITORING);
+	if (result.result != RefreshTaskQueueResult::EXISTS) {
+		monitorRefreshTasks++;
+		monitorRefreshedDirectories += refreshPaths.size();
+	}
+}
+
+void ShareManager::on(TimerManagerListener::Second, uint64_t aTick) noexcept {
+	if (monitor) {
+		handleMonitorChanges(aTick);
+	}
+}
+
+void ShareManager::on(TimerManagerListener::Minute, uint64_t aTick) noexcept {
+	if(lastSave == 0 || lastSave + 15*60*1000 <= aTick) {
+		saveCache();
+	}
+
+	if(SETTING(AUTO_REFRESH_TIME) > 0 && lastFullUpdate + SETTING(AUTO_REFRESH_TIME) * 60 * 1000 <= aTick) {
+		lastIncomingUpdate = aTick;
+		lastFullUpdate = aTick;
+		refresh(ShareRefreshType::REFRESH_ALL, ShareRefreshPriority::SCHEDULED);
+	} else if(SETTING(INCOMING_REFRESH_TIME) > 0 && lastIncomingUpdate + SETTING(INCOMING_REFRESH_TIME) * 60 * 1000 <= aTick) {
+		lastIncomingUpdate = aTick;
+		refresh(ShareRefreshType::REFRESH_INCOMING, ShareRefreshPriority::SCHEDULED);
+	}
+}
+
+ShareDirectoryInfoPtr ShareManager::getRootInfo(const Directory::Ptr& aDir) const noexcept {
+	auto& rootDir = aDir->getRoot();
+
+	size_t fileCount = 0, folderCount = 0;
+	int64_t size = 0;
+	aDir->getContentInfo(size, fileCount, folderCount);
+
+	auto info = std::make_shared<ShareDirectoryInfo>(aDir->getRealPath());
+	info->profiles = rootDir->getRootProfiles();
+	info->incoming = rootDir->getIncoming();
+	info->size = size;
 	info->contentInfo = DirectoryContentInfo(folderCount, fileCount);
 	info->virtualName = rootDir->getName();
 	info->refreshState = static_cast<uint8_t>(rootDir->getRefreshState());
@@ -2539,17 +3156,32 @@ FileList* ShareManager::generateXmlList(ProfileToken aProfile, bool forced /*fal
 				{
 					File f(tmpName, File::RW, File::TRUNCATE | File::CREATE, File::BUFFER_SEQUENTIAL, false);
 
-					toFilelist(f, ADC_ROOT_STR, aProfile, true);
+					{
+						BufferedOutputStream<false> bos(&f);
+						toFilelist(bos, ADC_ROOT_STR, aProfile, true, true);
+						bos.flushBuffers(false);
+					}
 
 					fl->setXmlListLen(f.getSize());
 
 					File bz(fl->getFileName(), File::WRITE, File::TRUNCATE | File::CREATE, File::BUFFER_SEQUENTIAL, false);
 					// We don't care about the leaves...
 					CalcOutputStream<TTFilter<1024 * 1024 * 1024>, false> bzTree(&bz);
-					FilteredOutputStream<BZFilter, false> bzipper(&bzTree);
+					ParallelBZOutputStream bzipper(&bzTree);
 					CalcOutputStream<TTFilter<1024 * 1024 * 1024>, false> newXmlFile(&bzipper);
 
-					newXmlFile.write(f.read());
+					f.setPos(0);
+					ByteVector buf(1024 * 1024);
+					for (;;) {
+						auto len = buf.size();
+						f.read(&buf[0], len);
+						if (len == 0) {
+							break;
+						}
+
+						newXmlFile.write(&buf[0], len);
+					}
+
 					newXmlFile.flushBuffers(false);
 
 					newXmlFile.getFilter().getTree().finalize();
@@ -2587,7 +3219,7 @@ MemoryInputStream* ShareManager::generatePartialList(const string& aVirtualPath,
 
 	{
 		StringOutputStream sos(xml);
-		toFilelist(sos, aVirtualPath, aProfile, aRecursive);
+		toFilelist(sos, aVirtualPath, aProfile, aRecursive, false);
 	}
 
 	if (xml.empty()) {
@@ -2599,34 +3231,62 @@ MemoryInputStream* ShareManager::generatePartialList(const string& aVirtualPath,
 	}
 }
 
-void ShareManager::toFilelist(OutputStream& os_, const string& aVirtualPath, const OptionalProfileToken& aProfile, bool aRecursive) const {
-	FilelistDirectory listRoot(Util::emptyString, 0);
+bool ShareManager::prepareFilelist(FilelistDirectory& listRoot_, const string& aVirtualPath, const OptionalProfileToken& aProfile, bool aRecursive) const noexcept {
 	Directory::List childDirectories;
 
-	RLock l(cs);
-	dcdebug("Generating filelist for %s \n", aVirtualPath.c_str());
-
 	// Get the directories
 	if (aVirtualPath == ADC_ROOT_STR) {
 		getRoots(aProfile, childDirectories);
 	} else {
 		try {
 			// We need to save the root directories as well for listing the files directly inside them
-			findVirtuals<OptionalProfileToken>(aVirtualPath, aProfile, listRoot.shareDirs);
+			findVirtuals<OptionalProfileToken>(aVirtualPath, aProfile, listRoot_.shareDirs);
 		} catch (...) {
-			return;
+			return false;
 		}
 
-		for (const auto& d : listRoot.shareDirs) {
+		for (const auto& d : listRoot_.shareDirs) {
 			copy(d->getDirectories(), back_inserter(childDirectories));
-			listRoot.date = max(listRoot.date, d->getLastWrite());
+			listRoot_.date = max(listRoot_.date, d->getLastWrite());
 		}
 	}
 
 	// Prepare the data
 	for (const auto& d : childDirectories) {
-		d->toFileList(listRoot, aRecursive);
-		listRoot.date = max(listRoot.date, d->getLastWrite()); // In case the date is not set yet
+		d->toFileList(listRoot_, aRecursive);
+		listRoot_.date = max(listRoot_.date, d->getLastWrite()); // In case the date is not set yet
+	}
+
+	return true;
+}
+
+bool ShareManager::toFilelist(FilelistVisitor& visitor_, const string& aVirtualPath, const OptionalProfileToken& aProfile, bool aRecursive) const {
+	FilelistDirectory listRoot(Util::emptyString, 0);
+
+	RLock l(cs);
+	if (!prepareFilelist(listRoot, aVirtualPath, aProfile, aRecursive)) {
+		return false;
+	}
+
+	visitor_.onListing(listRoot.date);
+	for (const auto ld : listRoot.listDirs | map_values) {
+		ld->toVisitor(visitor_, aRecursive);
+	}
+
+	listRoot.filesToVisitor(visitor_, !aRecursive);
+	return true;
+}
+
+void ShareManager::toFilelist(OutputStream& os_, const string& aVirtualPath, const OptionalProfileToken& aProfile, bool aRecursive, bool aUseFragments) const {
+	FilelistDirectory listRoot(Util::emptyString, 0);
+
+	// Top-level directories of full lists are written from the fragment cache and their content is added only when needed
+	auto useFragments = aUseFragments && aRecursive && aVirtualPath == ADC_ROOT_STR;
+
+	RLock l(cs);
+	dcdebug("Generating filelist for %s \n", aVirtualPath.c_str());
+	if (!prepareFilelist(listRoot, aVirtualPath, aProfile, aRecursive && !useFragments)) {
+		return;
 	}
 
 	// Write the XML
@@ -2639,11 +3299,154 @@ void ShareManager::toFilelist(OutputStream& os_, const string& aVirtualPath, con
 		"\" Generator=\"" + shortVersionString + "\">\r\n");
 
 	for (const auto ld : listRoot.listDirs | map_values) {
-		ld->toXml(os_, indent, tmp, aRecursive);
+		if (useFragments) {
+			writeFilelistFragment(os_, *ld, indent, tmp);
+		} else {
+			ld->toXml(os_, indent, tmp, aRecursive);
+		}
 	}
 	listRoot.filesToXml(os_, indent, tmp, !aRecursive);
 
 	os_.write("</FileListing>");
+
+	if (useFragments) {
+		removeStaleFilelistFragments();
+	}
+}
+
+void ShareManager::writeFilelistFragment(OutputStream& os_, FilelistDirectory& aListDir, string& indent_, string& tmp_) const {
+	// Returns false if the fragment couldn't be read (nothing was written in that case)
+	auto copyFragment = [&os_](const string& aPath) {
+		size_t written = 0;
+		try {
+			File f(aPath, File::READ, File::OPEN, File::BUFFER_SEQUENTIAL);
+			ByteVector buf(1024 * 1024);
+			for (;;) {
+				auto len = buf.size();
+				f.read(&buf[0], len);
+				if (len == 0) {
+					break;
+				}
+
+				os_.write(&buf[0], len);
+				written += len;
+			}
+		} catch (const FileException& e) {
+			dcdebug("Failed to read filelist fragment %s: %s\n", aPath.c_str(), e.getError().c_str());
+			if (written > 0) {
+				// the output can't be fixed anymore
+				throw;
+			}
+
+			return false;
+		}
+
+		return true;
+	};
+
+	// The content depends only on the included roots
+	FilelistFragment fragment;
+	auto key = aListDir.name + '|' + Util::toString(aListDir.date);
+	for (const auto& d : aListDir.shareDirs) {
+		auto revision = d->getRoot()->getRevision();
+		fragment.rootRevisions.push_back(revision);
+		key += '|' + Util::toString(revision);
+	}
+
+	{
+		string cachedPath;
+		{
+			Lock l(filelistFragmentCS);
+			auto i = filelistFragments.find(key);
+			if (i != filelistFragments.end()) {
+				cachedPath = i->second.path;
+			}
+		}
+
+		if (!cachedPath.empty()) {
+			if (copyFragment(cachedPath)) {
+				return;
+			}
+
+			// Render it again
+			Lock l(filelistFragmentCS);
+			auto i = filelistFragments.find(key);
+			if (i != filelistFragments.end() && i->second.path == cachedPath) {
+				File::deleteFile(cachedPath);
+				filelistFragments.erase(i);
+			}
+		}
+	}
+
+	// Add the content
+	for (const auto& d : aListDir.shareDirs) {
+		for (const auto& child : d->getDirectories()) {
+			child->toFileList(aListDir, true);
+		}
+	}
+
+	{
+		Lock l(filelistFragmentCS);
+		fragment.path = Util::getPath(Util::PATH_SHARECACHE) + "FilelistFragment_" + Util::toString(++filelistFragmentCounter) + ".xml";
+	}
+
+	try {
+		File f(fragment.path, File::WRITE, File::TRUNCATE | File::CREATE, File::BUFFER_SEQUENTIAL);
+		BufferedOutputStream<false> bos(&f);
+
+		auto indent = indent_;
+		aListDir.toXml(bos, indent, tmp_, true);
+		bos.flushBuffers(false);
+	} catch (const FileException& e) {
+		dcdebug("Failed to write filelist fragment %s: %s\n", fragment.path.c_str(), e.getError().c_str());
+		File::deleteFile(fragment.path);
+
+		aListDir.toXml(os_, indent_, tmp_, true);
+		return;
+	}
+
+	bool added = false;
+	auto path = fragment.path;
+	{
+		Lock l(filelistFragmentCS);
+		added = filelistFragments.emplace(key, move(fragment)).second;
+	}
+
+	if (!copyFragment(path)) {
+		aListDir.toXml(os_, indent_, tmp_, true);
+	}
+
+	if (!added) {
+		// Generated by another list simultaneously
+		File::deleteFile(path);
+	}
+}
+
+void ShareManager::removeStaleFilelistFragments() const noexcept {
+	unordered_set<uint64_t> currentRevisions;
+	for (const auto& d : rootPaths | map_values) {
+		if (d->isRoot()) {
+			currentRevisions.insert(d->getRoot()->getRevision());
+		}
+	}
+
+	Lock l(filelistFragmentCS);
+	for (auto i = filelistFragments.begin(); i != filelistFragments.end();) {
+		const auto& revisions = i->second.rootRevisions;
+		if (all_of(revisions.begin(), revisions.end(), [&](uint64_t aRevision) { return currentRevisions.count(aRevision) > 0; })) {
+			++i;
+			continue;
+		}
+
+		File::deleteFile(i->second.path);
+		i = filelistFragments.erase(i);
+	}
+}
+
+void ShareManager::deleteFilelistFragments() noexcept {
+	try {
+		for_each(File::findFiles(Util::getPath(Util::PATH_SHARECACHE), "FilelistFragment_*", File::TYPE_FILE), File::deleteFile);
+	} catch (...) { }
 }
 
 void ShareManager::Directory::toFileList(FilelistDirectory& aListDir, bool aRecursive) {
@@ -2696,9 +3499,7 @@ void ShareManager::FilelistDirectory::toXml(OutputStream& xmlFile, string& inden
 	} else {
 		size_t fileCount = 0, directoryCount = 0;
 		int64_t totalSize = 0;
-		for (const auto& d : shareDirs) {
-			d->getContentInfo(totalSize, fileCount, directoryCount);
-		}
+		getContentInfo(totalSize, fileCount, directoryCount);
 
 		xmlFile.write(LITERAL("\" Size=\""));
 		xmlFile.write(Util::toString(totalSize));
@@ -2723,7 +3524,48 @@ void ShareManager::FilelistDirectory::toXml(OutputStream& xmlFile, string& inden
 	}
 }
 
+void ShareManager::FilelistDirectory::toVisitor(FilelistVisitor& visitor_, bool aRecursive) const {
+	if (aRecursive) {
+		visitor_.onDirectoryStart(name, date, false, DirectoryContentInfo(0, 0), 0);
+
+		for (const auto& d : listDirs | map_values) {
+			d->toVisitor(visitor_, aRecursive);
+		}
+
+		filesToVisitor(visitor_, !aRecursive);
+	} else {
+		size_t fileCount = 0, directoryCount = 0;
+		int64_t totalSize = 0;
+		getContentInfo(totalSize, fileCount, directoryCount);
+
+		// Empty directories are complete
+		auto incomplete = fileCount > 0 || directoryCount > 0;
+		visitor_.onDirectoryStart(name, date, incomplete, DirectoryContentInfo(static_cast<int>(directoryCount), static_cast<int>(fileCount)), totalSize);
+	}
+
+	visitor_.onDirectoryEnd();
+}
+
+void ShareManager::FilelistDirectory::getContentInfo(int64_t& size_, size_t& files_, size_t& directories_) const noexcept {
+	for (const auto& d : shareDirs) {
+		d->getContentInfo(size_, files_, directories_);
+	}
+}
+
 void ShareManager::FilelistDirectory::filesToXml(OutputStream& xmlFile, string& indent, string& tmp2, bool addDate) const {
+	forEachFile([&](const Directory::File& aFile) {
+		aFile.toXml(xmlFile, indent, tmp2, addDate);
+	});
+}
+
+void ShareManager::FilelistDirectory::filesToVisitor(FilelistVisitor& visitor_, bool aAddDate) const {
+	forEachFile([&](const Directory::File& aFile) {
+		visitor_.onFile(aFile.name.lowerCaseOnly() ? aFile.name.getLower() : aFile.name.getNormal(), aFile.getSize(), aFile.getTTH(), aAddDate ? aFile.getLastWrite() : 0);
+	});
+}
+
+template<class FileF>
+void ShareManager::FilelistDirectory::forEachFile(FileF aFileF) const {
 	bool filesAdded = false;
 	int dupeFiles = 0;
 	for(auto di = shareDirs.begin(); di != shareDirs.end(); ++di) {
@@ -2731,7 +3573,7 @@ void ShareManager::FilelistDirectory::filesToXml(OutputStream& xmlFile, string&
 			for(const auto& fi: (*di)->files) {
 				//go through the dirs that we have added already
 				if (none_of(shareDirs.begin(), di, [&fi](const Directory::Ptr& d) { return d->files.find(fi->name.getLower()) != d->files.end(); })) {
-					fi->toXml(xmlFile, indent, tmp2, addDate);
+					aFileF(*fi);
 				} else {
 					dupeFiles++;
 				}
@@ -2739,7 +3581,7 @@ void ShareManager::FilelistDirectory::filesToXml(OutputStream& xmlFile, string&
 		} else if (!(*di)->files.empty()) {
 			filesAdded = true;
 			for(const auto& f: (*di)->files)
-				f->toXml(xmlFile, indent, tmp2, addDate);
+				aFileF(*f);
 		}
 	}
 
@@ -2752,22 +3594,108 @@ void ShareManager::FilelistDirectory::filesToXml(OutputStream& xmlFile, string&
 	}
 }
 
-void ShareManager::Directory::filesToXmlList(OutputStream& xmlFile, string& indent, string& tmp2) const {
-	for(const auto& f: files) {
-		xmlFile.write(indent);
-		xmlFile.write(LITERAL("<File Name=\""));
-		xmlFile.write(SimpleXML::escape(f->name.lowerCaseOnly() ? f->name.getLower() : f->name.getNormal(), tmp2, true));
-		xmlFile.write(LITERAL("\"/>\r\n"));
+ShareManager::Directory::File::File(DualString&& aName, Directory* aParent, const HashedFile& aFileInfo) : 
+	size(aFileInfo.getSize()), parent(aParent), tth(aFileInfo.getRoot()), lastWrite(aFileInfo.getTimeStamp()), name(move(aName)) {
+	
+}
+
+ShareManager::Directory::File::~File() {
+
+}
+
+// Blocks grow with the directory when the file count isn't known beforehand
+static const uint32_t MIN_FILE_BLOCK_SIZE = 4;
+static const uint32_t MAX_FILE_BLOCK_SIZE = 256;
+
+ShareManager::Directory::FileArena::~FileArena() {
+	dcassert(fileCount == 0);
+}
+
+void ShareManager::Directory::FileArena::addBlock(uint32_t aCapacity) noexcept {
+	if (!blocks.empty()) {
+		// Don't lose the unused tail of the previous block
+		auto& last = blocks.back();
+		for (; last.used < last.capacity; last.used++) {
+			freeSlots.push_back(last.firstIndex + last.used);
+		}
 	}
+
+	blocks.push_back({ unique_ptr<Slot[]>(new Slot[aCapacity]), capacity, aCapacity, 0 });
+	capacity += aCapacity;
 }
 
-ShareManager::Directory::File::File(DualString&& aName, const Directory::Ptr& aParent, const HashedFile& aFileInfo) : 
-	size(aFileInfo.getSize()), parent(aParent.get()), tth(aFileInfo.getRoot()), lastWrite(aFileInfo.getTimeStamp()), name(move(aName)) {
-	
+void ShareManager::Directory::FileArena::reserve(size_t aCount) noexcept {
+	size_t available = freeSlots.size();
+	if (!blocks.empty()) {
+		available += blocks.back().capacity - blocks.back().used;
+	}
+
+	if (aCount > available) {
+		addBlock(static_cast<uint32_t>(aCount - available));
+	}
 }
 
-ShareManager::Directory::File::~File() {
+ShareManager::Directory::File* ShareManager::Directory::FileArena::create(DualString&& aName, Directory* aParent, const HashedFile& aFileInfo) {
+	File* slot;
+	if (!freeSlots.empty()) {
+		slot = getSlot(freeSlots.back());
+		freeSlots.pop_back();
+	} else {
+		if (blocks.empty() || blocks.back().used == blocks.back().capacity) {
+			addBlock(min(max(capacity, MIN_FILE_BLOCK_SIZE), MAX_FILE_BLOCK_SIZE));
+		}
 
+		auto& block = blocks.back();
+		slot = reinterpret_cast<File*>(&block.slots[block.used++]);
+	}
+
+	auto f = new (slot) File(move(aName), aParent, aFileInfo);
+	fileCount++;
+	return f;
+}
+
+void ShareManager::Directory::FileArena::destroy(File* aFile) noexcept {
+	auto index = getIndex(aFile);
+	aFile->~File();
+	fileCount--;
+
+	if (fileCount == 0) {
+		// Release the memory of emptied directories
+		blocks.clear();
+		blocks.shrink_to_fit();
+		freeSlots.clear();
+		freeSlots.shrink_to_fit();
+		capacity = 0;
+		return;
+	}
+
+	freeSlots.push_back(index);
+}
+
+ShareManager::Directory::File* ShareManager::Directory::FileArena::getSlot(uint32_t aIndex) noexcept {
+	auto block = upper_bound(blocks.begin(), blocks.end(), aIndex, [](uint32_t aSlotIndex, const Block& aBlock) {
+		return aSlotIndex < aBlock.firstIndex;
+	}) - 1;
+
+	dcassert(aIndex < block->firstIndex + block->capacity);
+	return reinterpret_cast<File*>(&block->slots[aIndex - block->firstIndex]);
+}
+
+uint32_t ShareManager::Directory::FileArena::getIndex(const File* aFile) const noexcept {
+	auto slot = reinterpret_cast<const Slot*>(aFile);
+	for (const auto& block : blocks) {
+		auto first = block.slots.get();
+		if (std::less_equal<const Slot*>()(first, slot) && std::less<const Slot*>()(slot, first + block.capacity)) {
+			return block.firstIndex + static_cast<uint32_t>(slot - first);
+		}
+	}
+
+	dcassert(0);
+	return 0;
+}
+
+size_t ShareManager::Directory::FileArena::getAllocatedBytes() const noexcept {
+	return (capacity * sizeof(Slot)) + (blocks.capacity() * sizeof(Block)) + (freeSlots.capacity() * sizeof(uint32_t));
 }
 
 void ShareManager::Directory::File::toXml(OutputStream& xmlFile, string& indent, string& tmp2, bool addDate) const {
@@ -2787,6 +3715,10 @@ void ShareManager::Directory::File::toXml(OutputStream& xmlFile, string& indent,
 	xmlFile.write(LITERAL("\"/>\r\n"));
 }
 
+string ShareManager::RootDirectory::getCachePath() const noexcept {
+	return Util::getPath(Util::PATH_SHARECACHE) + "ShareCache_" + Util::validateFileName(path) + ".bin";
+}
+
 string ShareManager::RootDirectory::getCacheXmlPath() const noexcept {
 	return Util::getPath(Util::PATH_SHARECACHE) + "ShareCache_" + Util::validateFileName(path) + ".xml";
 }
@@ -2797,12 +3729,12 @@ void ShareManager::RootDirectory::setName(const string& aName) noexcept {
 
 #define LITERAL(n) n, sizeof(n)-1
 
-void ShareManager::saveXmlList(function<void(float)> progressF /*nullptr*/) noexcept {
+void ShareManager::saveCache(function<void(float)> progressF /*nullptr*/) noexcept {
 
-	if(xml_saving)
+	if(cacheSaving)
 		return;
 
-	xml_saving = true;
+	cacheSaving = true;
 
 	if (progressF)
 		progressF(0);
@@ -2816,35 +3748,14 @@ void ShareManager::saveXmlList(function<void(float)> progressF /*nullptr*/) noex
 
 		try {
 			parallel_for_each(dirtyDirs.begin(), dirtyDirs.end(), [&](const Directory::Ptr& d) {
-				string path = d->getRoot()->getCacheXmlPath();
+				string path = d->getRoot()->getCachePath();
 				try {
-					{
-						string indent, tmp;
-
-						//create a backup first in case we get interrupted on creation.
-						File ff(path + ".tmp", File::WRITE, File::TRUNCATE | File::CREATE);
-						BufferedOutputStream<false> xmlFile(&ff);
-
-						xmlFile.write(SimpleXML::utf8Header);
-						xmlFile.write(LITERAL("<Share Version=\"" SHARE_CACHE_VERSION));
-						xmlFile.write(LITERAL("\" Path=\""));
-						xmlFile.write(SimpleXML::escape(d->getRoot()->getPath(), tmp, true));
-
-						xmlFile.write(LITERAL("\" Date=\""));
-						xmlFile.write(SimpleXML::escape(Util::toString(d->getLastWrite()), tmp, true));
-						xmlFile.write(LITERAL("\">\r\n"));
-						indent += '\t';
-
-						for (const auto& child : d->getDirectories()) {
-							child->toXmlList(xmlFile, indent, tmp);
-						}
-						d->filesToXmlList(xmlFile, indent, tmp);
+					ShareCache::Writer writer;
+					d->toCache(writer, ShareCache::NO_INDEX);
+					writer.save(path);
 
-						xmlFile.write(LITERAL("</Share>"));
-					}
-
-					File::deleteFile(path);
-					File::renameFile(path + ".tmp", path);
+					// Migrated
+					File::deleteFile(d->getRoot()->getCacheXmlPath());
 				} catch (Exception& e) {
 					log(STRING_F(SAVE_FAILED_X, path % e.getError()), LogMessage::SEV_WARNING);
 				}
@@ -2860,29 +3771,19 @@ void ShareManager::saveXmlList(function<void(float)> progressF /*nullptr*/) noex
 		}
 	}
 
-	xml_saving = false;
+	cacheSaving = false;
 	lastSave = GET_TICK();
 }
 
-void ShareManager::Directory::toXmlList(OutputStream& xmlFile, string& indent, string& tmp) {
-	xmlFile.write(indent);
-	xmlFile.write(LITERAL("<Directory Name=\""));
-	xmlFile.write(SimpleXML::escape(realName.lowerCaseOnly() ? realName.getLower() : realName.getNormal(), tmp, true));
-
-	xmlFile.write(LITERAL("\" Date=\""));
-	xmlFile.write(SimpleXML::escape(Util::toString(lastWrite), tmp, true));
-	xmlFile.write(LITERAL("\">\r\n"));
-
-	indent += '\t';
-	filesToXmlList(xmlFile, indent, tmp);
-
-	for(const auto& d: directories) {
-		d->toXmlList(xmlFile, indent, tmp);
+void ShareManager::Directory::toCache(ShareCache::Writer& aWriter, uint32_t aParent) const noexcept {
+	auto index = aWriter.addDirectory(realName, aParent, lastWrite);
+	for (const auto& f: files) {
+		aWriter.addFile(f->name, f->getSize(), f->getLastWrite(), f->getTTH());
 	}
 
-	indent.erase(indent.length()-1);
-	xmlFile.write(indent);
-	xmlFile.write(LITERAL("</Directory>\r\n"));
+	for (const auto& d: directories) {
+		d->toCache(aWriter, index);
+	}
 }
 
 MemoryInputStream* ShareManager::generateTTHList(const string& dir, bool recurse, ProfileToken aProfile) const noexcept {
@@ -2988,7 +3889,12 @@ void ShareManager::nmdcSearch(SearchResultList& l, const string& nmdcString, int
 * but not the parents...
 */
 
-void ShareManager::Directory::search(SearchResultInfo::Set& results_, SearchQuery& aStrings, int aLevel) const noexcept{
+void ShareManager::Directory::search(SearchResults& results_, SearchQuery& aStrings, int aLevel) const noexcept{
+	// Can anything on this level get in the results?
+	if (!results_.canImprove(SearchQuery::getMaxRelevanceScore(aStrings, aLevel))) {
+		return;
+	}
+
 	const auto& dirName = getVirtualNameLower();
 	if (aStrings.isExcludedLower(dirName)) {
 		return;
@@ -3004,7 +3910,7 @@ void ShareManager::Directory::search(SearchResultInfo::Set& results_, SearchQuer
 		bool positionsComplete = aStrings.positionsComplete();
 		if (aStrings.itemType != SearchQuery::TYPE_FILE && positionsComplete && aStrings.gt == 0 && aStrings.matchesDate(lastWrite)) {
 			// Full match
-			results_.insert(Directory::SearchResultInfo(this, aStrings, aLevel));
+			results_.add(Directory::SearchResultInfo(this, aStrings, aLevel));
 			//if (aStrings.matchType == SearchQuery::MATCH_FULL_PATH) {
 			//	return;
 			//}
@@ -3038,12 +3944,18 @@ void ShareManager::Directory::search(SearchResultInfo::Set& results_, SearchQuer
 
 	// Match files
 	if(aStrings.itemType != SearchQuery::TYPE_DIRECTORY) {
+		auto maxScores = SearchQuery::getMaxRelevanceScore(aStrings, aLevel);
 		for(const auto& f: files) {
+			// No need to match (or score) the remaining files if they can't get in the results
+			if (!results_.canImprove(maxScores)) {
+				break;
+			}
+
 			if (!aStrings.matchesFileLower(f->name.getLower(), f->getSize(), f->getLastWrite())) {
 				continue;
 			}
 
-			results_.insert(Directory::SearchResultInfo(f, aStrings, aLevel));
+			results_.add(Directory::SearchResultInfo(f, aStrings, aLevel));
 			if (aStrings.addParents)
 				break;
 		}
@@ -3062,6 +3974,341 @@ void ShareManager::Directory::search(SearchResultInfo::Set& results_, SearchQuer
 	aStrings.recursion = old;
 }
 
+bool ShareManager::Directory::SearchResults::canImprove(double aMaxScores) const noexcept {
+	// Results with identical scores are added after the existing ones
+	if (isFull() && aMaxScores <= results.front().info.getScores()) {
+		return false;
+	}
+
+	return !sharedMinScores || aMaxScores >= sharedMinScores->load(std::memory_order_relaxed);
+}
+
+void ShareManager::Directory::SearchResults::add(SearchResultInfo&& aResult) noexcept {
+	if (!canImprove(aResult.getScores())) {
+		return;
+	}
+
+	if (isFull()) {
+		pop_heap(results.begin(), results.end(), IsBetter());
+		results.pop_back();
+	}
+
+	results.push_back({ move(aResult), addedCount++ });
+	push_heap(results.begin(), results.end(), IsBetter());
+
+	if (sharedMinScores && isFull()) {
+		// Lower scoring results aren't needed from any list
+		auto lowest = results.front().info.getScores();
+		auto cur = sharedMinScores->load();
+		while (cur < lowest && !sharedMinScores->compare_exchange_weak(cur, lowest)) {
+			// Updated by another list, check again
+		}
+	}
+}
+
+void ShareManager::Directory::SearchResults::merge(const SearchResults& aOther) noexcept {
+	auto entries = aOther.results;
+	sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.order < b.order; });
+	for (auto& e : entries) {
+		add(move(e.info));
+	}
+}
+
+vector<ShareManager::Directory::SearchResultInfo> ShareManager::Directory::SearchResults::getSorted() const noexcept {
+	auto entries = results;
+	sort_heap(entries.begin(), entries.end(), IsBetter());
+
+	vector<SearchResultInfo> ret;
+	ret.reserve(entries.size());
+	for (const auto& e : entries) {
+		ret.push_back(e.info);
+	}
+
+	return ret;
+}
+
+void ShareManager::searchRootsConcurrently(const Directory::List& aRoots, Directory::SearchResults& results_, const SearchQuery& aSearch) noexcept {
+	Directory::SearchResults::SharedMinScores minScores(0);
+
+	struct RootSearch {
+		Directory::Ptr root;
+		Directory::SearchResults results;
+	};
+
+	vector<RootSearch> rootSearches;
+	for (const auto& d : aRoots) {
+		rootSearches.push_back({ d, Directory::SearchResults(results_.getMaxResults(), &minScores) });
+	}
+
+	{
+		TaskScheduler s;
+		parallel_for_each(rootSearches.begin(), rootSearches.end(), [&](RootSearch& aRootSearch) {
+			// Each task needs a query of its own as the matching positions are stored in it
+			auto search = aSearch;
+			search.recursion = nullptr;
+			aRootSearch.root->search(aRootSearch.results, search, 0);
+		});
+	}
+
+	// Merge in the original root order so that results with identical scores are picked similarly to the regular search
+	for (const auto& rs : rootSearches) {
+		results_.merge(rs.results);
+	}
+}
+
+void ShareManager::SearchIndex::addDirectory(const Directory& aDirectory) noexcept {
+	directories.add(aDirectory.getVirtualNameLower(), &aDirectory);
+}
+
+void ShareManager::SearchIndex::removeDirectory(const Directory& aDirectory) noexcept {
+	directories.remove(aDirectory.getVirtualNameLower(), &aDirectory);
+}
+
+void ShareManager::SearchIndex::addFile(const Directory::File& aFile) noexcept {
+	files.add(aFile.name.getLower(), &aFile);
+}
+
+void ShareManager::SearchIndex::removeFile(const Directory::File& aFile) noexcept {
+	files.remove(aFile.name.getLower(), &aFile);
+}
+
+void ShareManager::SearchIndex::collectItems(const Directory& aDirectory, DirectoryIndex::NameItemList& directories_, FileIndex::NameItemList& files_) noexcept {
+	directories_.emplace_back(&aDirectory.getVirtualNameLower(), &aDirectory);
+	for (const auto& f : aDirectory.files) {
+		files_.emplace_back(&f->name.getLower(), f);
+	}
+
+	for (const auto& d : aDirectory.getDirectories()) {
+		collectItems(*d, directories_, files_);
+	}
+}
+
+void ShareManager::SearchIndex::addTree(const Directory& aDirectory) noexcept {
+	DirectoryIndex::NameItemList newDirectories;
+	FileIndex::NameItemList newFiles;
+	collectItems(aDirectory, newDirectories, newFiles);
+
+	directories.add(newDirectories);
+	files.add(newFiles);
+}
+
+void ShareManager::SearchIndex::removeTree(const Directory& aDirectory) noexcept {
+	DirectoryIndex::NameItemList removedDirectories;
+	FileIndex::NameItemList removedFiles;
+	collectItems(aDirectory, removedDirectories, removedFiles);
+
+	directories.remove(removedDirectories);
+	files.remove(removedFiles);
+}
+
+void ShareManager::SearchIndex::collectItems(const Directory::MultiMap& aDirectories, const Directory::File::TTHMap& aFiles, DirectoryIndex::NameItemList& directories_, FileIndex::NameItemList& files_) noexcept {
+	directories_.reserve(aDirectories.size());
+	for (const auto& d : aDirectories) {
+		directories_.emplace_back(d.first, d.second.get());
+	}
+
+	files_.reserve(aFiles.size());
+	for (const auto& f : aFiles | map_values) {
+		files_.emplace_back(&f->name.getLower(), f);
+	}
+}
+
+void ShareManager::SearchIndex::addItems(const Directory::MultiMap& aDirectories, const Directory::File::TTHMap& aFiles) noexcept {
+	DirectoryIndex::NameItemList newDirectories;
+	FileIndex::NameItemList newFiles;
+	collectItems(aDirectories, aFiles, newDirectories, newFiles);
+
+	directories.add(newDirectories);
+	files.add(newFiles);
+}
+
+void ShareManager::SearchIndex::prepareRemoved(const Directory& aDirectory, PreparedChanges& changes_) noexcept {
+	DirectoryIndex::NameItemList removedDirectories;
+	FileIndex::NameItemList removedFiles;
+	collectItems(aDirectory, removedDirectories, removedFiles);
+
+	changes_.removedDirectories = DirectoryIndex::groupItems(removedDirectories);
+	changes_.removedFiles = FileIndex::groupItems(removedFiles);
+}
+
+void ShareManager::SearchIndex::prepareAdded(const Directory::MultiMap& aDirectories, const Directory::File::TTHMap& aFiles, PreparedChanges& changes_) noexcept {
+	DirectoryIndex::NameItemList newDirectories;
+	FileIndex::NameItemList newFiles;
+	collectItems(aDirectories, aFiles, newDirectories, newFiles);
+
+	changes_.addedDirectories = DirectoryIndex::groupItems(newDirectories);
+	changes_.addedFiles = FileIndex::groupItems(newFiles);
+}
+
+void ShareManager::SearchIndex::prepareMerged(PreparedChanges& changes_) const noexcept {
+	changes_.mergedDirectories = directories.merge(changes_.removedDirectories, changes_.addedDirectories);
+	changes_.mergedFiles = files.merge(changes_.removedFiles, changes_.addedFiles);
+}
+
+void ShareManager::SearchIndex::applyPrepared(PreparedChanges& aChanges) noexcept {
+	directories.apply(aChanges.mergedDirectories);
+	files.apply(aChanges.mergedFiles);
+}
+
+void ShareManager::SearchIndex::removePrepared(const PreparedChanges& aChanges) noexcept {
+	directories.remove(aChanges.removedDirectories);
+	files.remove(aChanges.removedFiles);
+}
+
+
+optional<int> ShareManager::SearchIndex::getSearchLevel(const Directory* aDirectory, const DirectorySet& aRoots, const DirectorySet& aSkipParents, const SearchQuery& aSearch) noexcept {
+	int level = 0;
+	for (auto cur = aDirectory; cur; cur = cur->getParent()) {
+		if (aSkipParents.find(cur) != aSkipParents.end() || aSearch.isExcludedLower(cur->getVirtualNameLower())) {
+			return nullopt;
+		}
+
+		if (aRoots.find(cur) != aRoots.end()) {
+			return level;
+		}
+
+		level++;
+	}
+
+	return nullopt;
+}
+
+// Items that contain all indexable patterns
+template<class IndexT>
+static void getIndexCandidates(const IndexT& aIndex, const vector<const StringSearch::Pattern*>& aPatterns, typename IndexT::ItemList& candidates_) noexcept {
+	typename IndexT::ItemList patternCandidates;
+	for (auto i = aPatterns.begin(); i != aPatterns.end(); ++i) {
+		aIndex.getCandidates((*i)->str(), i == aPatterns.begin() ? candidates_ : patternCandidates);
+		if (i != aPatterns.begin()) {
+			IndexT::intersect(candidates_, patternCandidates);
+		}
+
+		if (candidates_.empty()) {
+			break;
+		}
+	}
+}
+
+/*
+* Produces the same results as the recursive tree search but only the items that contain all
+* (indexable) patterns need to be matched. Partial path matching requires recursion so directories
+* having a name match are searched via the tree.
+*/
+bool ShareManager::SearchIndex::search(const Directory::List& aRoots, Directory::SearchResults& results_, SearchQuery& aSearch, MatchStats& stats_) const noexcept {
+	// Patterns that are too short can't be matched via the index
+	vector<const StringSearch::Pattern*> patterns;
+	for (const auto& p : aSearch.include.getPatterns()) {
+		if (DirectoryIndex::isIndexable(p.str())) {
+			patterns.push_back(&p);
+		}
+	}
+
+	if (patterns.empty()) {
+		return false;
+	}
+
+	DirectorySet roots;
+	for (const auto& d : aRoots) {
+		roots.insert(d.get());
+	}
+
+	auto getLevel = [&](const Directory* aDirectory, const DirectorySet& aSkipParents) -> optional<int> {
+		if (roots.find(aDirectory) != roots.end()) {
+			return 0;
+		}
+
+		auto parentLevel = getSearchLevel(aDirectory->getParent(), roots, aSkipParents, aSearch);
+		if (!parentLevel) {
+			return nullopt;
+		}
+
+		return *parentLevel + 1;
+	};
+
+	aSearch.recursion = nullptr;
+
+	// Directories with a partial name match, search those recursively
+	// Items inside them are skipped when matching the index candidates
+	DirectorySet recursiveDirectories;
+	if (aSearch.matchType == Search::MATCH_PATH_PARTIAL) {
+		DirectoryIndex::ItemList candidates;
+		for (const auto& p : patterns) {
+			directories.getCandidates(p->str(), candidates);
+			stats_.candidates += candidates.size();
+			for (const auto& d : candidates) {
+				if (p->matchLower(d->getVirtualNameLower()) != string::npos) {
+					recursiveDirectories.insert(d);
+				}
+			}
+		}
+
+		stats_.matches += recursiveDirectories.size();
+		for (const auto& d : recursiveDirectories) {
+			// Parent directories will handle the nested ones
+			auto level = getLevel(d, recursiveDirectories);
+			if (level) {
+				d->search(results_, aSearch, *level);
+			}
+		}
+	} else if (aSearch.itemType != SearchQuery::TYPE_FILE && aSearch.gt == 0) {
+		// Full directory matches
+		DirectoryIndex::ItemList candidates;
+		getIndexCandidates(directories, patterns, candidates);
+		stats_.candidates += candidates.size();
+
+		for (const auto& d : candidates) {
+			const auto& dirName = d->getVirtualNameLower();
+			if (aSearch.isExcludedLower(dirName) || !aSearch.matchesAnyDirectoryLower(dirName) || !aSearch.positionsComplete() || !aSearch.matchesDate(d->getLastWrite())) {
+				continue;
+			}
+
+			auto level = getLevel(d, recursiveDirectories);
+			if (level) {
+				stats_.matches++;
+				results_.add(Directory::SearchResultInfo(d, aSearch, *level));
+			}
+		}
+	}
+
+	// Files
+	if (aSearch.itemType != SearchQuery::TYPE_DIRECTORY) {
+		FileIndex::ItemList candidates;
+		getIndexCandidates(files, patterns, candidates);
+		stats_.candidates += candidates.size();
+
+		// Only the first matching file (sorted by name) is returned for each directory when parents are wanted
+		unordered_map<const Directory*, pair<const Directory::File*, int>> parentResults;
+		for (const auto& f : candidates) {
+			auto parentLevel = getSearchLevel(f->getParent(), roots, recursiveDirectories, aSearch);
+			if (!parentLevel || !aSearch.matchesFileLower(f->name.getLower(), f->getSize(), f->getLastWrite())) {
+				continue;
+			}
+
+			stats_.matches++;
+			if (aSearch.addParents) {
+				auto& parentResult = parentResults[f->getParent()];
+				if (!parentResult.first || compare(f->name.getLower(), parentResult.first->name.getLower()) < 0) {
+					parentResult = { f, *parentLevel + 1 };
+				}
+
+				continue;
+			}
+
+			if (results_.canImprove(SearchQuery::getMaxRelevanceScore(aSearch, *parentLevel + 1))) {
+				results_.add(Directory::SearchResultInfo(f, aSearch, *parentLevel + 1));
+			}
+		}
+
+		for (const auto& r : parentResults | map_values) {
+			// Match positions are needed for scoring
+			aSearch.matchesFileLower(r.first->name.getLower(), r.first->getSize(), r.first->getLastWrite());
+			results_.add(Directory::SearchResultInfo(r.first, aSearch, r.second));
+		}
+	}
+
+	return true;
+}
+
 void ShareManager::adcSearch(SearchResultList& results, SearchQuery& srch, const OptionalProfileToken& aProfile, const CID& cid, const string& aDir, bool aIsAutoSearch) {
 	dcassert(!aDir.empty());
 
@@ -3112,11 +4359,53 @@ void ShareManager::adcSearch(SearchResultList& results, SearchQuery& srch, const
 	}
 
 	auto start = GET_TICK();
+	auto matchStart = chrono::steady_clock::now();
 
-	// go them through recursively
-	Directory::SearchResultInfo::Set resultInfos;
-	for (const auto& d: roots) {
-		d->search(resultInfos, srch, 0);
+	// Directory results may still be merged or filtered by date when they are picked, keep some extra
+	auto maxCandidates = srch.maxResults * 2;
+	const auto initialResultCount = results.size();
+	for (;;) {
+		// go them through recursively
+		Directory::SearchResults resultInfos(maxCandidates);
+		SearchIndex::MatchStats indexStats;
+		if (searchIndex && searchIndex->search(roots, resultInfos, srch, indexStats)) {
+			indexedSearches++;
+			indexCandidates += indexStats.candidates;
+			indexCandidateMatches += indexStats.matches;
+			indexSearchTimeUs += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - matchStart).count();
+		} else {
+			if (SETTING(CONCURRENT_SHARE_SEARCH) && roots.size() > 1) {
+				concurrentSearches++;
+				searchRootsConcurrently(roots, resultInfos, srch);
+			} else {
+				for (const auto& d: roots) {
+					d->search(resultInfos, srch, 0);
+				}
+			}
+
+			treeSearchTimeUs += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - matchStart).count();
+		}
+
+		// pick the results to return
+		auto sortedInfos = resultInfos.getSorted();
+		for (auto i = sortedInfos.begin(); (i != sortedInfos.end()) && (results.size() < srch.maxResults); ++i) {
+			auto& info = *i;
+			if (info.getType() == Directory::SearchResultInfo::DIRECTORY) {
+				addDirectoryResult(info.directory, results, aProfile, srch);
+			} else {
+				info.file->addSR(results, srch.addParents);
+			}
+		}
+
+		// Nothing was dropped from the candidates or there are enough results left after merging and filtering?
+		if (results.size() >= srch.maxResults || !resultInfos.isFull()) {
+			break;
+		}
+
+		// Some of the dropped candidates could have been returned, search again with more room
+		results.resize(initialResultCount);
+		maxCandidates *= 4;
+		matchStart = chrono::steady_clock::now();
 	}
 
 	// update statistics
@@ -3127,16 +4416,6 @@ void ShareManager::adcSearch(SearchResultList& results, SearchQuery& srch, const
 		searchTokenLength += p.size();
 
 
-	// pick the results to return
-	for (auto i = resultInfos.begin(); (i != resultInfos.end()) && (results.size() < srch.maxResults); ++i) {
-		auto& info = *i;
-		if (info.getType() == Directory::SearchResultInfo::DIRECTORY) {
-			addDirectoryResult(info.directory, results, aProfile, srch);
-		} else {
-			info.file->addSR(results, srch.addParents);
-		}
-	}
-
 	if (!results.empty())
 		recursiveSearchesResponded++;
 }
@@ -3260,6 +4539,9 @@ ShareManager::Directory::Ptr ShareManager::getDirectory(const string& aRealPath)
 	for (const auto& curName : tokens) {
 		curDir->updateModifyDate();
 		curDir = Directory::createNormal(DualString(curName), curDir, File::getLastModified(curDir->getRealPath()), lowerDirNameMap, *bloom.get());
+		if (curDir && searchIndex) {
+			searchIndex->addDirectory(*curDir);
+		}
 	}
 
 	return curDir;
@@ -3275,30 +4557,38 @@ void ShareManager::onFileHashed(const string& fname, HashedFile& fileInfo) noexc
 	ProfileTokenSet dirtyProfiles;
 	{
 		WLock l(cs);
+		treeRevision++;
 		auto d = getDirectory(Util::getFilePath(fname));
 		if (!d) {
 			return;
 		}
 
-		addFile(Util::getFileName(fname), d, fileInfo, tthIndex, *bloom.get(), sharedSize, &dirtyProfiles);
+		addFile(Util::getFileName(fname), d, fileInfo, tthIndex, *bloom.get(), sharedSize, &dirtyProfiles, searchIndex.get());
 	}
 
 	setProfilesDirty(dirtyProfiles, false);
 }
 
-void ShareManager::addFile(DualString&& aName, const Directory::Ptr& aDir, const HashedFile& aFileInfo, HashFileMap& tthIndex_, ShareBloom& aBloom_, int64_t& sharedSize_, ProfileTokenSet* dirtyProfiles_) noexcept {
+void ShareManager::addFile(DualString&& aName, const Directory::Ptr& aDir, const HashedFile& aFileInfo, HashFileMap& tthIndex_, ShareBloom& aBloom_, int64_t& sharedSize_, ProfileTokenSet* dirtyProfiles_, SearchIndex* searchIndex_) noexcept {
 	{
 		auto i = aDir->files.find(aName.getLower());
 		if (i != aDir->files.end()) {
 			// Get rid of false constness...
 			(*i)->cleanIndices(sharedSize_, tthIndex_);
-			delete *i;
+			if (searchIndex_) {
+				searchIndex_->removeFile(**i);
+			}
+
+			aDir->destroyFile(*i);
 			aDir->files.erase(i);
 		}
 	}
 
-	auto it = aDir->files.insert_sorted(new Directory::File(move(aName), aDir, aFileInfo)).first;
+	auto it = aDir->files.insert_sorted(aDir->createFile(move(aName), aFileInfo)).first;
 	(*it)->updateIndices(aBloom_, sharedSize_, tthIndex_);
+	if (searchIndex_) {
+		searchIndex_->addFile(**it);
+	}
 
 	if (dirtyProfiles_) {
 		aDir->copyRootProfiles(*dirtyProfiles_, true);
@@ -36,6 +36,7 @@
 #include "MerkleTree.h"
 #include "Pointer.h"
 #include "SearchQuery.h"
+#include "ShareCache.h"
 #include "ShareDirectoryInfo.h"
 #include "ShareProfile.h"
 #include "Singleton.h"
@@ -44,15 +45,20 @@
 #include "TaskQueue.h"
 #include "Thread.h"
 #include "TimerManager.h"
+#include "TrigramIndex.h"
 #include "UserConnection.h"
 
+#include <future>
+
 namespace dcpp {
 
+class DeviceTaskPool;
 class File;
 class ErrorCollector;
 class OutputStream;
 class MemoryInputStream;
 class SearchQuery;
+class ShareMonitor;
 class SharePathValidator;
 
 class FileList;
@@ -92,7 +98,8 @@ enum class ShareRefreshType : uint8_t {
 	REFRESH_INCOMING,
 	REFRESH_ALL,
 	STARTUP,
-	BUNDLE
+	BUNDLE,
+	MONITORING
 };
 
 enum class ShareRefreshPriority : uint8_t {
@@ -117,6 +124,22 @@ struct ShareRefreshTask : public Task {
 
 typedef vector<ShareRefreshTask> ShareRefreshTaskList;
 
+// Receives the content of a filelist directly from the share (the same information that would be written in the XML list)
+// The functions are called while the share is locked
+class FilelistVisitor {
+public:
+	virtual ~FilelistVisitor() { }
+
+	virtual void onListing(time_t aBaseDate) = 0;
+
+	// Content of incomplete directories isn't listed (the content info and size are set for them)
+	virtual void onDirectoryStart(const string& aName, time_t aDate, bool aIncomplete, const DirectoryContentInfo& aContentInfo, int64_t aSize) = 0;
+	virtual void onDirectoryEnd() = 0;
+
+	// The date is set only for non-recursive lists
+	virtual void onFile(const string& aName, int64_t aSize, const TTHValue& aTTH, time_t aDate) = 0;
+};
+
 class ShareManager : public Singleton<ShareManager>, public Speaker<ShareManagerListener>, private Thread, private SettingsManagerListener, 
 	private TimerManagerListener, private HashManagerListener
 {
@@ -227,9 +250,14 @@ public:
 	MemoryInputStream* generatePartialList(const string& dir, bool aRecursive, const OptionalProfileToken& aProfile) const noexcept;
 	MemoryInputStream* generateTTHList(const string& dir, bool aRecursive, ProfileToken aProfile) const noexcept;
 	MemoryInputStream* getTree(const string& virtualFile, ProfileToken aProfile) const noexcept;
-	void toFilelist(OutputStream& os_, const string& aVirtualPath, const OptionalProfileToken& aProfile, bool aRecursive) const;
+	// aUseFragments: write the top-level directories of full lists from the fragment cache (only for lists generated to a file)
+	void toFilelist(OutputStream& os_, const string& aVirtualPath, const OptionalProfileToken& aProfile, bool aRecursive, bool aUseFragments) const;
 
-	void saveXmlList(function<void (float)> progressF = nullptr) noexcept;	//for filelist caching
+	// Passes the filelist content to the visitor without generating XML
+	// Returns false if the path doesn't exist
+	bool toFilelist(FilelistVisitor& visitor_, const string& aVirtualPath, const OptionalProfileToken& aProfile, bool aRecursive) const;
+
+	void saveCache(function<void (float)> progressF = nullptr) noexcept;
 
 	// Throws ShareException
 	AdcCommand getFileInfo(const string& aFile, ProfileToken aProfile);
@@ -294,6 +322,26 @@ public:
 	};
 	optional<ShareItemStats> getShareItemStats() const noexcept;
 
+	// Estimated memory usage of the share tree and the indexes
+	struct ShareMemoryStats {
+		size_t directoryCount = 0;
+		size_t fileCount = 0;
+
+		size_t directoryBytes = 0;
+		size_t fileBytes = 0;
+		size_t nameBytes = 0;
+
+		size_t tthIndexBytes = 0;
+		size_t directoryNameIndexBytes = 0;
+		size_t bloomBytes = 0;
+		size_t searchIndexBytes = 0;
+
+		size_t getTotalBytes() const noexcept {
+			return directoryBytes + fileBytes + nameBytes + tthIndexBytes + directoryNameIndexBytes + bloomBytes + searchIndexBytes;
+		}
+	};
+	ShareMemoryStats getMemoryStats() const noexcept;
+
 	struct ShareSearchStats {
 		uint64_t totalSearches = 0;
 		double totalSearchesPerSecond = 0;
@@ -307,6 +355,22 @@ public:
 		double averageSearchTokenLength = 0;
 
 		uint64_t autoSearches = 0, tthSearches = 0;
+
+		// Searches matched via the trigram index (and the tree search with the same query rules)
+		uint64_t indexedSearches = 0;
+		double indexHitRatio = 0;
+		double indexCandidateMatchRatio = 0;
+		uint64_t averageIndexSearchMatchUs = 0;
+		uint64_t averageTreeSearchMatchUs = 0;
+		size_t indexTrigramCount = 0;
+		size_t indexPostingCount = 0;
+
+		uint64_t concurrentSearches = 0;
+
+		// Refreshes that were applied with prepared changes (and the longest time the share was locked for applying a refresh)
+		uint64_t refreshApplies = 0;
+		uint64_t preparedRefreshApplies = 0;
+		uint64_t maxRefreshApplyMs = 0;
 	};
 	ShareSearchStats getSearchMatchingStats() const noexcept;
 
@@ -347,7 +411,9 @@ public:
 
 	mutable SharedMutex cs;
 
+	struct CacheLoader;
 	struct ShareLoader;
+	struct BinaryShareLoader;
 
 	void setDefaultProfile(ProfileToken aNewDefault) noexcept;
 
@@ -375,6 +441,12 @@ private:
 	uint64_t tthSearches = 0;
 	uint64_t recursiveSearches = 0;
 	uint64_t recursiveSearchTime = 0;
+	uint64_t treeSearchTimeUs = 0;
+	uint64_t indexedSearches = 0;
+	uint64_t indexSearchTimeUs = 0;
+	uint64_t indexCandidates = 0;
+	uint64_t indexCandidateMatches = 0;
+	uint64_t concurrentSearches = 0;
 	uint64_t filteredSearches = 0;
 	uint64_t recursiveSearchesResponded = 0;
 	uint64_t searchTokenCount = 0;
@@ -390,7 +462,6 @@ private:
 			static Ptr create(const string& aRootPath, const string& aVname, const ProfileTokenSet& aProfiles, bool aIncoming, time_t aLastRefreshTime) noexcept;
 
 			GETSET(ProfileTokenSet, rootProfiles, RootProfiles);
-			IGETSET(bool, cacheDirty, CacheDirty, false);
 			IGETSET(bool, incoming, Incoming, false);
 			IGETSET(RefreshState, refreshState, RefreshState, RefreshState::STATE_NORMAL);
 			IGETSET(optional<ShareRefreshTaskToken>, refreshTaskToken, RefreshTaskToken, nullopt);
@@ -417,7 +488,18 @@ private:
 				return pathLower;
 			}
 
+			bool getCacheDirty() const noexcept { return cacheDirty; }
+
+			// Marking the cache dirty also changes the revision
+			void setCacheDirty(bool aDirty) noexcept;
+
+			// Unique among all roots, changes whenever the content is modified
+			uint64_t getRevision() const noexcept { return revision; }
+
 			void setName(const string& aName) noexcept;
+			string getCachePath() const noexcept;
+
+			// Legacy cache format (only loaded for migration)
 			string getCacheXmlPath() const noexcept;
 		private:
 			RootDirectory(const string& aRootPath, const string& aVname, const ProfileTokenSet& aProfiles, bool aIncoming, time_t aLastRefreshTime) noexcept;
@@ -425,6 +507,11 @@ private:
 			unique_ptr<DualString> virtualName;
 			const string path;
 			const string pathLower;
+
+			bool cacheDirty = false;
+			uint64_t revision;
+
+			static atomic<uint64_t> nextRevision;
 	};
 
 	typedef vector<RootDirectory::Ptr> RootDirectoryList;
@@ -453,7 +540,7 @@ private:
 			typedef SortedVector<File*, std::vector, string, Compare, NameLower> Set;
 			typedef unordered_multimap<TTHValue*, const Directory::File*> TTHMap;
 
-			File(DualString&& aName, const Directory::Ptr& aParent, const HashedFile& aFileInfo);
+			File(DualString&& aName, Directory* aParent, const HashedFile& aFileInfo);
 			~File();
 		
 			inline string getAdcPath() const noexcept{ return parent->getAdcPath() + name.getNormal(); }
@@ -474,12 +561,51 @@ private:
 			void cleanIndices(int64_t& sharedSize_, TTHMap& tthIndex_) noexcept;
 		};
 
-		class SearchResultInfo {
+		// Stores the files of a directory in contiguous blocks instead of separate heap objects
+		// The blocks are never moved so that the file pointers in the indices remain valid,
+		// slots of removed files are reused and the memory is released with the directory
+		// Same locking rules apply as for the file set of the directory
+		class FileArena {
 		public:
-			struct Sort {
-				bool operator()(const SearchResultInfo& left, const SearchResultInfo& right) const noexcept { return left.scores > right.scores; }
+			FileArena() noexcept { }
+			~FileArena();
+
+			// Make room for the given number of new files in a single block
+			void reserve(size_t aCount) noexcept;
+
+			File* create(DualString&& aName, Directory* aParent, const HashedFile& aFileInfo);
+			void destroy(File* aFile) noexcept;
+
+			// Bytes allocated for the blocks and the free slot list
+			size_t getAllocatedBytes() const noexcept;
+
+			FileArena(FileArena&) = delete;
+			FileArena& operator=(FileArena&) = delete;
+		private:
+			typedef std::aligned_storage<sizeof(File), alignof(File)>::type Slot;
+
+			struct Block {
+				unique_ptr<Slot[]> slots;
+				uint32_t firstIndex;
+				uint32_t capacity;
+				uint32_t used;
 			};
 
+			void addBlock(uint32_t aCapacity) noexcept;
+			File* getSlot(uint32_t aIndex) noexcept;
+			uint32_t getIndex(const File* aFile) const noexcept;
+
+			vector<Block> blocks;
+
+			// Indices of the slots that have been released
+			vector<uint32_t> freeSlots;
+
+			uint32_t capacity = 0;
+			uint32_t fileCount = 0;
+		};
+
+		class SearchResultInfo {
+		public:
 			explicit SearchResultInfo(const File* f, const SearchQuery& aSearch, int aLevel) :
 				file(f), type(FILE), scores(SearchQuery::getRelevanceScore(aSearch, aLevel, false, f->name.getLower())) {
 
@@ -490,7 +616,6 @@ private:
 
 			}
 
-			typedef multiset<SearchResultInfo, Sort> Set;
 			enum Type: uint8_t {
 				FILE,
 				DIRECTORY
@@ -502,11 +627,58 @@ private:
 			};
 
 			Type getType() const noexcept { return type; }
+			double getScores() const noexcept { return scores; }
 		private:
-			const Type type;
+			Type type;
 			double scores;
 		};
 
+		// Keeps the best scoring results in a bounded heap
+		class SearchResults {
+		public:
+			// Lowest score of all full result lists that are being filled concurrently
+			typedef atomic<double> SharedMinScores;
+
+			// Results aren't limited if aMaxResults is 0
+			explicit SearchResults(size_t aMaxResults, SharedMinScores* aSharedMinScores = nullptr) noexcept : maxResults(aMaxResults), sharedMinScores(aSharedMinScores) { }
+
+			// Returns false if items scoring at most aMaxScores can't get in the list
+			bool canImprove(double aMaxScores) const noexcept;
+
+			// Removes the lowest scoring result if the list is full
+			// Results with identical scores are kept in the order they were added
+			void add(SearchResultInfo&& aResult) noexcept;
+			void merge(const SearchResults& aOther) noexcept;
+
+			// Best results first
+			vector<SearchResultInfo> getSorted() const noexcept;
+
+			size_t getMaxResults() const noexcept { return maxResults; }
+			size_t size() const noexcept { return results.size(); }
+
+			// Lower scoring results may have been dropped (or skipped without matching)
+			bool isFull() const noexcept { return maxResults > 0 && results.size() >= maxResults; }
+		private:
+			struct Entry {
+				SearchResultInfo info;
+				size_t order;
+			};
+
+			struct IsBetter {
+				bool operator()(const Entry& a, const Entry& b) const noexcept {
+					return a.info.getScores() > b.info.getScores() || (a.info.getScores() == b.info.getScores() && a.order < b.order);
+				}
+			};
+
+			const size_t maxResults;
+			SharedMinScores* const sharedMinScores;
+
+			size_t addedCount = 0;
+
+			// The lowest scoring result is kept first
+			vector<Entry> results;
+		};
+
 		typedef SortedVector<Ptr, std::vector, string, Compare, NameLower> Set;
 		File::Set files;
 
@@ -520,6 +692,9 @@ private:
 		// Remove directory from possible parent and all shared containers
 		static void cleanIndices(Directory& aDirectory, int64_t& sharedSize_, File::TTHMap& tthIndex_, Directory::MultiMap& aDirNames_) noexcept;
 
+		// Remove directory from possible parent (shared containers must be cleaned separately)
+		static void removeFromParent(Directory& aDirectory) noexcept;
+
 		struct HasRootProfile {
 			HasRootProfile(const OptionalProfileToken& aProfile) : profile(aProfile) { }
 			bool operator()(const Ptr& d) const noexcept {
@@ -549,14 +724,21 @@ private:
 
 		void getProfileInfo(ProfileToken aProfile, int64_t& totalSize, size_t& filesCount) const noexcept;
 
-		void search(SearchResultInfo::Set& aResults, SearchQuery& aStrings, int aLevel) const noexcept;
+		// Directories and files that can't get in the results are skipped
+		void search(SearchResults& results_, SearchQuery& aStrings, int aLevel) const noexcept;
 
 		void toFileList(FilelistDirectory& aListDir, bool aRecursive);
 		void toTTHList(OutputStream& tthList, string& tmp2, bool recursive) const;
 
-		//for file list caching
-		void toXmlList(OutputStream& xmlFile, string& indent, string& tmp);
-		void filesToXmlList(OutputStream& xmlFile, string& indent, string& tmp2) const;
+		// Add the directory tree in the share cache
+		void toCache(ShareCache::Writer& aWriter, uint32_t aParent) const noexcept;
+
+		// Files must be allocated and released through the directory (the file set isn't updated)
+		File* createFile(DualString&& aName, const HashedFile& aFileInfo) { return fileArena.create(move(aName), this, aFileInfo); }
+		void destroyFile(File* aFile) noexcept { fileArena.destroy(aFile); }
+
+		// Prepare for adding the given number of files
+		void reserveFiles(size_t aCount) noexcept;
 
 		GETSET(time_t, lastWrite, LastWrite);
 
@@ -568,6 +750,7 @@ private:
 		//void addBloom(ShareBloom& aBloom) const noexcept;
 
 		void countStats(time_t& totalAge_, size_t& totalDirs_, int64_t& totalSize_, size_t& totalFiles, size_t& lowerCaseFiles, size_t& totalStrLen_) const noexcept;
+		void countMemoryUsage(ShareMemoryStats& stats_) const noexcept;
 		DualString realName;
 
 		// check for an updated modify date from filesystem
@@ -616,6 +799,8 @@ private:
 		int64_t size = 0;
 		RootDirectory::Ptr root;
 
+		FileArena fileArena;
+
 		Directory(DualString&& aRealName, const Ptr& aParent, time_t aLastWrite, const RootDirectory::Ptr& aRoot = nullptr);
 		friend void intrusive_ptr_release(intrusive_ptr_base<Directory>*);
 
@@ -636,8 +821,91 @@ private:
 
 		void toXml(OutputStream& xmlFile, string& indent, string& tmp2, bool fullList) const;
 		void filesToXml(OutputStream& xmlFile, string& indent, string& tmp2, bool addDate) const;
+
+		void toVisitor(FilelistVisitor& visitor_, bool aRecursive) const;
+		void filesToVisitor(FilelistVisitor& visitor_, bool aAddDate) const;
+	private:
+		void getContentInfo(int64_t& size_, size_t& files_, size_t& directories_) const noexcept;
+
+		// Skips files that exist in multiple merged directories
+		template<class FileF>
+		void forEachFile(FileF aFileF) const;
+	};
+
+	// Collects the directories of a virtual path (the share must be locked)
+	// Returns false if the path doesn't exist
+	bool prepareFilelist(FilelistDirectory& listRoot_, const string& aVirtualPath, const OptionalProfileToken& aProfile, bool aRecursive) const noexcept;
+
+	// Inverted name index for directories and files that are currently in share
+	class SearchIndex : boost::noncopyable {
+	public:
+		typedef TrigramIndex<Directory> DirectoryIndex;
+		typedef TrigramIndex<Directory::File> FileIndex;
+
+		void addDirectory(const Directory& aDirectory) noexcept;
+		void removeDirectory(const Directory& aDirectory) noexcept;
+
+		void addFile(const Directory::File& aFile) noexcept;
+		void removeFile(const Directory::File& aFile) noexcept;
+
+		// Recursive
+		void addTree(const Directory& aDirectory) noexcept;
+		void removeTree(const Directory& aDirectory) noexcept;
+
+		// Add items from the refresh maps
+		void addItems(const Directory::MultiMap& aDirectories, const Directory::File::TTHMap& aFiles) noexcept;
+
+		// Index changes that can be collected without modifying the index
+		struct PreparedChanges {
+			DirectoryIndex::GroupedItems removedDirectories, addedDirectories;
+			FileIndex::GroupedItems removedFiles, addedFiles;
+
+			// Posting lists with all changes applied
+			DirectoryIndex::MergedItems mergedDirectories;
+			FileIndex::MergedItems mergedFiles;
+		};
+
+		static void prepareRemoved(const Directory& aDirectory, PreparedChanges& changes_) noexcept;
+		static void prepareAdded(const Directory::MultiMap& aDirectories, const Directory::File::TTHMap& aFiles, PreparedChanges& changes_) noexcept;
+
+		// Build the updated posting lists (requires read access to the index)
+		void prepareMerged(PreparedChanges& changes_) const noexcept;
+
+		// Swap the updated posting lists in place (the index must not have been modified after the changes were prepared)
+		void applyPrepared(PreparedChanges& aChanges) noexcept;
+
+		// Remove only the old content (when the new content can't be added)
+		void removePrepared(const PreparedChanges& aChanges) noexcept;
+
+		struct MatchStats {
+			uint64_t candidates = 0;
+			uint64_t matches = 0;
+		};
+
+		// Match the search via the index
+		// Returns false if the search can't be matched via the index (the tree search should be used instead)
+		bool search(const Directory::List& aRoots, Directory::SearchResults& results_, SearchQuery& aSearch, MatchStats& stats_) const noexcept;
+
+		const DirectoryIndex& getDirectories() const noexcept { return directories; }
+		const FileIndex& getFiles() const noexcept { return files; }
+	private:
+		static void collectItems(const Directory& aDirectory, DirectoryIndex::NameItemList& directories_, FileIndex::NameItemList& files_) noexcept;
+		static void collectItems(const Directory::MultiMap& aDirectories, const Directory::File::TTHMap& aFiles, DirectoryIndex::NameItemList& directories_, FileIndex::NameItemList& files_) noexcept;
+
+		// Returns the search level for an item inside aDirectory (nullopt if the item isn't inside the search roots or one of the parents is excluded)
+		// Also returns nullopt if any of the parents exists in aSkipParents
+		typedef unordered_set<const Directory*> DirectorySet;
+		static optional<int> getSearchLevel(const Directory* aDirectory, const DirectorySet& aRoots, const DirectorySet& aSkipParents, const SearchQuery& aSearch) noexcept;
+
+		DirectoryIndex directories;
+		FileIndex files;
 	};
 
+	unique_ptr<SearchIndex> searchIndex;
+
+	// Search each root in a separate task and merge the best results
+	static void searchRootsConcurrently(const Directory::List& aRoots, Directory::SearchResults& results_, const SearchQuery& aSearch) noexcept;
+
 	ShareDirectoryInfoPtr getRootInfo(const Directory::Ptr& aDir) const noexcept;
 
 	void addAsyncTask(AsyncF aF) noexcept;
@@ -669,10 +937,28 @@ private:
 	// Throws ShareException
 	FileList* generateXmlList(ProfileToken aProfile, bool aForced = false);
 
+	// Rendered XML of top-level directories in full filelists (shared between the profiles)
+	// The fragments are valid as long as the revisions of the included roots don't change
+	struct FilelistFragment {
+		string path;
+		vector<uint64_t> rootRevisions;
+	};
+
+	mutable unordered_map<string, FilelistFragment> filelistFragments;
+	mutable uint64_t filelistFragmentCounter = 0;
+	mutable CriticalSection filelistFragmentCS;
+
+	// Writes a recursive top-level directory from the fragment cache (the subdirectories are added to the list directory only when it needs to be rendered)
+	// The directory is rendered directly if the cache can't be used
+	// Throws FileException if reading a fragment fails after a part of it has been written already
+	void writeFilelistFragment(OutputStream& os_, FilelistDirectory& aListDir, string& indent_, string& tmp_) const;
+	void removeStaleFilelistFragments() const noexcept;
+	static void deleteFilelistFragments() noexcept;
+
 	// Throws ShareException
 	FileList* getFileList(ProfileToken aProfile) const;
 
-	bool loadCache(function<void(float)> progressF) noexcept;
+	bool loadCache(StartupLoader& aLoader) noexcept;
 	
 	static atomic_flag tasksRunning;
 	bool refreshRunning = false;
@@ -681,7 +967,7 @@ private:
 	uint64_t lastIncomingUpdate = GET_TICK();
 	uint64_t lastSave = 0;
 	
-	bool xml_saving = false;
+	bool cacheSaving = false;
 
 	// Map real name to virtual name - multiple real names may be mapped to a single virtual one
 	Directory::Map rootPaths;
@@ -707,22 +993,77 @@ private:
 
 		ShareManager::ShareBloom& bloom;
 
-		void applyRefreshChanges(Directory::MultiMap& lowerDirNameMap_, Directory::Map& rootPaths_, HashFileMap& tthIndex_, int64_t& sharedBytes_, ProfileTokenSet* dirtyProfiles) noexcept;
+		void applyRefreshChanges(Directory::MultiMap& lowerDirNameMap_, Directory::Map& rootPaths_, HashFileMap& tthIndex_, int64_t& sharedBytes_, ProfileTokenSet* dirtyProfiles, SearchIndex* searchIndex_) noexcept;
 		bool checkContent(const Directory::Ptr& aDirectory) noexcept;
+
+		// Changes collected while holding the read lock so that the write lock is only needed for modifying the containers
+		// Items of the old directory can only be used if the share tree hasn't been modified after they were collected
+		struct PreparedChanges {
+			uint64_t treeRevision = 0;
+
+			vector<HashFileMap::const_iterator> removedFiles;
+			vector<Directory::MultiMap::const_iterator> removedDirectories;
+			int64_t removedSize = 0;
+
+			SearchIndex::PreparedChanges searchIndex;
+		};
+
+		unique_ptr<PreparedChanges> preparedChanges;
 	};
 
 	class ShareBuilder : public RefreshInfo {
 	public:
-		ShareBuilder(const string& aPath, const Directory::Ptr& aOldRoot, time_t aLastWrite, ShareBloom& bloom_, ShareManager* sm);
+		// Directories are listed via the scan pool when one is provided (otherwise on the calling thread)
+		ShareBuilder(const string& aPath, const Directory::Ptr& aOldRoot, time_t aLastWrite, ShareBloom& bloom_, ShareManager* sm, DeviceTaskPool* aScanPool);
 
 		// Recursive function for building a new share tree from a path
 		bool buildTree(const bool& aStopping) noexcept;
 	private:
-		void buildTree(const string& aPath, const string& aPathLower, const Directory::Ptr& aCurrentDirectory, const Directory::Ptr& aOldDirectory, const bool& aStopping);
+		// Directory item with the file system information cached
+		// (the builder won't access the file system for listed items)
+		class ScannedItem : public FileItemInfoBase {
+		public:
+			ScannedItem(string&& aName, const FileItemInfoBase& aInfo) noexcept;
+
+			const string name;
+
+			bool isDirectory() const noexcept override { return directory; }
+			bool isHidden() const noexcept override { return hidden; }
+			bool isLink() const noexcept override { return link; }
+			int64_t getSize() const noexcept override { return size; }
+			time_t getLastWriteTime() const noexcept override { return lastWriteTime; }
+		private:
+			const bool directory;
+			const bool hidden;
+			const bool link;
+			const int64_t size;
+			const time_t lastWriteTime;
+		};
+
+		typedef vector<ScannedItem> ScannedItemList;
+		typedef std::future<ScannedItemList> ScanResult;
+
+		// Directories are listed in the background while their parents and preceding siblings are being processed
+		struct PendingDirectory {
+			string path;
+			string pathLower;
+			Directory::Ptr directory;
+			Directory::Ptr oldDirectory;
+			bool isNew;
+			ScanResult content;
+		};
+
+		ScanResult scanDirectory(const string& aPath, const bool& aStopping) noexcept;
+		static ScannedItemList listDirectory(const string& aPath, const bool& aStopping);
+
+		void buildTree(const string& aPath, const string& aPathLower, const Directory::Ptr& aCurrentDirectory, const Directory::Ptr& aOldDirectory, const ScannedItemList& aItems, const bool& aStopping);
 
 		bool validateFileItem(const FileItemInfoBase& aFileItem, const string& aPath, bool aIsNew, bool aNewParent, ErrorCollector& aErrorCollector) noexcept;
 
 		const ShareManager& sm;
+
+		DeviceTaskPool* const scanPool;
+		int64_t deviceId = 0;
 	};
 
 	typedef shared_ptr<ShareBuilder> ShareBuilderPtr;
@@ -730,6 +1071,17 @@ private:
 
 	bool applyRefreshChanges(RefreshInfo& ri, ProfileTokenSet* aDirtyProfiles);
 
+	// Collect the changes that can be done without the write lock (the read lock must be held)
+	void prepareRefreshChanges(RefreshInfo& ri) const noexcept;
+	static void collectRemovedItems(const Directory& aDirectory, const HashFileMap& aTTHIndex, const Directory::MultiMap& aDirNames, RefreshInfo::PreparedChanges& changes_) noexcept;
+
+	// Incremented whenever the directory tree or its containers are modified (write lock must be held)
+	uint64_t treeRevision = 0;
+
+	uint64_t refreshApplies = 0;
+	uint64_t preparedRefreshApplies = 0;
+	uint64_t maxRefreshApplyTime = 0;
+
 	// Display a log message if the refresh can't be started immediately
 	void reportPendingRefresh(ShareRefreshType aTask, const RefreshPathList& aDirectories, const string& displayName) const noexcept;
 
@@ -743,7 +1095,7 @@ private:
 	// Safe to call with non-root directories
 	void setRefreshState(const string& aPath, RefreshState aState, bool aUpdateRefreshTime, const optional<ShareRefreshTaskToken>& aRefreshTaskToken) noexcept;
 
-	static void addFile(DualString&& aName, const Directory::Ptr& aDir, const HashedFile& fi, HashFileMap& tthIndex_, ShareBloom& aBloom_, int64_t& sharedSize_, ProfileTokenSet* dirtyProfiles_ = nullptr) noexcept;
+	static void addFile(DualString&& aName, const Directory::Ptr& aDir, const HashedFile& fi, HashFileMap& tthIndex_, ShareBloom& aBloom_, int64_t& sharedSize_, ProfileTokenSet* dirtyProfiles_ = nullptr, SearchIndex* searchIndex_ = nullptr) noexcept;
 
 	static void addDirName(const Directory::Ptr& dir, Directory::MultiMap& aDirNames, ShareBloom& aBloom) noexcept;
 	static void removeDirName(const Directory& dir, Directory::MultiMap& aDirNames) noexcept;
@@ -845,8 +1197,28 @@ private:
 	void on(SettingsManagerListener::LoadCompleted, bool aFileLoaded) noexcept override;
 	
 	// TimerManagerListener
+	void on(TimerManagerListener::Second, uint64_t aTick) noexcept override;
 	void on(TimerManagerListener::Minute, uint64_t aTick) noexcept override;
 
+	// Refreshes the directories that have been changed on disk (optional)
+	unique_ptr<ShareMonitor> monitor;
+
+	void startMonitoring() noexcept;
+	void handleMonitorChanges(uint64_t aTick) noexcept;
+
+	// Watch the refreshed directories (including their subdirectories)
+	void addMonitoredDirectories(const RefreshPathList& aPaths) noexcept;
+	static void getDirectoryPaths(const Directory& aDirectory, const string& aPath, StringList& paths_) noexcept;
+
+	uint64_t monitorRefreshTasks = 0;
+	uint64_t monitorRefreshedDirectories = 0;
+	uint64_t monitorFullRefreshes = 0;
+	uint64_t monitorRefreshTime = 0;
+
+	// Estimated by comparing with the duration of the previous full refresh
+	uint64_t monitorTimeSaved = 0;
+	uint64_t lastFullRefreshDuration = 0;
+
 	void load(SimpleXML& aXml);
 	void loadProfile(SimpleXML& aXml, const string& aName, ProfileToken aToken);
 	void save(SimpleXML& aXml);
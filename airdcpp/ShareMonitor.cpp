@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "ShareMonitor.h"
+
+#include "AirUtil.h"
+#include "TimerManager.h"
+#include "Util.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace dcpp {
+
+#ifdef __linux__
+// Content changes (file writes are reported only after the file has been closed)
+static const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+	// The watched directory itself
+	IN_DELETE_SELF | IN_MOVE_SELF |
+	IN_ONLYDIR | IN_EXCL_UNLINK;
+#endif
+
+ShareMonitor::ShareMonitor() noexcept {
+
+}
+
+ShareMonitor::~ShareMonitor() {
+	stop();
+}
+
+bool ShareMonitor::isSupported() noexcept {
+#ifdef __linux__
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool ShareMonitor::start() noexcept {
+#ifdef __linux__
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd == -1) {
+		return false;
+	}
+
+	try {
+		Thread::start();
+	} catch (const ThreadException&) {
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+void ShareMonitor::stop() noexcept {
+	if (fd == -1) {
+		return;
+	}
+
+	stopping = true;
+	join();
+
+#ifdef __linux__
+	// Closing the descriptor removes all watches
+	::close(fd);
+#endif
+	fd = -1;
+
+	Lock l(cs);
+	watchPaths.clear();
+	pathWatches.clear();
+	changedDirectories.clear();
+}
+
+void ShareMonitor::addDirectories(const StringList& aPaths) noexcept {
+#ifdef __linux__
+	if (fd == -1) {
+		return;
+	}
+
+	for (const auto& path : aPaths) {
+		dcassert(!path.empty() && path.back() == PATH_SEPARATOR);
+
+		// Adding an existing path returns the previous watch
+		auto wd = inotify_add_watch(fd, path.c_str(), WATCH_MASK);
+
+		Lock l(cs);
+		if (wd == -1) {
+			stats.failedWatches++;
+			continue;
+		}
+
+		auto p = watchPaths.find(wd);
+		if (p != watchPaths.end()) {
+			// Watches are per inode, the directory may have been moved
+			if (p->second == path) {
+				continue;
+			}
+
+			pathWatches.erase(p->second);
+		}
+
+		watchPaths[wd] = path;
+		pathWatches[path] = wd;
+	}
+#endif
+}
+
+void ShareMonitor::removeDirectory(const string& aPath) noexcept {
+#ifdef __linux__
+	vector<int> removed;
+
+	{
+		Lock l(cs);
+		for (const auto& w : watchPaths) {
+			if (AirUtil::isParentOrExactLocal(aPath, w.second)) {
+				removed.push_back(w.first);
+			}
+		}
+
+		for (auto wd : removed) {
+			removeWatch(wd);
+		}
+	}
+
+	for (auto wd : removed) {
+		inotify_rm_watch(fd, wd);
+	}
+#endif
+}
+
+void ShareMonitor::removeWatch(int aWatch) noexcept {
+	auto p = watchPaths.find(aWatch);
+	if (p == watchPaths.end()) {
+		return;
+	}
+
+	auto i = pathWatches.find(p->second);
+	if (i != pathWatches.end() && i->second == aWatch) {
+		pathWatches.erase(i);
+	}
+
+	watchPaths.erase(p);
+}
+
+void ShareMonitor::addChange(const string& aPath, uint64_t aTick) noexcept {
+	stats.events++;
+
+	auto p = changedDirectories.find(aPath);
+	if (p != changedDirectories.end()) {
+		stats.coalescedEvents++;
+		p->second = aTick;
+	} else {
+		changedDirectories.emplace(aPath, aTick);
+	}
+}
+
+StringList ShareMonitor::getChangedDirectories(uint64_t aTick, uint64_t aDelayMs, bool& overflow_) noexcept {
+	StringList ret;
+
+	Lock l(cs);
+	overflow_ = overflow;
+	overflow = false;
+
+	for (auto i = changedDirectories.begin(); i != changedDirectories.end();) {
+		if (i->second + aDelayMs <= aTick) {
+			ret.push_back(i->first);
+			i = changedDirectories.erase(i);
+		} else {
+			++i;
+		}
+	}
+
+	return ret;
+}
+
+ShareMonitor::Stats ShareMonitor::getStats() const noexcept {
+	Lock l(cs);
+	auto ret = stats;
+	ret.watchCount = watchPaths.size();
+	return ret;
+}
+
+int ShareMonitor::run() {
+#ifdef __linux__
+	// Enough for multiple events with maximum name length
+	alignas(struct inotify_event) char buf[16 * 1024];
+
+	while (!stopping) {
+		pollfd pfd = { fd, POLLIN, 0 };
+		auto ret = poll(&pfd, 1, 500);
+		if (ret <= 0) {
+			continue;
+		}
+
+		auto len = read(fd, buf, sizeof(buf));
+		if (len <= 0) {
+			continue;
+		}
+
+		auto tick = GET_TICK();
+
+		Lock l(cs);
+		for (auto ptr = buf; ptr < buf + len; ) {
+			const auto event = reinterpret_cast<const struct inotify_event*>(ptr);
+			ptr += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				stats.overflows++;
+				overflow = true;
+				continue;
+			}
+
+			if (event->mask & IN_IGNORED) {
+				// Deleted or removed by us
+				removeWatch(event->wd);
+				continue;
+			}
+
+			auto p = watchPaths.find(event->wd);
+			if (p == watchPaths.end()) {
+				continue;
+			}
+
+			if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+				// The parent directory is also watched unless this is a root
+				// A moved directory will be watched again after its new parent has been refreshed
+				addChange(Util::getParentDir(p->second), tick);
+				if (event->mask & IN_MOVE_SELF) {
+					inotify_rm_watch(fd, event->wd);
+				}
+
+				continue;
+			}
+
+			addChange(p->second, tick);
+		}
+	}
+#endif
+
+	return 0;
+}
+
+} // namespace dcpp
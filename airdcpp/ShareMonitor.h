@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_SHARE_MONITOR_H
+#define DCPLUSPLUS_DCPP_SHARE_MONITOR_H
+
+#include "CriticalSection.h"
+#include "Thread.h"
+
+#include "typedefs.h"
+
+namespace dcpp {
+
+/* Collects the shared directories that have been modified on disk (inotify on Linux, unsupported on other platforms)
+   Directories aren't watched recursively by the kernel so each shared directory must be added separately.
+   Events are coalesced per directory and the directories are returned only after their changes have settled. */
+
+class ShareMonitor : private Thread {
+public:
+	struct Stats {
+		// Received file system events (and events for directories that were already pending)
+		uint64_t events = 0;
+		uint64_t coalescedEvents = 0;
+
+		// Lost events (a full refresh is needed)
+		uint64_t overflows = 0;
+
+		size_t watchCount = 0;
+		uint64_t failedWatches = 0;
+	};
+
+	ShareMonitor() noexcept;
+	~ShareMonitor();
+
+	static bool isSupported() noexcept;
+
+	// Returns false if monitoring isn't supported or the watcher couldn't be initialized
+	bool start() noexcept;
+	void stop() noexcept;
+
+	// Paths must end with a path separator
+	void addDirectories(const StringList& aPaths) noexcept;
+
+	// Remove watches from the path and all its subdirectories
+	void removeDirectory(const string& aPath) noexcept;
+
+	// Returns directories without new events during the last aDelayMs milliseconds
+	// overflow_ will be set if events were lost after the previous call (the returned directories can't be considered complete)
+	StringList getChangedDirectories(uint64_t aTick, uint64_t aDelayMs, bool& overflow_) noexcept;
+
+	Stats getStats() const noexcept;
+private:
+	int run() override;
+
+	// The lock must be held
+	void addChange(const string& aPath, uint64_t aTick) noexcept;
+	void removeWatch(int aWatch) noexcept;
+
+	mutable CriticalSection cs;
+
+	unordered_map<int, string> watchPaths;
+	unordered_map<string, int> pathWatches;
+
+	unordered_map<string, uint64_t> changedDirectories;
+	bool overflow = false;
+
+	Stats stats;
+
+	int fd = -1;
+	atomic<bool> stopping = { false };
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_SHARE_MONITOR_H)
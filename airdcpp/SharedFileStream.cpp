@@ -31,6 +31,25 @@ CriticalSection SharedFileStream::cs;
 SharedFileStream::SharedFileHandleMap SharedFileStream::readpool;
 SharedFileStream::SharedFileHandleMap SharedFileStream::writepool;
 
+atomic<uint64_t> SharedFileStream::reads(0);
+atomic<uint64_t> SharedFileStream::writes(0);
+atomic<uint64_t> SharedFileStream::concurrentOperations(0);
+
+class SharedFileStream::OperationCounter {
+public:
+	OperationCounter(SharedFileHandle* aHandle) noexcept : sfh(aHandle) {
+		if (sfh->activeOperations++ > 0) {
+			concurrentOperations++;
+		}
+	}
+
+	~OperationCounter() {
+		sfh->activeOperations--;
+	}
+private:
+	SharedFileHandle* sfh;
+};
+
 SharedFileHandle::SharedFileHandle(const string& aPath, int aAccess, int aMode) : 
 	File(aPath, aAccess, aMode), ref_cnt(1), path(aPath), mode(aMode)
 { }
@@ -59,20 +78,20 @@ SharedFileStream::~SharedFileStream() {
 }
 
 size_t SharedFileStream::write(const void* buf, size_t len) {
-	Lock l(sfh->cs);
+	OperationCounter c(sfh);
+	writes++;
 
-	sfh->setPos(pos);
-	sfh->write(buf, len);
+	sfh->writeAt(buf, len, pos);
 
     pos += len;
 	return len;
 }
 
 size_t SharedFileStream::read(void* buf, size_t& len) {
-	Lock l(sfh->cs);
+	OperationCounter c(sfh);
+	reads++;
 
-	sfh->setPos(pos);
-	len = sfh->read(buf, len);
+	len = sfh->readAt(buf, len, pos);
 
     pos += len;
 	return len;
@@ -97,4 +116,12 @@ void SharedFileStream::setPos(int64_t aPos) noexcept {
 	pos = aPos;
 }
 
+SharedFileStream::Stats SharedFileStream::getStats() noexcept {
+	Stats ret;
+	ret.reads = reads;
+	ret.writes = writes;
+	ret.concurrentOperations = concurrentOperations;
+	return ret;
+}
+
 }
@@ -31,16 +31,29 @@ struct SharedFileHandle : File {
 	SharedFileHandle(const string& aPath, int access, int mode);
 	~SharedFileHandle() noexcept { }
 
+	// Reads and writes use positional I/O and don't need to be locked
 	CriticalSection cs;
 	int	ref_cnt;
 	string path;
 	int mode;
+
+	// Reads and writes that are currently in progress
+	atomic<int> activeOperations = { 0 };
 };
 
 class SharedFileStream : public IOStream
 {
 
 public:
+	struct Stats {
+		uint64_t reads = 0;
+		uint64_t writes = 0;
+
+		// Operations that were started while another operation of the same file was in progress
+		// (these would have had to wait for the file lock with shared file positions)
+		uint64_t concurrentOperations = 0;
+	};
+
 	typedef unordered_map<string, unique_ptr<SharedFileHandle>, noCaseStringHash, noCaseStringEq> SharedFileHandleMap;
 
     SharedFileStream(const string& aFileName, int access, int mode);
@@ -59,9 +72,17 @@ public:
 	static SharedFileHandleMap writepool;
 
 	void setPos(int64_t aPos) noexcept override;
+
+	static Stats getStats() noexcept;
 private:
 	SharedFileHandle* sfh;
 	int64_t pos;
+
+	class OperationCounter;
+
+	static atomic<uint64_t> reads;
+	static atomic<uint64_t> writes;
+	static atomic<uint64_t> concurrentOperations;
 };
 
 }
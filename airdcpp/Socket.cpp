@@ -20,11 +20,23 @@
 #include "Socket.h"
 
 #include "ConnectivityManager.h"
+#include "File.h"
 #include "format.h"
 #include "SettingsManager.h"
 #include "TimerManager.h"
 #include "ResourceManager.h"
 
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+
+// Multiple datagrams with a single call (sendmmsg/recvmmsg)
+#define HAVE_SENDMMSG
+#endif
+
 /// @todo remove when MinGW has this
 #ifdef __MINGW32__
 #ifndef EADDRNOTAVAIL
@@ -116,6 +128,37 @@ inline int setSocketOpt2(socket_t sock, int level, int option, int val) {
 	return ::setsockopt(sock, level, option, (char*)&val, len);
 }
 
+#ifndef _WIN32
+
+// select can't be used with descriptors above FD_SETSIZE
+inline bool isConnected(socket_t sock) {
+	pollfd pfd = { sock, POLLOUT, 0 };
+	if(::poll(&pfd, 1, 0) == 1 && (pfd.revents & (POLLOUT | POLLERR | POLLHUP))) {
+		if (getSocketOptInt2(sock, SO_ERROR) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+inline socket_t readable(socket_t sock0, socket_t sock1) {
+	if (sock0 == INVALID_SOCKET) {
+		return sock1;
+	} else if (sock1 == INVALID_SOCKET) {
+		return sock0;
+	}
+
+	pollfd pfd[2] = { { sock0, POLLIN, 0 }, { sock1, POLLIN, 0 } };
+	if(::poll(pfd, 2, 0) > 0) {
+		return pfd[0].revents != 0 ? sock0 : sock1;
+	}
+
+	return sock0;
+}
+
+#else
+
 inline bool isConnected(socket_t sock) {
 	fd_set wfd;
 	struct timeval tv = { 0 };
@@ -154,6 +197,8 @@ inline socket_t readable(socket_t sock0, socket_t sock1) {
 	return sock0;
 }
 
+#endif
+
 }
 
 Socket::addr Socket::udpAddr;
@@ -163,6 +208,7 @@ socklen_t Socket::udpAddrLen;
 
 SocketException::SocketException(int aError) noexcept {
 	errorString = "SocketException: " + errorToString(aError);
+	errorCode = aError;
 	dcdebug("Thrown: %s\n", errorString.c_str());
 }
 
@@ -214,7 +260,11 @@ string SocketException::errorToString(int aError) noexcept {
 socket_t Socket::setSock(socket_t s, int af) {
 	setBlocking2(s, false);
 	setSocketOpt2(s, SOL_SOCKET, SO_REUSEADDR, 1);
-
+#ifdef SO_REUSEPORT
+	if(reusePort) {
+		setSocketOpt2(s, SOL_SOCKET, SO_REUSEPORT, 1);
+	}
+#endif
 
 	if(af == AF_INET) {
 		dcassert(sock4 == INVALID_SOCKET);
@@ -613,6 +663,52 @@ int Socket::read(void* aBuffer, int aBufLen, string &aIP) {
 	return len;
 }
 
+int Socket::read(vector<Datagram>& datagrams_) {
+	dcassert(type == TYPE_UDP);
+	if (datagrams_.empty()) {
+		return -1;
+	}
+
+#ifdef HAVE_SENDMMSG
+	const size_t MAX_BATCH = 64;
+	auto count = min(MAX_BATCH, datagrams_.size());
+
+	mmsghdr msgs[MAX_BATCH];
+	iovec iov[MAX_BATCH];
+	addr remoteAddrs[MAX_BATCH];
+
+	memset(msgs, 0, sizeof(mmsghdr) * count);
+	for (size_t i = 0; i < count; ++i) {
+		auto& d = datagrams_[i];
+		iov[i].iov_base = d.buffer.data();
+		iov[i].iov_len = d.buffer.size();
+
+		msgs[i].msg_hdr.msg_name = &remoteAddrs[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(addr);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	// The sockets are non-blocking, this returns the datagrams that are available currently
+	auto received = check([&] {
+		return ::recvmmsg(readable(sock4, sock6), msgs, count, 0, nullptr);
+	}, true);
+
+	for (int i = 0; i < received; ++i) {
+		auto& d = datagrams_[i];
+		d.len = static_cast<int>(msgs[i].msg_len);
+		d.ip = resolveName(&remoteAddrs[i].sa, msgs[i].msg_hdr.msg_namelen);
+		stats.totalDown += d.len;
+	}
+
+	return received;
+#else
+	auto& d = datagrams_.front();
+	d.len = read(d.buffer.data(), static_cast<int>(d.buffer.size()), d.ip);
+	return d.len > 0 ? 1 : d.len;
+#endif
+}
+
 int Socket::socksRead(ByteVector& aBuffer, int aBufLen, std::function<bool(const ByteVector& aBuffer, int aBufLen)>&& aIsComplete, uint64_t aTimeout) {
 	int i = 0;
 	while (i <= 0 || !aIsComplete(aBuffer, i)) {
@@ -665,6 +761,29 @@ int Socket::write(const void* aBuffer, int aLen) {
 	return sent;
 }
 
+bool Socket::isSendFileSupported() const noexcept {
+#ifdef __linux__
+	return type == TYPE_TCP;
+#else
+	return false;
+#endif
+}
+
+int Socket::sendFile(File& aFile, size_t aLen) {
+#ifdef __linux__
+	// The file position is updated
+	auto sent = check([&] { return static_cast<int>(::sendfile(getSock(), aFile.getNativeHandle(), nullptr, aLen)); }, true);
+	if(sent > 0) {
+		stats.totalUp += sent;
+	}
+
+	return sent;
+#else
+	dcassert(0);
+	throw SocketException(EINVAL);
+#endif
+}
+
 /**
  * Sends data, will block until all data has been sent or an exception occurs
  * @param aBuffer Buffer with data
@@ -739,6 +858,77 @@ void Socket::writeTo(const string& aAddr, const string& aPort, const void* aBuff
 	stats.totalUp += sent;
 }
 
+int Socket::writeTo(const string& aAddr, const string& aPort, const StringList& aPackets) {
+	if (aPackets.empty())
+		return 0;
+
+	if(aAddr.empty() || aPort.empty()) {
+		throw SocketException(EADDRNOTAVAIL);
+	}
+
+	if (CONNSETTING(OUTGOING_CONNECTIONS) == SettingsManager::OUTGOING_SOCKS5 && socksUdpInitialized()) {
+		// Each packet needs its own SOCKS header
+		for (const auto& p: aPackets) {
+			writeTo(aAddr, aPort, p);
+		}
+
+		return static_cast<int>(aPackets.size());
+	}
+
+	auto ai = resolveAddr(aAddr, aPort);
+	if((ai->ai_family == AF_INET && !sock4.valid()) || (ai->ai_family == AF_INET6 && !sock6.valid())) {
+		create(*ai);
+	}
+
+	socket_t s = ai->ai_family == AF_INET ? sock4 : sock6;
+	int calls = 0;
+
+#ifdef HAVE_SENDMMSG
+	const size_t MAX_BATCH = 64;
+	mmsghdr msgs[MAX_BATCH];
+	iovec iov[MAX_BATCH];
+
+	size_t pos = 0;
+	while (pos < aPackets.size()) {
+		auto count = min(MAX_BATCH, aPackets.size() - pos);
+		memset(msgs, 0, sizeof(mmsghdr) * count);
+		for (size_t i = 0; i < count; ++i) {
+			const auto& p = aPackets[pos + i];
+			iov[i].iov_base = (void*)p.data();
+			iov[i].iov_len = p.size();
+
+			msgs[i].msg_hdr.msg_name = ai->ai_addr;
+			msgs[i].msg_hdr.msg_namelen = ai->ai_addrlen;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		auto sent = check([&] { return ::sendmmsg(s, msgs, count, 0); });
+		calls++;
+		if (sent <= 0) {
+			break;
+		}
+
+		for (int i = 0; i < sent; ++i) {
+			stats.totalUp += msgs[i].msg_len;
+		}
+
+		pos += sent;
+	}
+#else
+	for (const auto& p: aPackets) {
+		auto sent = check([&] { 
+			return ::sendto(s, p.data(), (int)p.size(), 0, ai->ai_addr, ai->ai_addrlen); 
+		});
+
+		calls++;
+		stats.totalUp += sent;
+	}
+#endif
+
+	return calls;
+}
+
 /**
  * Blocks until timeout is reached one of the specified conditions have been fulfilled
  * @param millis Max milliseconds to block.
@@ -747,6 +937,90 @@ void Socket::writeTo(const string& aAddr, const string& aPort, const void* aBuff
  * @return pair with read/write state respectively
  * @throw SocketException Select or the connection attempt failed.
  */
+#ifndef _WIN32
+
+std::pair<bool, bool> Socket::wait(uint64_t millis, bool checkRead, bool checkWrite) {
+	pollfd pfd[2];
+	nfds_t n = 0;
+
+	short events = (checkRead ? POLLIN : 0) | (checkWrite ? POLLOUT : 0);
+	if(sock4.valid()) {
+		pfd[n++] = { sock4, events, 0 };
+	}
+
+	if(sock6.valid()) {
+		pfd[n++] = { sock6, events, 0 };
+	}
+
+	check([&] { return ::poll(pfd, n, static_cast<int>(millis)); });
+
+	// Errors are reported in the same way as with select (the following call will fail)
+	bool read = false, write = false;
+	for(nfds_t i = 0; i < n; ++i) {
+		read |= checkRead && (pfd[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+		write |= checkWrite && (pfd[i].revents & (POLLOUT | POLLHUP | POLLERR)) != 0;
+	}
+
+	return std::make_pair(read, write);
+}
+
+bool Socket::waitConnected(uint64_t millis) {
+	pollfd pfd[2];
+	nfds_t n = 0;
+
+	if(sock6.valid()) {
+		pfd[n++] = { sock6, POLLOUT, 0 };
+	}
+
+	if(sock4.valid()) {
+		pfd[n++] = { sock4, POLLOUT, 0 };
+	}
+
+	check([&] { return ::poll(pfd, n, static_cast<int>(millis)); });
+
+	auto isReady = [&](socket_t aSock) {
+		for(nfds_t i = 0; i < n; ++i) {
+			if(pfd[i].fd == aSock) {
+				return pfd[i].revents != 0;
+			}
+		}
+
+		return false;
+	};
+
+	if(sock6.valid() && isReady(sock6)) {
+		int err6 = getSocketOptInt2(sock6, SO_ERROR);
+		if(err6 == 0) {
+			sock4.reset(); // We won't be needing this any more...
+			return true;
+		}
+
+		if(!sock4.valid()) {
+			throw SocketException(err6);
+		}
+
+		sock6.reset();
+	}
+
+	if(sock4.valid() && isReady(sock4)) {
+		int err4 = getSocketOptInt2(sock4, SO_ERROR);
+		if(err4 == 0) {
+			sock6.reset(); // We won't be needing this any more...
+			return true;
+		}
+
+		if(!sock6.valid()) {
+			throw SocketException(err4);
+		}
+
+		sock4.reset();
+	}
+
+	return false;
+}
+
+#else
+
 std::pair<bool, bool> Socket::wait(uint64_t millis, bool checkRead, bool checkWrite) {
 	timeval tv;
 	tv.tv_sec = static_cast<long>(millis / 1000);
@@ -842,6 +1116,8 @@ bool Socket::waitConnected(uint64_t millis) {
 	return false;
 }
 
+#endif
+
 bool Socket::waitAccepted(uint64_t /*millis*/) {
 	// Normal sockets are always connected after a call to accept
 	return true;
@@ -931,6 +1207,15 @@ bool Socket::socksUdpInitialized() noexcept {
 	return udpAddr.sa.sa_family != 0;
 }
 
+bool Socket::isReusePortSupported() noexcept {
+#if defined(SO_REUSEPORT) && defined(__linux__)
+	// Other platforms don't distribute the traffic between the sockets
+	return true;
+#else
+	return false;
+#endif
+}
+
 void Socket::socksUpdated() {
 	memset(&udpAddr, 0, sizeof(udpAddr));
 	udpAddrLen = sizeof(udpAddr);
@@ -115,6 +115,13 @@ public:
 	int write(const string& aData) { return write(aData.data(), (int)aData.length()); }
 	virtual void writeTo(const string& aIp, const string& aPort, const void* aBuffer, int aLen);
 	void writeTo(const string& aIp, const string& aPort, const string& aData) { writeTo(aIp, aPort, aData.data(), (int)aData.length()); }
+
+	/**
+	 * Sends multiple datagrams to the same address, with a single system call when supported by the platform
+	 * @return Number of system calls used
+	 * @throw SocketException Send failed.
+	 */
+	int writeTo(const string& aIp, const string& aPort, const StringList& aPackets);
 	virtual void shutdown() noexcept;
 	virtual void close() noexcept;
 	void disconnect() noexcept;
@@ -140,8 +147,34 @@ public:
 	 */
 	virtual int read(void* aBuffer, int aBufLen, string &aIP);
 
+	struct Datagram {
+		// Allocated by the caller
+		ByteVector buffer;
+
+		int len = 0;
+		string ip;
+	};
+
+	/**
+	 * Reads multiple datagrams with a single system call when supported by the platform
+	 * @param datagrams_ The datagrams to fill (the buffers must have been allocated)
+	 * @return Number of datagrams read, 0 if disconnected and -1 if the call would block.
+	 * @throw SocketException On any failure.
+	 */
+	int read(vector<Datagram>& datagrams_);
+
 	virtual std::pair<bool, bool> wait(uint64_t millis, bool checkRead, bool checkWrite);
 
+	/** Whether file data can be sent by the kernel as it is (see sendFile) */
+	virtual bool isSendFileSupported() const noexcept;
+
+	/**
+	 * Sends data from the current position of the file without copying it to user space
+	 * @return Number of bytes sent, 0 at the end of file and -1 if the call would block.
+	 * @throw SocketException On any failure.
+	 */
+	int sendFile(File& aFile, size_t aLen);
+
 	static string resolve(const string& aDns, int af = AF_UNSPEC) noexcept;
 	addrinfo_p resolveAddr(const string& name, const string& port, int family = AF_UNSPEC, int flags = 0) const;
 
@@ -162,10 +195,14 @@ public:
 	int getSocketOptInt(int option);
 	void setSocketOpt(int option, int value);
 
+	/** The connected socket (for event notifications) */
+	socket_t getNativeHandle() const { return getSock(); }
+
 	virtual bool isSecure() const noexcept { return false; }
 	virtual bool isTrusted() const noexcept { return false; }
 	virtual bool isKeyprintMatch() const noexcept { return true; }
 	virtual std::string getEncryptionInfo() const noexcept { return Util::emptyString; }
+	virtual bool isKernelTls() const noexcept { return false; }
 	virtual ByteVector getKeyprint() const noexcept{ return ByteVector(); }
 	virtual bool verifyKeyprint(const string&, bool) noexcept{ return true; };
 
@@ -181,6 +218,11 @@ public:
 	GETSET(string, localIp6, LocalIp6);
 	IGETSET(bool, v4only, V4only, false);
 
+	// Allow multiple sockets to listen on the same port (the incoming traffic is distributed between them)
+	// Must be set before listening
+	IGETSET(bool, reusePort, ReusePort, false);
+	static bool isReusePortSupported() noexcept;
+
 	const string& getIp() const noexcept {
 		return sock6.valid() ? ip6 : ip4;
 	}
@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "SocketReactor.h"
+
+#include "debug.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace dcpp {
+
+// Notification ID of the wakeup descriptor (handler IDs start from one)
+static const SocketReactor::HandlerId WAKEUP_ID = 0;
+
+SocketReactor::SocketReactor(int aThreads) noexcept : threadCount(max(aThreads, 1)) {
+
+}
+
+SocketReactor::~SocketReactor() {
+	stop();
+}
+
+bool SocketReactor::isSupported() noexcept {
+#ifdef __linux__
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool SocketReactor::start() noexcept {
+#ifdef __linux__
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (epollFd == -1) {
+		return false;
+	}
+
+	// Level-triggered so that all threads will see it when stopping
+	wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	epoll_event ev = { };
+	ev.events = EPOLLIN;
+	ev.data.u64 = WAKEUP_ID;
+	if (wakeupFd == -1 || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd, &ev) != 0) {
+		if (wakeupFd != -1) {
+			::close(wakeupFd);
+			wakeupFd = -1;
+		}
+
+		::close(epollFd);
+		epollFd = -1;
+		return false;
+	}
+
+	for (int i = 0; i < threadCount; ++i) {
+		threads.emplace_back([this] { run(); });
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+void SocketReactor::stop() noexcept {
+	if (epollFd == -1) {
+		return;
+	}
+
+	stopping = true;
+	wakeup();
+
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	threads.clear();
+
+#ifdef __linux__
+	::close(wakeupFd);
+	::close(epollFd);
+#endif
+	wakeupFd = -1;
+	epollFd = -1;
+
+	Lock l(cs);
+	for (const auto& h : handlers) {
+		h.second.handler->reactorId = 0;
+	}
+
+	handlers.clear();
+	scheduled.clear();
+}
+
+SocketReactor::HandlerId SocketReactor::add(socket_t aSock, Handler* aHandler) noexcept {
+	dcassert(aHandler->reactorId == 0);
+
+	Lock l(cs);
+	if (epollFd == -1) {
+		return 0;
+	}
+
+	auto id = ++lastId;
+
+	// The handler must know its ID before the first event is processed
+	aHandler->reactorId = id;
+	aHandler->pendingEvents = 0;
+
+#ifdef __linux__
+	if (aSock != INVALID_SOCKET) {
+		epoll_event ev = { };
+		ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		ev.data.u64 = id;
+
+		// Events for data that is already available will be reported as well
+		if (epoll_ctl(epollFd, EPOLL_CTL_ADD, aSock, &ev) != 0) {
+			dcdebug("SocketReactor: failed to add socket (%d)\n", errno);
+			aHandler->reactorId = 0;
+			return 0;
+		}
+	}
+#endif
+
+	handlers.emplace(id, HandlerInfo({ aHandler, aSock }));
+	return id;
+}
+
+void SocketReactor::unregisterSocket(HandlerInfo& aInfo) noexcept {
+	if (aInfo.sock == INVALID_SOCKET) {
+		return;
+	}
+
+#ifdef __linux__
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, aInfo.sock, nullptr);
+#endif
+	aInfo.sock = INVALID_SOCKET;
+}
+
+void SocketReactor::removeSocket(HandlerId aId) noexcept {
+	Lock l(cs);
+	auto p = handlers.find(aId);
+	if (p != handlers.end()) {
+		unregisterSocket(p->second);
+	}
+}
+
+void SocketReactor::remove(HandlerId aId) noexcept {
+	Lock l(cs);
+	auto p = handlers.find(aId);
+	if (p == handlers.end()) {
+		return;
+	}
+
+	unregisterSocket(p->second);
+	p->second.handler->reactorId = 0;
+	handlers.erase(p);
+}
+
+void SocketReactor::schedule(HandlerId aId) noexcept {
+	{
+		Lock l(cs);
+		scheduled.push_back(aId);
+	}
+
+	wakeup();
+}
+
+size_t SocketReactor::getHandlerCount() const noexcept {
+	Lock l(cs);
+	return handlers.size();
+}
+
+void SocketReactor::wakeup() noexcept {
+#ifdef __linux__
+	uint64_t value = 1;
+	auto ret = ::write(wakeupFd, &value, sizeof(value));
+	(void)ret;
+#endif
+}
+
+void SocketReactor::dispatch(HandlerId aId) noexcept {
+	Handler* handler = nullptr;
+
+	{
+		Lock l(cs);
+		auto p = handlers.find(aId);
+		if (p == handlers.end()) {
+			// Removed
+			return;
+		}
+
+		handler = p->second.handler;
+		if (handler->pendingEvents++ > 0) {
+			// Being processed by another thread, it will run the handler again
+			return;
+		}
+	}
+
+	for (;;) {
+		auto pending = handler->pendingEvents.load();
+		if (!handler->handleReactorEvents()) {
+			// Nothing else can reference the handler after it has been removed from the map
+			handler->pendingEvents = 0;
+			handler->onReactorRemoved();
+			return;
+		}
+
+		if ((handler->pendingEvents -= pending) == 0) {
+			return;
+		}
+	}
+}
+
+void SocketReactor::runScheduled() noexcept {
+#ifdef __linux__
+	uint64_t value;
+	auto ret = ::read(wakeupFd, &value, sizeof(value));
+	(void)ret;
+#endif
+
+	if (stopping) {
+		// Make sure that the other threads will see it as well
+		wakeup();
+		return;
+	}
+
+	// Other woken threads may handle some of the tasks in parallel
+	for (;;) {
+		HandlerId id;
+
+		{
+			Lock l(cs);
+			if (scheduled.empty()) {
+				return;
+			}
+
+			id = scheduled.front();
+			scheduled.pop_front();
+		}
+
+		dispatch(id);
+	}
+}
+
+void SocketReactor::run() noexcept {
+#ifdef __linux__
+	epoll_event events[64];
+
+	while (!stopping) {
+		auto n = epoll_wait(epollFd, events, 64, -1);
+		if (n < 0) {
+			if (errno != EINTR) {
+				dcdebug("SocketReactor: epoll_wait failed (%d)\n", errno);
+				dcassert(0);
+			}
+
+			continue;
+		}
+
+		for (int i = 0; i < n && !stopping; ++i) {
+			if (events[i].data.u64 == WAKEUP_ID) {
+				runScheduled();
+			} else {
+				dispatch(events[i].data.u64);
+			}
+		}
+	}
+#endif
+}
+
+} // namespace dcpp
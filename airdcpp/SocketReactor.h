@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_SOCKET_REACTOR_H
+#define DCPLUSPLUS_DCPP_SOCKET_REACTOR_H
+
+#include "CriticalSection.h"
+#include "Socket.h"
+
+#include "typedefs.h"
+
+#include <deque>
+#include <thread>
+
+#include <boost/noncopyable.hpp>
+
+namespace dcpp {
+
+/* Serves event-driven sockets from a small pool of I/O threads (edge-triggered epoll on Linux, unsupported on other platforms)
+   Events of a handler are never processed concurrently: events that arrive during processing cause the handler to be run again.
+   Notifications aren't repeated for data that was already available so handlers must read until the socket would block. */
+
+class SocketReactor : boost::noncopyable {
+public:
+	typedef uint64_t HandlerId;
+
+	class Handler {
+	public:
+		// Process socket events and queued tasks (called from an I/O thread)
+		// Return false after the handler has removed itself from the reactor
+		virtual bool handleReactorEvents() noexcept = 0;
+
+		// Called from the I/O thread after the handler has been removed
+		// The handler is no longer referenced by the reactor and it may be deleted
+		virtual void onReactorRemoved() noexcept = 0;
+
+		// Zero if the handler hasn't been added in the reactor
+		HandlerId getReactorId() const noexcept { return reactorId; }
+	protected:
+		virtual ~Handler() { }
+	private:
+		friend class SocketReactor;
+
+		atomic<HandlerId> reactorId = { 0 };
+		atomic<int> pendingEvents = { 0 };
+	};
+
+	explicit SocketReactor(int aThreads) noexcept;
+	~SocketReactor();
+
+	static bool isSupported() noexcept;
+
+	// Returns false if the reactor isn't supported or it couldn't be initialized
+	bool start() noexcept;
+	void stop() noexcept;
+
+	// Start receiving events for the socket (both for reading and writing)
+	// Handlers without a socket (INVALID_SOCKET) can only be scheduled
+	// Returns the new handler ID or zero if the socket couldn't be added
+	HandlerId add(socket_t aSock, Handler* aHandler) noexcept;
+
+	// Stop receiving events for the socket, this must be called before the socket is closed
+	// The handler may still be scheduled
+	void removeSocket(HandlerId aId) noexcept;
+
+	// Remove the handler and its socket, call only from the handleReactorEvents of the same handler
+	void remove(HandlerId aId) noexcept;
+
+	// Run the handler from an I/O thread
+	void schedule(HandlerId aId) noexcept;
+
+	size_t getHandlerCount() const noexcept;
+	int getThreadCount() const noexcept { return threadCount; }
+private:
+	struct HandlerInfo {
+		Handler* handler;
+		socket_t sock;
+	};
+
+	void run() noexcept;
+
+	void dispatch(HandlerId aId) noexcept;
+	void runScheduled() noexcept;
+	void wakeup() noexcept;
+
+	// The lock must be held
+	void unregisterSocket(HandlerInfo& aInfo) noexcept;
+
+	const int threadCount;
+
+	mutable CriticalSection cs;
+	unordered_map<HandlerId, HandlerInfo> handlers;
+	deque<HandlerId> scheduled;
+	HandlerId lastId = 0;
+
+	vector<std::thread> threads;
+
+	int epollFd = -1;
+	int wakeupFd = -1;
+	atomic<bool> stopping = { false };
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_SOCKET_REACTOR_H)
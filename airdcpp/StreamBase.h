@@ -26,6 +26,8 @@
 
 namespace dcpp {
 
+class File;
+
 /**
 	* A simple output stream. Intended to be used for nesting streams one inside the other.
 	*/
@@ -79,6 +81,13 @@ public:
 	/* This only works for file streams */
 	virtual void setPos(int64_t /*pos*/) noexcept { }
 	virtual InputStream* releaseRootStream() { return this; }
+
+	/* Streams that pass unmodified file data may allow it to be sent without copying.
+	   Returns the file and the number of bytes that may be read from its current position (-1 = until the end of file). */
+	virtual File* getDirectFile(int64_t& /*maxBytes_*/) noexcept { return nullptr; }
+
+	/* Called after aBytes have been read from the direct file by other means */
+	virtual void directRead(int64_t /*aBytes*/) noexcept { }
 };
 
 class IOStream : public InputStream, public OutputStream {
@@ -115,6 +115,17 @@ public:
 		auto as = s.release();
 		return as->releaseRootStream();
 	}
+	File* getDirectFile(int64_t& maxBytes_) noexcept override {
+		auto f = s->getDirectFile(maxBytes_);
+		if (f) {
+			maxBytes_ = maxBytes_ == -1 ? maxBytes : min(maxBytes, maxBytes_);
+		}
+		return f;
+	}
+	void directRead(int64_t aBytes) noexcept override {
+		maxBytes -= aBytes;
+		s->directRead(aBytes);
+	}
 private:
 	unique_ptr<InputStream> s;
 	int64_t maxBytes;
@@ -21,8 +21,212 @@
 
 #include "Text.h"
 
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+# define STRINGSEARCH_X86
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+# endif
+#endif
+
 namespace dcpp {
 
+namespace {
+
+// Longer texts are matched with StringSearch::matchLowerPerPattern
+const size_t MAX_MASK_TEXT_LENGTH = 64;
+const size_t MAX_MASK_PATTERNS = 16;
+
+// The text is copied in a zero-padded buffer so that the vector loads for the last character
+// of the patterns (which are never longer than the text) will always stay inside it
+const size_t TEXT_BUFFER_SIZE = (MAX_MASK_TEXT_LENGTH * 2) + 32;
+
+typedef void (*OccurrenceF)(const uint8_t* aText, size_t aTextLen, const StringSearch::PatternList& aPatterns, uint64_t* occurrences_);
+
+inline int lowestBit(uint64_t aMask) noexcept {
+#ifdef _MSC_VER
+	unsigned long ret;
+# ifdef _WIN64
+	_BitScanForward64(&ret, aMask);
+# else
+	if (!_BitScanForward(&ret, static_cast<uint32_t>(aMask))) {
+		_BitScanForward(&ret, static_cast<uint32_t>(aMask >> 32));
+		ret += 32;
+	}
+# endif
+	return static_cast<int>(ret);
+#else
+	return __builtin_ctzll(aMask);
+#endif
+}
+
+inline int highestBit(uint64_t aMask) noexcept {
+#ifdef _MSC_VER
+	unsigned long ret;
+# ifdef _WIN64
+	_BitScanReverse64(&ret, aMask);
+# else
+	if (_BitScanReverse(&ret, static_cast<uint32_t>(aMask >> 32))) {
+		ret += 32;
+	} else {
+		_BitScanReverse(&ret, static_cast<uint32_t>(aMask));
+	}
+# endif
+	return static_cast<int>(ret);
+#else
+	return 63 - __builtin_clzll(aMask);
+#endif
+}
+
+// Positions where the pattern fits in the text
+inline uint64_t getValidPositions(size_t aTextLen, size_t aPatternLen) noexcept {
+	auto count = aTextLen - aPatternLen + 1;
+	return count >= 64 ? ~0ULL : (1ULL << count) - 1;
+}
+
+inline bool isMaskable(size_t aTextLen, const string& aPattern) noexcept {
+	return !aPattern.empty() && aPattern.size() <= aTextLen;
+}
+
+// Compare the characters between the first and last one
+inline uint64_t verifyCandidates(uint64_t aCandidates, const uint8_t* aText, const string& aPattern) noexcept {
+	uint64_t ret = 0;
+	const auto plen = aPattern.size();
+	while (aCandidates) {
+		auto pos = lowestBit(aCandidates);
+		aCandidates &= aCandidates - 1;
+		if (plen <= 2 || memcmp(aText + pos + 1, aPattern.data() + 1, plen - 2) == 0) {
+			ret |= 1ULL << pos;
+		}
+	}
+
+	return ret;
+}
+
+#ifndef STRINGSEARCH_X86
+
+void getOccurrencesScalar(const uint8_t* aText, size_t aTextLen, const StringSearch::PatternList& aPatterns, uint64_t* occurrences_) {
+	for (size_t j = 0; j < aPatterns.size(); ++j) {
+		const auto& p = aPatterns[j].str();
+		occurrences_[j] = 0;
+		if (!isMaskable(aTextLen, p)) {
+			continue;
+		}
+
+		const auto first = static_cast<uint8_t>(p.front()), last = static_cast<uint8_t>(p.back());
+		uint64_t candidates = 0;
+		for (size_t i = 0; i + p.size() <= aTextLen; ++i) {
+			if (aText[i] == first && aText[i + p.size() - 1] == last) {
+				candidates |= 1ULL << i;
+			}
+		}
+
+		occurrences_[j] = verifyCandidates(candidates, aText, p);
+	}
+}
+
+#else
+
+void getOccurrencesSSE2(const uint8_t* aText, size_t aTextLen, const StringSearch::PatternList& aPatterns, uint64_t* occurrences_) {
+	fill_n(occurrences_, aPatterns.size(), 0);
+
+	for (size_t i = 0; i < aTextLen; i += 16) {
+		const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aText + i));
+		for (size_t j = 0; j < aPatterns.size(); ++j) {
+			const auto& p = aPatterns[j].str();
+			if (!isMaskable(aTextLen, p)) {
+				continue;
+			}
+
+			const auto lastBlock = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aText + i + p.size() - 1));
+			const auto eq = _mm_and_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(p.front())), _mm_cmpeq_epi8(lastBlock, _mm_set1_epi8(p.back())));
+			occurrences_[j] |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(eq))) << i;
+		}
+	}
+
+	for (size_t j = 0; j < aPatterns.size(); ++j) {
+		const auto& p = aPatterns[j].str();
+		if (occurrences_[j]) {
+			occurrences_[j] = verifyCandidates(occurrences_[j] & getValidPositions(aTextLen, p.size()), aText, p);
+		}
+	}
+}
+
+#ifdef __GNUC__
+__attribute__((target("avx2")))
+#endif
+void getOccurrencesAVX2(const uint8_t* aText, size_t aTextLen, const StringSearch::PatternList& aPatterns, uint64_t* occurrences_) {
+	fill_n(occurrences_, aPatterns.size(), 0);
+
+	for (size_t i = 0; i < aTextLen; i += 32) {
+		const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(aText + i));
+		for (size_t j = 0; j < aPatterns.size(); ++j) {
+			const auto& p = aPatterns[j].str();
+			if (!isMaskable(aTextLen, p)) {
+				continue;
+			}
+
+			const auto lastBlock = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(aText + i + p.size() - 1));
+			const auto eq = _mm256_and_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(p.front())), _mm256_cmpeq_epi8(lastBlock, _mm256_set1_epi8(p.back())));
+			occurrences_[j] |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(eq))) << i;
+		}
+	}
+
+	for (size_t j = 0; j < aPatterns.size(); ++j) {
+		const auto& p = aPatterns[j].str();
+		if (occurrences_[j]) {
+			occurrences_[j] = verifyCandidates(occurrences_[j] & getValidPositions(aTextLen, p.size()), aText, p);
+		}
+	}
+}
+
+bool hasAVX2() noexcept {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+
+	// The OS must save the AVX registers as well
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+struct Matcher {
+	OccurrenceF getOccurrences;
+	const char* name;
+};
+
+const Matcher& getMatcher() noexcept {
+	static const Matcher matcher = []() -> Matcher {
+#ifdef STRINGSEARCH_X86
+		if (hasAVX2()) {
+			return { getOccurrencesAVX2, "AVX2" };
+		}
+
+		return { getOccurrencesSSE2, "SSE2" };
+#else
+		return { getOccurrencesScalar, "scalar" };
+#endif
+	}();
+
+	return matcher;
+}
+
+}
+
 StringSearch::Pattern::Pattern(const string& aPattern) noexcept : pattern(Text::toLower(aPattern)), plen(aPattern.length()) {
 	initDelta1();
 }
@@ -105,6 +309,11 @@ bool StringSearch::match_all(const string& aText) const {
 }
 
 bool StringSearch::match_any_lower(const string& aText) const {
+	uint64_t occurrences[MAX_MASK_PATTERNS];
+	if (getOccurrences(aText, occurrences)) {
+		return any_of(occurrences, occurrences + patterns.size(), [](uint64_t aMask) { return aMask != 0; });
+	}
+
 	for (const auto& p : patterns) {
 		if (p.matchLower(aText) != string::npos) {
 			return true;
@@ -118,7 +327,65 @@ bool StringSearch::match_any(const string& aText) const {
 	return match_any_lower(Text::toLower(aText));
 }
 
+const char* StringSearch::getMatcherName() noexcept {
+	return getMatcher().name;
+}
+
+bool StringSearch::getOccurrences(const string& aText, uint64_t* occurrences_) const noexcept {
+	dcassert(Text::isLower(aText));
+	if (aText.size() > MAX_MASK_TEXT_LENGTH || patterns.size() > MAX_MASK_PATTERNS) {
+		return false;
+	}
+
+	uint8_t text[TEXT_BUFFER_SIZE];
+	memcpy(text, aText.data(), aText.size());
+	memset(text + aText.size(), 0, TEXT_BUFFER_SIZE - aText.size());
+
+	getMatcher().getOccurrences(text, aText.size(), patterns, occurrences_);
+	return true;
+}
+
 int StringSearch::matchLower(const string& aText, bool aResumeOnNoMatch, ResultList* results_) const {
+	uint64_t occurrences[MAX_MASK_PATTERNS];
+	if (!getOccurrences(aText, occurrences)) {
+		return matchLowerPerPattern(aText, aResumeOnNoMatch, results_);
+	}
+
+	// Pick the same positions as matchLowerPerPattern
+	int matches = 0;
+	for (size_t listPos = 0; listPos < patterns.size(); ++listPos) {
+		const auto mask = occurrences[listPos];
+		auto pos = string::npos;
+		if (mask) {
+			pos = lowestBit(mask);
+			if (results_ && listPos > 0) {
+				// prefer sequential match order if this isn't the first pattern
+				auto prevPos = (*results_)[listPos - 1];
+				if (prevPos != string::npos && prevPos > pos) {
+					// use the last match if there are none after the previous pattern
+					auto following = prevPos < 64 ? mask & (~0ULL << prevPos) : 0;
+					pos = following ? lowestBit(following) : highestBit(mask);
+				}
+			}
+		}
+
+		if (pos != string::npos) {
+			matches++;
+			if (results_) {
+				(*results_)[listPos] = pos;
+			}
+		} else if (!aResumeOnNoMatch) {
+			if (results_) {
+				fill_n((*results_).begin(), listPos, string::npos);
+			}
+			return 0;
+		}
+	}
+
+	return matches;
+}
+
+int StringSearch::matchLowerPerPattern(const string& aText, bool aResumeOnNoMatch, ResultList* results_) const {
 	int matches = 0, listPos = 0;
 	for (const auto& p: patterns) {
 		size_t addPos = string::npos;
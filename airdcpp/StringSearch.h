@@ -28,7 +28,10 @@ namespace dcpp {
 * one pattern against many strings (currently Quick Search, a variant of
 * Boyer-Moore. Code based on "A very fast substring search algorithm" by
 * D. Sunday).
-* @todo Perhaps find an algo suitable for matching multiple substrings.
+*
+* Short texts (such as file names) are matched against all patterns in a
+* single pass with a vectorized first/last character filter (SSE2/AVX2,
+* selected at runtime with a scalar fallback).
 */
 class StringSearch {
 public:
@@ -69,6 +72,13 @@ public:
 	bool match_any_lower(const string& aText) const;
 
 	int matchLower(const string& aText, bool aResumeOnNoMatch, ResultList* results_ = nullptr) const;
+
+	// Matches each pattern separately with Pattern::matchLower (used for long texts)
+	int matchLowerPerPattern(const string& aText, bool aResumeOnNoMatch, ResultList* results_ = nullptr) const;
+
+	// Name of the instruction set used by the multi-pattern matcher
+	static const char* getMatcherName() noexcept;
+
 	void addString(const string& aPattern);
 	void clear();
 
@@ -76,6 +86,10 @@ public:
 	inline bool empty() const { return patterns.empty(); }
 	inline const PatternList& getPatterns() const { return patterns; }
 private:
+	// Get the matching positions of each pattern as bitmasks
+	// Returns false if the text or pattern count is too large for the multi-pattern matcher
+	bool getOccurrences(const string& aText, uint64_t* occurrences_) const noexcept;
+
 	PatternList patterns;
 };
 
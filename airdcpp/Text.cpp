@@ -186,6 +186,44 @@ bool validateUtf8(const string& str) noexcept {
 	return true;
 }
 
+bool validateUtf8(const char* aStr, size_t aLen) noexcept {
+	size_t i = 0;
+	while (i < aLen) {
+		const auto c0 = static_cast<uint8_t>(aStr[i]);
+		if ((c0 & 0x80) == 0) {
+			i++;
+			continue;
+		}
+
+		// Same rules as with utf8ToWc (the data isn't null-terminated)
+		if ((c0 & 0xc0) != 0xc0) {
+			return false;
+		}
+
+		const auto bytes = 2 + !!(c0 & 0x20) + ((c0 & 0x30) == 0x30);
+		const auto checkBit = 1 << (7 - bytes);
+		if ((c0 & checkBit) || i + bytes > aLen) {
+			return false;
+		}
+
+		uint32_t c = (checkBit - 1) & c0;
+		for (auto j = 1; j < bytes; ++j) {
+			const auto cj = static_cast<uint8_t>(aStr[i + j]);
+			if ((cj & 0xc0) != 0x80)
+				return false;
+			c = (c << 6) | (cj & 0x3f);
+		}
+
+		if (c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff)) {
+			return false;
+		}
+
+		i += bytes;
+	}
+
+	return true;
+}
+
 wchar_t toLower(wchar_t c) noexcept {
 #ifdef _WIN32
 	// WinAPI is about 20% faster than towlower
@@ -103,6 +103,7 @@ namespace Text {
 
 	string sanitizeUtf8(const string& str) noexcept;
 	bool validateUtf8(const string& str) noexcept;
+	bool validateUtf8(const char* aStr, size_t aLen) noexcept;
 
 	wchar_t toLower(wchar_t c) noexcept;
 	wchar_t toUpper(wchar_t c) noexcept;
@@ -19,10 +19,15 @@
 #include "stdinc.h"
 #include "ThrottleManager.h"
 
+#include "ConnectionManager.h"
 #include "DownloadManager.h"
 #include "Socket.h"
 #include "TimerManager.h"
 #include "UploadManager.h"
+#include "User.h"
+
+#include <random>
+#include <thread>
 
 namespace dcpp {
 	// The actual limiting code is from StrongDC++
@@ -30,9 +35,28 @@ namespace dcpp {
 
 	#define CONDWAIT_TIMEOUT		250
 
+	// Maximum time that a connection will wait for its reserved tokens
+	// Connections that would need to wait longer will retry later without a reservation
+	static const TokenBucket::Time MAX_WAIT = CONDWAIT_TIMEOUT * 1000000LL;
+
+	// Sleep without holding any locks
+	// Retrying connections get a small random delay so that they won't all wake up at the same time
+	static void sleepFor(TokenBucket::Time aTime, bool aJitter) noexcept {
+		static thread_local std::minstd_rand rng(static_cast<uint32_t>(TokenBucket::now()));
+		if (aJitter) {
+			aTime += rng() % (MAX_WAIT / 10);
+		}
+
+		aTime = std::min(aTime, MAX_WAIT);
+		if (aTime > 0) {
+			std::this_thread::sleep_for(std::chrono::nanoseconds(aTime));
+		}
+	}
+
 	// constructor
 	ThrottleManager::ThrottleManager(void)
 	{
+		updateLimits();
 		TimerManager::getInstance()->addListener(this);
 	}
 
@@ -40,80 +64,168 @@ namespace dcpp {
 	ThrottleManager::~ThrottleManager()
 	{
 		TimerManager::getInstance()->removeListener(this);
-
-		// release conditional variables on exit
-		downCond.notify_all();
-		upCond.notify_all();
 	}
 
 	/*
 	 * Limits a traffic and reads a packet from the network
 	 */
-	int ThrottleManager::read(Socket* sock, void* buffer, size_t len)
+	int ThrottleManager::read(Socket* sock, void* buffer, size_t len, const TokenBucketList* aLimiters)
 	{
 		size_t downs = DownloadManager::getInstance()->getTotalDownloadConnectionCount();
-		if (getDownLimit() == 0 || downs == 0)
-			return sock->read(buffer, len);
-
-		unique_lock<mutex> lock(downMutex);
-
-
-		if(downTokens > 0)
-		{
-			size_t slice = (getDownLimit() * 1024) / downs;
-			size_t readSize = min(slice, min(len, downTokens));
-				
-			// read from socket
-			readSize = sock->read(buffer, readSize);
-				
-			if(readSize > 0)
-				downTokens -= readSize;
-
-			// next code can't be in critical section, so we must unlock here
-			lock.unlock();
-
-			// give a chance to other transfers to get a token
-			Thread::yield();
-			return readSize;
-		}
-
-		// no tokens, wait for them
-		downCond.wait_for(lock, std::chrono::milliseconds(CONDWAIT_TIMEOUT));
-		return -1;	// from BufferedSocket: -1 = retry, 0 = connection close
+		return throttle(downBucket, downs, aLimiters, len, -1, true, [&] { return sock->read(buffer, len); });	// from BufferedSocket: -1 = retry, 0 = connection close
 	}
 	
 	/*
 	 * Limits a traffic and writes a packet to the network
 	 * We must handle this a little bit differently than downloads, because of that stupidity in OpenSSL
 	 */		
-	int ThrottleManager::write(Socket* sock, void* buffer, size_t& len)
+	int ThrottleManager::write(Socket* sock, void* buffer, size_t& len, const TokenBucketList* aLimiters)
+	{
+		// A failed write is retried with the same length without the limiter, so the tokens are kept
+		size_t ups = UploadManager::getInstance()->getUploadCount();
+		return throttle(upBucket, ups, aLimiters, len, 0, false, [&] { return sock->write(buffer, len); });	// from BufferedSocket: -1 = failed, 0 = retry
+	}
+
+	/*
+	 * Limits a traffic and sends file data to the network without copying it
+	 */
+	int ThrottleManager::sendFile(Socket* sock, File& file, size_t& len, const TokenBucketList* aLimiters)
 	{
 		size_t ups = UploadManager::getInstance()->getUploadCount();
-		if(getUpLimit() == 0 || ups == 0)
-			return sock->write(buffer, len);
-		
-		unique_lock<mutex> lock(upMutex);
-		
-		if(upTokens > 0)
+		return throttle(upBucket, ups, aLimiters, len, 0, true, [&] { return sock->sendFile(file, len); });
+	}
+
+	template<typename IOF>
+	int ThrottleManager::throttle(TokenBucket& aGlobal, size_t aConnections, const TokenBucketList* aLimiters, size_t& len, int aRetry, bool aRefundBlocked, const IOF& aIO)
+	{
+		// collect the buckets that apply to this connection
+		const size_t MAX_BUCKETS = CLASS_LAST + 1;
+		TokenBucket* buckets[MAX_BUCKETS];
+		size_t count = 0;
+
+		int64_t grant = len;
+		if (aGlobal.isLimited() && aConnections > 0) {
+			// don't let a single connection take all bandwidth
+			grant = min(grant, max<int64_t>(aGlobal.getRate() / aConnections, 1));
+			buckets[count++] = &aGlobal;
+		}
+
+		if (aLimiters) {
+			for (const auto& b: *aLimiters) {
+				if (b->isLimited() && count < MAX_BUCKETS) {
+					buckets[count++] = b.get();
+				}
+			}
+		}
+
+		if (count == 0) {
+			return aIO();
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			grant = min(grant, buckets[i]->getBurstSize());
+		}
+
+		// reserve the tokens from each bucket
+		auto now = TokenBucket::now();
+		TokenBucket::Time wait = 0;
+		for (size_t i = 0; i < count; ++i) {
+			auto bucketWait = buckets[i]->reserve(grant, now, MAX_WAIT);
+			if (bucketWait < 0) {
+				// too many connections waiting already, release what we got and try again later
+				for (size_t j = 0; j < i; ++j) {
+					buckets[j]->refund(grant);
+				}
+
+				sleepFor(buckets[i]->getQueueTime(now) - MAX_WAIT, true);
+				return aRetry;
+			}
+
+			wait = max(wait, bucketWait);
+		}
+
+		// wait for our turn
+		sleepFor(wait, false);
+
+		len = static_cast<size_t>(grant);
+		int transferred = aIO();
+
+		// return the unused tokens
+		auto unused = transferred >= 0 ? grant - transferred : (aRefundBlocked ? grant : 0);
+		if (unused > 0) {
+			for (size_t i = 0; i < count; ++i) {
+				buckets[i]->refund(unused);
+			}
+		}
+
+		return transferred;
+	}
+
+	void ThrottleManager::setClassLimit(LimitClass aClass, const string& aKey, bool aUpload, int aLimit) noexcept {
+		if (aLimit < 0 || aLimit > MAX_LIMIT)
+			aLimit = 0;
+
 		{
-			size_t slice = (getUpLimit() * 1024) / ups;
-			len = min(slice, min(len, upTokens));
-			upTokens -= len;
+			WLock l(cs);
+			auto& buckets = classBuckets[aClass][aUpload];
+			auto i = buckets.find(aKey);
+			if (aLimit == 0) {
+				if (i == buckets.end()) {
+					return;
+				}
 
-			// next code can't be in critical section, so we must unlock here
-			lock.unlock();
+				// existing connections may still hold the bucket
+				i->second->setRate(0);
+				buckets.erase(i);
+			} else if (i != buckets.end()) {
+				// connections share the existing bucket
+				i->second->setRate(static_cast<int64_t>(aLimit) * 1024);
+				return;
+			} else {
+				buckets.emplace(aKey, make_shared<TokenBucket>()).first->second->setRate(static_cast<int64_t>(aLimit) * 1024);
+			}
+		}
+
+		// a bucket was added or removed
+		ConnectionManager::getInstance()->updateLimiters();
+	}
+
+	int ThrottleManager::getClassLimit(LimitClass aClass, const string& aKey, bool aUpload) const noexcept {
+		RLock l(cs);
+		const auto& buckets = classBuckets[aClass][aUpload];
+		auto i = buckets.find(aKey);
+		return i != buckets.end() ? static_cast<int>(i->second->getRate() / 1024) : 0;
+	}
+
+	string ThrottleManager::getPriorityKey(Priority aPriority) noexcept {
+		return Util::toString(static_cast<int>(aPriority));
+	}
 
-			// write to socket			
-			int sent = sock->write(buffer, len);
+	TokenBucketList ThrottleManager::getLimiters(bool aUpload, const string& aHubUrl, const UserPtr& aUser, Priority aPriority) const noexcept {
+		TokenBucketList ret;
 
-			// give a chance to other transfers to get a token
-			Thread::yield();
-			return sent;
+		RLock l(cs);
+		auto addBucket = [&](LimitClass aClass, const string& aKey) {
+			const auto& buckets = classBuckets[aClass][aUpload];
+			auto i = buckets.find(aKey);
+			if (i != buckets.end()) {
+				ret.push_back(i->second);
+			}
+		};
+
+		if (!aHubUrl.empty()) {
+			addBucket(CLASS_HUB, aHubUrl);
 		}
-		
-		// no tokens, wait for them
-		upCond.wait_for(lock, std::chrono::milliseconds(CONDWAIT_TIMEOUT));
-		return 0;	// from BufferedSocket: -1 = failed, 0 = retry
+
+		if (aUser) {
+			addBucket(CLASS_USER, aUser->getCID().toBase32());
+		}
+
+		if (aPriority != Priority::DEFAULT) {
+			addBucket(CLASS_PRIORITY, getPriorityKey(aPriority));
+		}
+
+		return ret;
 	}
 
 	void ThrottleManager::setSetting(SettingsManager::IntSetting setting, int value) noexcept {
@@ -163,25 +275,31 @@ namespace dcpp {
 		}
 	}
 
+	void ThrottleManager::updateLimits() noexcept {
+		// the buckets are refilled continuously, only the rates need to be updated
+		downBucket.setRate(static_cast<int64_t>(getDownLimit()) * 1024);
+		upBucket.setRate(static_cast<int64_t>(getUpLimit()) * 1024);
+
+		// bundle priority limits
+		static const pair<Priority, SettingsManager::IntSetting> priorityLimits[] = {
+			{ Priority::LOWEST, SettingsManager::MAX_DOWNLOAD_SPEED_LOWEST },
+			{ Priority::LOW, SettingsManager::MAX_DOWNLOAD_SPEED_LOW },
+			{ Priority::NORMAL, SettingsManager::MAX_DOWNLOAD_SPEED_NORMAL },
+			{ Priority::HIGH, SettingsManager::MAX_DOWNLOAD_SPEED_HIGH },
+			{ Priority::HIGHEST, SettingsManager::MAX_DOWNLOAD_SPEED_HIGHEST },
+		};
+
+		for (const auto& p : priorityLimits) {
+			if (getClassLimit(CLASS_PRIORITY, getPriorityKey(p.first), false) != SettingsManager::getInstance()->get(p.second)) {
+				setClassLimit(CLASS_PRIORITY, getPriorityKey(p.first), false, SettingsManager::getInstance()->get(p.second));
+			}
+		}
+	}
+
 	// TimerManagerListener
 	void ThrottleManager::on(TimerManagerListener::Second, uint64_t /*aTick*/) noexcept {
-		auto downLimit = getDownLimit() * 1024;
-		auto upLimit = getUpLimit() * 1024;
-		
-		// readd tokens
-		if(downLimit > 0)
-		{
-			lock_guard<mutex> lock(downMutex);
-			downTokens = downLimit;
-			downCond.notify_all();
-		}
-			
-		if(upLimit > 0)
-		{
-			lock_guard<mutex> lock(upMutex);
-			upTokens = upLimit;
-			upCond.notify_all();
-		}
+		// the limits may depend on the time of the day
+		updateLimits();
 	}
 
 
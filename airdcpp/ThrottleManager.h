@@ -19,12 +19,12 @@
 #ifndef DCPLUSPLUS_DCPP_THROTTLEMANAGER_H
 #define DCPLUSPLUS_DCPP_THROTTLEMANAGER_H
 
+#include "CriticalSection.h"
+#include "Priority.h"
 #include "Singleton.h"
 #include "SettingsManager.h"
 #include "TimerManagerListener.h"
-
-#include <condition_variable>
-#include <mutex>
+#include "TokenBucket.h"
 
 
 namespace dcpp
@@ -33,22 +33,54 @@ namespace dcpp
 	/**
 	 * Manager for throttling traffic flow speed.
 	 * Inspired by Token Bucket algorithm: http://en.wikipedia.org/wiki/Token_bucket
+	 *
+	 * The global limits apply to all limited connections. Additional limits can be set for
+	 * connections of a specific hub, user or bundle priority (see setClassLimit), the connection must
+	 * have tokens from each bucket that applies to it. The hub limits come from the hub settings,
+	 * the user limits from favorite users and the priority limits from the settings.
 	 */
 	class ThrottleManager :
 		public Singleton<ThrottleManager>, private TimerManagerListener
 	{
 	public:
+		enum LimitClass {
+			CLASS_HUB,
+			CLASS_USER,
+			CLASS_PRIORITY,
+			CLASS_LAST
+		};
 
 		/*
 		 * Limits a traffic and reads a packet from the network
+		 * aLimiters may contain class limiters for the connection (see getLimiters)
 		 */
-		int read(Socket* sock, void* buffer, size_t len);
+		int read(Socket* sock, void* buffer, size_t len, const TokenBucketList* aLimiters = nullptr);
 		
 		/*
 		 * Limits a traffic and writes a packet to the network
 		 * We must handle this a little bit differently than downloads, because of that stupidity in OpenSSL
 		 */		
-		int write(Socket* sock, void* buffer, size_t& len);
+		int write(Socket* sock, void* buffer, size_t& len, const TokenBucketList* aLimiters = nullptr);
+
+		/*
+		 * Limits a traffic and sends file data to the network without copying it (see Socket::sendFile)
+		 * Returns 0 when there are no tokens available
+		 */
+		int sendFile(Socket* sock, File& file, size_t& len, const TokenBucketList* aLimiters = nullptr);
+
+		/*
+		 * Sets the limit (KiB/s, 0 = unlimited) for connections of the given hub URL, user CID or bundle priority
+		 * Existing connections are updated when a class limit is added or removed
+		 */
+		void setClassLimit(LimitClass aClass, const string& aKey, bool aUpload, int aLimit) noexcept;
+		int getClassLimit(LimitClass aClass, const string& aKey, bool aUpload) const noexcept;
+
+		static string getPriorityKey(Priority aPriority) noexcept;
+
+		/*
+		 * Returns the class limiters that apply to a connection
+		 */
+		TokenBucketList getLimiters(bool aUpload, const string& aHubUrl, const UserPtr& aUser, Priority aPriority) const noexcept;
 
 		/*
 		 * Returns current download limit.
@@ -65,16 +97,21 @@ namespace dcpp
 
 		static const int MAX_LIMIT = 1024 * 1024; // 1 GiB/s
 	private:
-		
-		// download limiter
-		size_t						downTokens = 0;
-		condition_variable	downCond;
-		mutex				downMutex;
-		
-		// upload limiter
-		size_t						upTokens = 0;
-		condition_variable	upCond;
-		mutex				upMutex;
+		// Reserves the tokens for len bytes (len may be reduced) from all applicable buckets before performing the I/O
+		// Returns aRetry if the caller should try again later
+		template<typename IOF>
+		int throttle(TokenBucket& aGlobal, size_t aConnections, const TokenBucketList* aLimiters, size_t& len, int aRetry, bool aRefundBlocked, const IOF& aIO);
+
+		void updateLimits() noexcept;
+
+		// global limiters
+		TokenBucket downBucket;
+		TokenBucket upBucket;
+
+		// class limiters
+		typedef unordered_map<string, TokenBucketPtr> BucketMap;
+		BucketMap classBuckets[CLASS_LAST][2];
+		mutable SharedMutex cs;
 			
 		friend class Singleton<ThrottleManager>;
 		
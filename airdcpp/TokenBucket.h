@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_TOKEN_BUCKET_H
+#define DCPLUSPLUS_DCPP_TOKEN_BUCKET_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <boost/noncopyable.hpp>
+
+namespace dcpp {
+
+/**
+ * Lock-free token bucket
+ *
+ * The whole state is a single timestamp from which the available tokens are derived
+ * (tokens = (now - zeroTime) * rate, capped to the burst size). The bucket refills
+ * continuously instead of in one second steps.
+ *
+ * Reservations may move the timestamp past the current time: each caller that has to wait
+ * gets its own wakeup time, which queues the waiters in the order of their reservations.
+ */
+class TokenBucket : boost::noncopyable {
+public:
+	// Nanoseconds
+	typedef int64_t Time;
+
+	static const Time SECOND = 1000000000LL;
+
+	// How much unused bandwidth may be accumulated
+	static const Time BURST_TIME = SECOND / 4;
+
+	static Time now() noexcept {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Bytes per second, 0 = unlimited
+	void setRate(int64_t aRate) noexcept { rate.store(aRate < 0 ? 0 : aRate, std::memory_order_relaxed); }
+	int64_t getRate() const noexcept { return rate.load(std::memory_order_relaxed); }
+	bool isLimited() const noexcept { return getRate() > 0; }
+
+	// Maximum number of bytes that can be reserved at once
+	int64_t getBurstSize() const noexcept {
+		auto r = getRate();
+		return r <= 0 ? INT64_MAX : std::max<int64_t>(r * BURST_TIME / SECOND, 1);
+	}
+
+	/**
+	 * Take tokens from the bucket
+	 * @param aMaxWait Maximum time that the caller is willing to wait for the tokens
+	 * @return Time until the reserved tokens can be used (0 = immediately) or -1 if
+	 * the tokens wouldn't be available within aMaxWait (nothing is reserved in that case)
+	 */
+	Time reserve(int64_t aBytes, Time aNow, Time aMaxWait) noexcept {
+		auto r = getRate();
+		if (r <= 0) {
+			return 0;
+		}
+
+		auto cost = getCost(aBytes, r);
+		auto cur = zeroTime.load(std::memory_order_relaxed);
+		Time next;
+		do {
+			next = std::max(cur, aNow - BURST_TIME) + cost;
+			if (next - aNow > aMaxWait) {
+				return -1;
+			}
+		} while (!zeroTime.compare_exchange_weak(cur, next, std::memory_order_relaxed));
+
+		return std::max<Time>(next - aNow, 0);
+	}
+
+	// Return reserved tokens that weren't used
+	void refund(int64_t aBytes) noexcept {
+		auto r = getRate();
+		if (r > 0 && aBytes > 0) {
+			zeroTime.fetch_sub(getCost(aBytes, r), std::memory_order_relaxed);
+		}
+	}
+
+	// Time until the earlier reservations have been covered
+	Time getQueueTime(Time aNow) const noexcept {
+		return std::max<Time>(zeroTime.load(std::memory_order_relaxed) - aNow, 0);
+	}
+private:
+	static Time getCost(int64_t aBytes, int64_t aRate) noexcept {
+		return aBytes * SECOND / aRate;
+	}
+
+	std::atomic<int64_t> rate { 0 };
+	std::atomic<Time> zeroTime { 0 };
+};
+
+}
+
+#endif
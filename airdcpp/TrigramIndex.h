@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_TRIGRAM_INDEX_H
+#define DCPLUSPLUS_DCPP_TRIGRAM_INDEX_H
+
+#include "typedefs.h"
+
+namespace dcpp {
+
+/* Inverted index that maps each three-byte substring of a (lowercase) name to the items having it in their name.
+   Posting lists are kept sorted by the item address so that they can be merged and intersected in linear time.
+   The index can only tell which items may contain a pattern; the actual match must always be verified by the caller. */
+
+template<class T>
+class TrigramIndex {
+public:
+	typedef vector<const T*> ItemList;
+	typedef vector<pair<const string*, const T*>> NameItemList;
+
+	// Sorted posting lists for each trigram of the items
+	typedef unordered_map<uint32_t, ItemList> GroupedItems;
+
+	static const size_t MIN_PATTERN_LENGTH = 3;
+
+	static bool isIndexable(const string& aPattern) noexcept {
+		return aPattern.size() >= MIN_PATTERN_LENGTH;
+	}
+
+	void add(const string& aNameLower, const T* aItem) noexcept {
+		forEachTrigram(aNameLower, [&](uint32_t aKey) {
+			auto& l = postings[aKey];
+			l.insert(lower_bound(l.begin(), l.end(), aItem, Less()), aItem);
+			postingCount++;
+		});
+	}
+
+	void remove(const string& aNameLower, const T* aItem) noexcept {
+		forEachTrigram(aNameLower, [&](uint32_t aKey) {
+			auto p = postings.find(aKey);
+			if (p == postings.end()) {
+				dcassert(0);
+				return;
+			}
+
+			auto& l = p->second;
+			auto i = lower_bound(l.begin(), l.end(), aItem, Less());
+			if (i == l.end() || *i != aItem) {
+				dcassert(0);
+				return;
+			}
+
+			l.erase(i);
+			postingCount--;
+			if (l.empty()) {
+				postings.erase(p);
+			}
+		});
+	}
+
+	// Bulk versions that should be used when adding/removing large amounts of items
+	void add(const NameItemList& aItems) noexcept {
+		add(groupItems(aItems));
+	}
+
+	void remove(const NameItemList& aItems) noexcept {
+		remove(groupItems(aItems));
+	}
+
+	// Grouping doesn't access the index and it's the most expensive part of bulk operations
+	static GroupedItems groupItems(const NameItemList& aItems) noexcept {
+		GroupedItems ret;
+		for (const auto& i : aItems) {
+			forEachTrigram(*i.first, [&](uint32_t aKey) {
+				ret[aKey].push_back(i.second);
+			});
+		}
+
+		for (auto& l : ret) {
+			sort(l.second.begin(), l.second.end(), Less());
+		}
+
+		return ret;
+	}
+
+	void add(const GroupedItems& aItems) noexcept {
+		for (const auto& g : aItems) {
+			auto& l = postings[g.first];
+			auto oldSize = l.size();
+			l.insert(l.end(), g.second.begin(), g.second.end());
+			inplace_merge(l.begin(), l.begin() + oldSize, l.end(), Less());
+			postingCount += g.second.size();
+		}
+	}
+
+	void remove(const GroupedItems& aItems) noexcept {
+		for (const auto& g : aItems) {
+			auto p = postings.find(g.first);
+			if (p == postings.end()) {
+				dcassert(0);
+				continue;
+			}
+
+			ItemList remaining;
+			remaining.reserve(p->second.size() > g.second.size() ? p->second.size() - g.second.size() : 0);
+			set_difference(p->second.begin(), p->second.end(), g.second.begin(), g.second.end(), back_inserter(remaining), Less());
+
+			dcassert(p->second.size() - remaining.size() == g.second.size());
+			postingCount -= p->second.size() - remaining.size();
+			if (remaining.empty()) {
+				postings.erase(p);
+			} else {
+				p->second.swap(remaining);
+			}
+		}
+	}
+
+	// Updated posting lists of the trigrams affected by grouped changes
+	struct MergedItems {
+		// Empty lists are removed from the index
+		GroupedItems lists;
+		ptrdiff_t postingDelta = 0;
+	};
+
+	// Builds the updated posting lists without modifying the index so that it can be done without exclusive access
+	// The index must not be modified before the result is applied
+	MergedItems merge(const GroupedItems& aRemoved, const GroupedItems& aAdded) const noexcept {
+		MergedItems ret;
+		auto mergeList = [&](uint32_t aKey) {
+			if (ret.lists.find(aKey) != ret.lists.end()) {
+				return;
+			}
+
+			static const ItemList emptyList;
+			auto p = postings.find(aKey);
+			const auto& current = p != postings.end() ? p->second : emptyList;
+
+			ItemList remaining;
+			auto r = aRemoved.find(aKey);
+			if (r != aRemoved.end()) {
+				remaining.reserve(current.size() > r->second.size() ? current.size() - r->second.size() : 0);
+				set_difference(current.begin(), current.end(), r->second.begin(), r->second.end(), back_inserter(remaining), Less());
+				dcassert(current.size() - remaining.size() == r->second.size());
+			} else {
+				remaining = current;
+			}
+
+			auto& l = ret.lists[aKey];
+			auto a = aAdded.find(aKey);
+			if (a != aAdded.end()) {
+				l.reserve(remaining.size() + a->second.size());
+				std::merge(remaining.begin(), remaining.end(), a->second.begin(), a->second.end(), back_inserter(l), Less());
+			} else {
+				l.swap(remaining);
+			}
+
+			ret.postingDelta += static_cast<ptrdiff_t>(l.size()) - static_cast<ptrdiff_t>(current.size());
+		};
+
+		for (const auto& g : aRemoved) {
+			mergeList(g.first);
+		}
+
+		for (const auto& g : aAdded) {
+			mergeList(g.first);
+		}
+
+		return ret;
+	}
+
+	// Only swaps the changed lists
+	// The replaced lists are moved to aMerged
+	void apply(MergedItems& aMerged) noexcept {
+		for (auto& l : aMerged.lists) {
+			if (l.second.empty()) {
+				postings.erase(l.first);
+			} else {
+				postings[l.first].swap(l.second);
+			}
+		}
+
+		postingCount += aMerged.postingDelta;
+	}
+
+	// Get items containing all trigrams of the pattern (sorted by address)
+	// Returns false if the pattern is too short to be matched via the index
+	bool getCandidates(const string& aPatternLower, ItemList& candidates_) const noexcept {
+		candidates_.clear();
+		if (!isIndexable(aPatternLower)) {
+			return false;
+		}
+
+		vector<const ItemList*> lists;
+		auto hasMissing = false;
+		forEachTrigram(aPatternLower, [&](uint32_t aKey) {
+			auto p = postings.find(aKey);
+			if (p == postings.end()) {
+				hasMissing = true;
+			} else {
+				lists.push_back(&p->second);
+			}
+		});
+
+		if (hasMissing) {
+			return true;
+		}
+
+		// Start from the shortest list
+		sort(lists.begin(), lists.end(), [](const ItemList* a, const ItemList* b) { return a->size() < b->size(); });
+
+		candidates_ = *lists.front();
+		for (auto i = lists.begin() + 1; i != lists.end() && !candidates_.empty(); ++i) {
+			intersect(candidates_, **i);
+		}
+
+		return true;
+	}
+
+	// Leaves only items that exist in both lists (both lists must be sorted by address)
+	static void intersect(ItemList& items_, const ItemList& aOther) noexcept {
+		ItemList ret;
+		set_intersection(items_.begin(), items_.end(), aOther.begin(), aOther.end(), back_inserter(ret), Less());
+		items_.swap(ret);
+	}
+
+	size_t getTrigramCount() const noexcept { return postings.size(); }
+	size_t getPostingCount() const noexcept { return postingCount; }
+
+	// Estimated (hash nodes are assumed to contain the next pointer and the cached hash)
+	size_t getMemoryUsage() const noexcept {
+		size_t ret = postings.bucket_count() * sizeof(void*);
+		for (const auto& p : postings) {
+			ret += sizeof(typename PostingMap::value_type) + (sizeof(void*) * 2) + (p.second.capacity() * sizeof(const T*));
+		}
+
+		return ret;
+	}
+
+	void clear() noexcept {
+		postings.clear();
+		postingCount = 0;
+	}
+private:
+	typedef std::less<const T*> Less;
+
+	static uint32_t toKey(const string& aStr, size_t aPos) noexcept {
+		return static_cast<uint32_t>(static_cast<uint8_t>(aStr[aPos])) |
+			(static_cast<uint32_t>(static_cast<uint8_t>(aStr[aPos + 1])) << 8) |
+			(static_cast<uint32_t>(static_cast<uint8_t>(aStr[aPos + 2])) << 16);
+	}
+
+	// Calls the handler once for each unique trigram
+	template<class HandlerT>
+	static void forEachTrigram(const string& aStr, HandlerT&& aHandler) noexcept {
+		if (aStr.size() < MIN_PATTERN_LENGTH) {
+			return;
+		}
+
+		vector<uint32_t> keys;
+		keys.reserve(aStr.size() - MIN_PATTERN_LENGTH + 1);
+		for (size_t i = 0; i + MIN_PATTERN_LENGTH <= aStr.size(); ++i) {
+			keys.push_back(toKey(aStr, i));
+		}
+
+		sort(keys.begin(), keys.end());
+		keys.erase(unique(keys.begin(), keys.end()), keys.end());
+
+		for (auto k : keys) {
+			aHandler(k);
+		}
+	}
+
+	typedef GroupedItems PostingMap;
+
+	PostingMap postings;
+	size_t postingCount = 0;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_TRIGRAM_INDEX_H)
@@ -41,9 +41,45 @@ void UDPServer::listen() {
 		socket->setLocalIp4(CONNSETTING(BIND_ADDRESS));
 		socket->setLocalIp6(CONNSETTING(BIND_ADDRESS6));
 		socket->setV4only(false);
+
+		auto receivers = Socket::isReusePortSupported() ? max(SETTING(UDP_RECEIVE_SOCKETS), 1) : 1;
+		socket->setReusePort(receivers > 1);
 		port = socket->listen(Util::toString(CONNSETTING(UDP_PORT)));
+
+		for (auto i = 1; i < receivers; ++i) {
+			try {
+				auto s = make_unique<Socket>(Socket::TYPE_UDP);
+				s->setLocalIp4(CONNSETTING(BIND_ADDRESS));
+				s->setLocalIp6(CONNSETTING(BIND_ADDRESS6));
+				s->setV4only(false);
+				s->setReusePort(true);
+				s->listen(port);
+				extraSockets.push_back(move(s));
+			} catch (const SocketException& e) {
+				dcdebug("UDPServer::listen: failed to create an additional socket: %s\n", e.getError().c_str());
+				break;
+			}
+		}
+
+		if (workers.empty()) {
+			auto workerCount = max(SETTING(UDP_WORKER_THREADS), 1);
+			for (auto i = 0; i < workerCount; ++i) {
+				workers.push_back(make_unique<DispatcherQueue>(true));
+			}
+		}
+
 		start();
+
+		for (const auto& s: extraSockets) {
+			extraThreads.emplace_back([this, sock = s.get()] {
+				receive(*sock);
+
+				// there's no one to listen again, close the socket so that it won't receive the packets of the group anymore
+				sock->disconnect();
+			});
+		}
 	} catch(...) {
+		extraSockets.clear();
 		socket.reset();
 		throw;
 	}
@@ -57,40 +93,86 @@ void UDPServer::disconnect() {
 
 		join();
 
+		for (auto& t: extraThreads) {
+			t.join();
+		}
+
+		extraThreads.clear();
+		extraSockets.clear();
+
 		socket.reset();
 
 		stop = false;
 	}
 }
 
-UDPServer::UDPServer() : stop(false), pp(true) { }
+UDPServer::UDPServer() : stop(false) { }
 UDPServer::~UDPServer() { }
 
 #define BUFSIZE 8192
-int UDPServer::run() {
-	int len;
-	string remoteAddr;
+
+// Datagrams to read with a single call
+#define RECEIVE_BATCH 32
+
+// Errors caused by a single datagram (e.g. an ICMP port unreachable for an earlier send), the socket remains usable
+static bool isTransientError(int aError) noexcept {
+#ifdef _WIN32
+	return aError == WSAEINTR || aError == WSAENOBUFS || aError == WSAECONNREFUSED || aError == WSAECONNRESET || aError == WSAEMSGSIZE;
+#else
+	return aError == EINTR || aError == ENOBUFS || aError == ENOMEM || aError == ECONNREFUSED || aError == ECONNRESET;
+#endif
+}
+
+void UDPServer::receive(Socket& aSocket) noexcept {
+	vector<Socket::Datagram> datagrams(RECEIVE_BATCH);
+	for (auto& d: datagrams) {
+		d.buffer.resize(BUFSIZE);
+	}
 
 	while(!stop) {
 		try {
-			if(!socket->wait(400, true, false).first) {
+			if(!aSocket.wait(400, true, false).first) {
 				continue;
 			}
 
-			auto buf = vector<uint8_t>(BUFSIZE);
-			if((len = socket->read(buf.data(), BUFSIZE, remoteAddr)) > 0) {
-				pp.addTask([=] { handlePacket(buf, len, remoteAddr); });
-				continue;
+			auto count = aSocket.read(datagrams);
+			for (auto i = 0; i < count; ++i) {
+				const auto& d = datagrams[i];
+				if (d.len > 0) {
+					addPacket(ByteVector(d.buffer.begin(), d.buffer.begin() + d.len), d.ip);
+				}
 			}
 		} catch(const SocketException& e) {
-			dcdebug("SearchManager::run Error: %s\n", e.getError().c_str());
+			dcdebug("UDPServer::receive Error: %s\n", e.getError().c_str());
+			if (!isTransientError(e.getErrorCode())) {
+				return;
+			}
 		}
+	}
+}
+
+void UDPServer::addPacket(ByteVector&& aBuf, const string& aRemoteIp) noexcept {
+	auto& worker = workers[std::hash<string>()(aRemoteIp) % workers.size()];
+	worker->addTask([this, buf = move(aBuf), remoteIp = aRemoteIp] { 
+		handlePacket(buf, remoteIp); 
+	});
+}
+
+int UDPServer::run() {
+	while(!stop) {
+		receive(*socket);
+		if (stop) {
+			break;
+		}
+
+		// the additional sockets are still listening, stay in the same group with them (the port may have been chosen randomly)
+		auto listenPort = extraSockets.empty() ? Util::toString(CONNSETTING(UDP_PORT)) : port;
 
 		bool failed = false;
 		while(!stop) {
 			try {
 				socket->disconnect();
-				port = socket->listen(Util::toString(CONNSETTING(UDP_PORT)));
+				port = socket->listen(listenPort);
 				if(failed) {
 					LogManager::getInstance()->message("Search enabled again", LogMessage::SEV_INFO, STRING(CONNECTIVITY));
 					failed = false;
@@ -115,12 +197,13 @@ int UDPServer::run() {
 	return 0;
 }
 
-void UDPServer::handlePacket(const ByteVector& aBuf, size_t aLen, const string& aRemoteIp) {
-	string x(aBuf.begin(), aBuf.begin() + aLen);
+void UDPServer::handlePacket(const ByteVector& aBuf, const string& aRemoteIp) {
+	auto len = aBuf.size();
+	string x(aBuf.begin(), aBuf.end());
 
 	//check if this packet has been encrypted
-	if (SETTING(ENABLE_SUDP) && aLen >= 32 && ((aLen & 15) == 0)) {
-		SearchManager::getInstance()->decryptPacket(x, aLen, aBuf);
+	if (SETTING(ENABLE_SUDP) && len >= 32 && ((len & 15) == 0)) {
+		SearchManager::getInstance()->decryptPacket(x, len, aBuf);
 	}
 
 	if (x.empty())
@@ -39,12 +39,23 @@ private:
 
 	virtual int run();
 
+	// Reads datagrams from the socket until the server is stopped or the socket fails
+	// Errors caused by a single datagram are ignored
+	void receive(Socket& aSocket) noexcept;
+
 	std::unique_ptr<Socket> socket;
 	string port;
-	bool stop;
+	atomic<bool> stop;
+
+	// Additional sockets listening on the same port (SO_REUSEPORT), each with its own receiving thread
+	vector<unique_ptr<Socket>> extraSockets;
+	vector<std::thread> extraThreads;
+
+	// Packets from the same sender are always handled by the same worker so that they are processed in order
+	vector<unique_ptr<DispatcherQueue>> workers;
+	void addPacket(ByteVector&& aBuf, const string& aRemoteIp) noexcept;
 
-	DispatcherQueue pp;
-	void handlePacket(const ByteVector& aBuf, size_t aLen, const string& aRemoteIp);
+	void handlePacket(const ByteVector& aBuf, const string& aRemoteIp);
 
 	// Search results
 	void handle(AdcCommand::RES, AdcCommand& c, const string& aRemoteIp) noexcept;
@@ -34,7 +34,7 @@
 
 namespace dcpp {
 
-SharedMutex Identity::cs;
+SharedMutex Identity::cs[Identity::LOCK_STRIPES];
 
 OnlineUser::OnlineUser(const UserPtr& ptr, const ClientPtr& client_, uint32_t sid_) : identity(ptr, sid_), client(client_) {
 }
@@ -124,7 +124,7 @@ uint8_t Identity::getSlots() const noexcept {
 
 void Identity::getParams(ParamMap& sm, const string& prefix, bool compatibility) const noexcept {
 	{
-		RLock l(cs);
+		RLock l(getLock());
 		for(auto& i: info) {
 			sm[prefix + string((char*)(&i.first), 2)] = i.second;
 		}
@@ -195,15 +195,39 @@ Identity::Identity(const Identity& rhs) : Flags(), sid(0) {
 }
 
 Identity& Identity::operator = (const Identity& rhs) {
-	WLock l(cs);
+	if (this == &rhs) {
+		return *this;
+	}
+
+	// The identities may use the same lock, don't hold both of them at the same time
+	InfMap rhsInfo;
+	{
+		RLock l(rhs.getLock());
+		rhsInfo = rhs.info;
+	}
+
+	WLock l(getLock());
 	*static_cast<Flags*>(this) = rhs;
 	user = rhs.user;
 	sid = rhs.sid;
-	info = rhs.info;
+	info.swap(rhsInfo);
 	adcTcpConnectMode = rhs.adcTcpConnectMode;
 	return *this;
 }
 
+SharedMutex& Identity::getLock() const noexcept {
+	auto p = reinterpret_cast<uintptr_t>(this);
+	return cs[((p >> 4) ^ (p >> 12)) % LOCK_STRIPES];
+}
+
+Identity::InfMap::const_iterator Identity::findField(short aCode) const noexcept {
+	auto i = lower_bound(info.begin(), info.end(), aCode, [](const InfMap::value_type& aField, short aCode) {
+		return aField.first < aCode;
+	});
+
+	return i != info.end() && i->first == aCode ? i : info.end();
+}
+
 string Identity::getApplication() const noexcept {
 	auto application = get("AP");
 	auto version = get("VE");
@@ -225,24 +249,34 @@ string Identity::getCountry() const noexcept {
 }
 
 string Identity::get(const char* name) const noexcept {
-	RLock l(cs);
-	auto i = info.find(*(short*)name);
+	RLock l(getLock());
+	auto i = findField(*(short*)name);
 	return i == info.end() ? Util::emptyString : i->second;
 }
 
 bool Identity::isSet(const char* name) const noexcept {
-	RLock l(cs);
-	auto i = info.find(*(short*)name);
-	return i != info.end();
+	RLock l(getLock());
+	return findField(*(short*)name) != info.end();
 }
 
 
 void Identity::set(const char* name, const string& val) noexcept {
-	WLock l(cs);
-	if(val.empty())
-		info.erase(*(short*)name);
-	else
-		info[*(short*)name] = val;
+	auto code = *(short*)name;
+
+	WLock l(getLock());
+	auto i = lower_bound(info.begin(), info.end(), code, [](const InfMap::value_type& aField, short aCode) {
+		return aField.first < aCode;
+	});
+
+	auto exists = i != info.end() && i->first == code;
+	if(val.empty()) {
+		if (exists)
+			info.erase(i);
+	} else if (exists) {
+		i->second = val;
+	} else {
+		info.emplace(i, code, val);
+	}
 }
 
 StringList Identity::getSupports() const noexcept {
@@ -266,7 +300,7 @@ bool Identity::isMe() const noexcept {
 std::map<string, string> Identity::getInfo() const noexcept {
 	std::map<string, string> ret;
 
-	RLock l(cs);
+	RLock l(getLock());
 	for(const auto& i: info) {
 		ret[string((char*)(&i.first), 2)] = i.second;
 	}
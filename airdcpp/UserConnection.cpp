@@ -28,8 +28,10 @@
 #include "DebugManager.h"
 #include "FavoriteManager.h"
 #include "Message.h"
+#include "ThrottleManager.h"
 
 
+#include "Bundle.h"
 #include "Download.h"
 
 namespace dcpp {
@@ -155,6 +157,7 @@ void UserConnection::connect(const AddressInfo& aServer, const string& aPort, co
 
 	socket = BufferedSocket::getSocket(0);
 	socket->addListener(this);
+	socket->setKernelTls(SETTING(KERNEL_TLS));
 
 	//string expKP;
 	if (aUser) {
@@ -190,6 +193,21 @@ void UserConnection::setUser(const UserPtr& aUser) noexcept {
 			}
 		}
 	}
+
+	updateLimiters();
+}
+
+void UserConnection::updateLimiters() noexcept {
+	if (!socket || !user) {
+		return;
+	}
+
+	auto priority = Priority::DEFAULT;
+	if (isSet(FLAG_DOWNLOAD) && download && download->getBundle()) {
+		priority = download->getBundle()->getPriority();
+	}
+
+	socket->setLimiters(ThrottleManager::getInstance()->getLimiters(isSet(FLAG_UPLOAD), hubUrl, user, priority));
 }
 
 void UserConnection::maxedOut(size_t qPos /*0*/) {
@@ -210,6 +228,7 @@ void UserConnection::accept(const Socket& aServer) {
 	dcassert(!socket);
 	socket = BufferedSocket::getSocket(0);
 	socket->addListener(this);
+	socket->setKernelTls(SETTING(KERNEL_TLS));
 
 	/*
 	Technically only one side needs to verify KeyPrint, 
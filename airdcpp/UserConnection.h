@@ -168,14 +168,18 @@ public:
 	bool isSecure() const noexcept { return socket && socket->isSecure(); }
 	bool isTrusted() const noexcept { return socket && socket->isTrusted(); }
 	std::string getEncryptionInfo() const noexcept { return socket ? socket->getEncryptionInfo() : Util::emptyString; }
+	bool isKernelTls() const noexcept { return socket && socket->isKernelTls(); }
 	ByteVector getKeyprint() const noexcept { return socket ? socket->getKeyprint() : ByteVector(); }
 	bool verifyKeyprint(const string& expKeyp, bool allowUntrusted) noexcept { return socket ? socket->verifyKeyprint(expKeyp, allowUntrusted) : true; }
 
 	const string& getRemoteIp() const noexcept { if(socket) return socket->getIp(); else return Util::emptyString; }
 	Download* getDownload() noexcept { dcassert(isSet(FLAG_DOWNLOAD)); return download; }
-	void setDownload(Download* d) noexcept { dcassert(isSet(FLAG_DOWNLOAD)); download = d; }
+	void setDownload(Download* d) noexcept { dcassert(isSet(FLAG_DOWNLOAD)); download = d; updateLimiters(); }
 	Upload* getUpload() noexcept { dcassert(isSet(FLAG_UPLOAD)); return upload; }
-	void setUpload(Upload* u) noexcept { dcassert(isSet(FLAG_UPLOAD)); upload = u; }
+	void setUpload(Upload* u) noexcept { dcassert(isSet(FLAG_UPLOAD)); upload = u; updateLimiters(); }
+
+	// Update the hub/user/priority specific bandwidth limiters of the socket
+	void updateLimiters() noexcept;
 	
 	void handle(AdcCommand::SUP t, const AdcCommand& c) { fire(t, this, c); }
 	void handle(AdcCommand::INF t, const AdcCommand& c) { fire(t, this, c); }
@@ -199,6 +199,10 @@ class StringSearch;
 
 class TigerHash;
 
+class TokenBucket;
+typedef std::shared_ptr<TokenBucket> TokenBucketPtr;
+typedef std::vector<TokenBucketPtr> TokenBucketList;
+
 class Transfer;
 
 typedef HashValue<TigerHash> TTHValue;
@@ -430,40 +430,39 @@ void ADLSearchManager::save(bool force /*false*/) noexcept {
 	SettingsManager::saveSettingFile(xml, CONFIG_DIR, CONFIG_NAME);
 }
 
-void ADLSearchManager::MatchesFile(DestDirList& destDirVector, const DirectoryListing::File::Ptr& currentFile, const string& aAdcPath) noexcept {
+void ADLSearchManager::MatchesFile(DestDirList& destDirVector, const DirectoryListing::FileStore::Item& currentFile, const string& aAdcPath) noexcept {
 	// Add to any substructure being stored
 	for(auto& id: destDirVector) {
 		if(id.subdir != NULL) {
-			auto copyFile = make_shared<DirectoryListing::File>(*currentFile, this);
 			dcassert(id.subdir->isVirtual());
-
-			id.subdir->files.push_back(copyFile);
+			id.subdir->files.push_back(currentFile, this);
 		}
 		id.fileAdded = false;	// Prepare for next stage
 	}
 
 	// Prepare to match searches
-	if(currentFile->getName().size() < 1) {
+	if(currentFile.getName().size() < 1) {
 		return;
 	}
 
 	dcassert(Util::isAdcDirectoryPath(aAdcPath));
 
+	const string fileName(currentFile.getName());
+
 	// Use NMDC path for matching due to compatibility reasons
-	const auto nmdcPath = Util::toNmdcFile(aAdcPath + currentFile->getName());
+	const auto nmdcPath = Util::toNmdcFile(aAdcPath + fileName);
 
 	// Match searches
 	for(auto& is: collection) {
 		if(destDirVector[is.ddIndex].fileAdded) {
 			continue;
 		}
-		if(is.matchesFile(currentFile->getName(), nmdcPath, currentFile->getSize())) {
-			auto copyFile = make_shared<DirectoryListing::File>(*currentFile, this);
-			destDirVector[is.ddIndex].dir->files.push_back(copyFile);
+		if(is.matchesFile(fileName, nmdcPath, currentFile.getSize())) {
+			destDirVector[is.ddIndex].dir->files.push_back(currentFile, this);
 			destDirVector[is.ddIndex].fileAdded = true;
 
 			if (is.isAutoQueue){
-				auto fileInfo = BundleFileAddData(currentFile->getName(), currentFile->getTTH(), currentFile->getSize(), Priority::DEFAULT, currentFile->getRemoteDate());
+				auto fileInfo = BundleFileAddData(fileName, currentFile.getTTH(), currentFile.getSize(), Priority::DEFAULT, currentFile.getRemoteDate());
 				try {
 					auto options = BundleAddOptions(SETTING(DOWNLOAD_DIRECTORY), getUser(), this);
 					QueueManager::getInstance()->createFileBundleHooked(options, fileInfo);
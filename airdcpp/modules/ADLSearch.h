@@ -164,7 +164,7 @@ private:
 	// Throws AbortException
 	void matchRecurse(DestDirList& /*aDestList*/, const DirectoryListing::Directory::Ptr& /*aDir*/, const string& aAdcPath, DirectoryListing& /*aDirList*/);
 	// Search for file match
-	void MatchesFile(DestDirList& destDirVector, const DirectoryListing::File::Ptr& currentFile, const string& aAdcPath) noexcept;
+	void MatchesFile(DestDirList& destDirVector, const DirectoryListing::FileStore::Item& currentFile, const string& aAdcPath) noexcept;
 	// Search for directory match
 	void MatchesDirectory(DestDirList& destDirVector, const DirectoryListing::Directory::Ptr& currentDir, const string& aAdcPath) noexcept;
 	// Step up directory